@@ -133,6 +133,9 @@ On Oct 22, 2016 10:07 PM, "Simon Monk" <srmonk@gmail.com> wrote:
 #define CC1101_TXFIFO       0x3F
 #define CC1101_RXFIFO       0x3F
 
+// Number of configuration registers, CC1101_IOCFG2 (0x00) to CC1101_TEST0 (0x2E)
+#define CC1101_CONFIG_SIZE  0x2F
+
 // the restriction the library enforces on maximum packet size
 #define MAX_PACKET_LEN 61
 // Most modules come with 26Mhz crystal
@@ -140,6 +143,71 @@ On Oct 22, 2016 10:07 PM, "Simon Monk" <srmonk@gmail.com> wrote:
 #define  CC1101_CRYSTAL_FREQUENCY 26000000ul
 #endif
 
+// SPIClass::transferBytes() hands a whole buffer to the SPI peripheral in one call
+// (ESP32). Other platforms can define this if their SPIClass has the same call.
+#if defined(ARDUINO_ARCH_ESP32) && !defined(CC1101_BLOCK_TRANSFER)
+#define CC1101_BLOCK_TRANSFER
+#endif
+
+// How readBurstRegister()/writeBurstRegister() move their data
+typedef enum {
+	CC1101_BURST_BYTE_LOOP,		// one spi.transfer() per byte, works on any SPIClass
+	CC1101_BURST_BLOCK			// one spi.transferBytes() per burst (CC1101_BLOCK_TRANSFER only)
+} cc1101_burst_mode_t;
+
+// SPI bus cost counters, see CC1101::spiStats
+typedef struct {
+	uint32_t transactions;		// chip select cycles
+	uint32_t bytes;				// bytes clocked over the bus
+	uint32_t writesSkipped;		// register writes dropped as the register already held the value
+} cc1101_spi_stats_t;
+
+// One packet drained from the RX FIFO by CC1101::getPackets()
+typedef struct {
+	byte size;							// payload length, 0 if the slot is unused
+	byte data[MAX_PACKET_LEN];
+	byte status[2];						// RSSI, CRC OK / LQI as appended by the chip
+} cc1101_frame_t;
+
+// Receive counters, see CC1101::rxStats
+typedef struct {
+	uint32_t drains;			// getPackets() calls that found at least one packet
+	uint32_t frames;			// packets handed to the caller
+	uint32_t recovered;			// packets after the first in a drain
+	uint32_t flushes;			// RX FIFO flushed (overflow or a corrupt length byte)
+	uint32_t overflows;			// RX FIFO overflow seen
+	uint32_t incomplete;		// gave up waiting for the rest of a packet
+} cc1101_rx_stats_t;
+
+// Deadlines for waiting on the chip. It is ready (MISO low) well within a millisecond of
+// a reset or wake up, calibration and settling into RX take ~0.8ms.
+#define CC1101_MISO_TIMEOUT_US	2000
+#define CC1101_STATE_TIMEOUT_US	5000
+// A wait polls flat out for this long, then sleeps a tick (delay(1)) between polls
+#define CC1101_WAIT_SPIN_US		1000
+
+// Why a wait on the chip gave up, see CC1101::error
+typedef enum {
+	CC1101_OK,
+	CC1101_ERROR_MISO,			// MISO stayed high, the chip is not ready (crystal, wiring)
+	CC1101_ERROR_STATE			// the chip did not reach the state asked for
+} cc1101_error_t;
+
+// Wait counters, see CC1101::waitStats
+typedef struct {
+	uint32_t waits;				// waits not over at the first poll
+	uint32_t timeouts;			// waits given up
+	uint32_t totalUs;			// time spent in waits
+	uint32_t maxUs;				// longest wait
+} cc1101_wait_stats_t;
+
+// Frequency synthesiser calibration counters, see CC1101::calStats
+typedef struct {
+	uint32_t calibrations;		// calibrate() runs
+	uint32_t restores;			// cached FSCAL3..FSCAL1 written back
+	uint32_t lastUs;			// how long the last calibrate() took
+} cc1101_cal_stats_t;
+
 //************************************* class **************************************************//
 
 // An instance of the CC1101 represents a CC1101 chip
@@ -177,10 +245,80 @@ class CC1101 {
 		// however or SoftwareSPI. See the BluePill_SPI2 for a different configuration
 		SPIClass& spi;
 		
-		void waitMiso();
+		// Waits for the chip to be ready, false if MISO is still high at CC1101_MISO_TIMEOUT_US
+		bool waitMiso();
 		void chipSelect();
         void chipDeselect();
 
+		// Group several register accesses into one chip select cycle. Calls nest,
+		// only the outermost pair toggles CSN.
+		void beginTransaction();
+		void endTransaction();
+
+		// Ends a burst without ending an outer transaction
+		void restartBurstCycle();
+
+		// Transfers a single byte and counts it in spiStats
+		byte spiTransfer(byte value);
+
+		// Running SPI bus cost. Take a copy before and after an operation to see what it costs.
+		cc1101_spi_stats_t spiStats = {0, 0, 0};
+		void resetSpiStats();
+
+		// Burst transfer path, the byte loop is kept as a fallback and for comparison
+#ifdef CC1101_BLOCK_TRANSFER
+		cc1101_burst_mode_t burstMode = CC1101_BURST_BLOCK;
+#else
+		cc1101_burst_mode_t burstMode = CC1101_BURST_BYTE_LOOP;
+#endif
+
+		// Nesting level of beginTransaction()
+		byte transactionDepth = 0;
+
+		// Last value written to each configuration register, so writes that
+		// would not change anything are dropped. Bit n of shadowValid is set
+		// when shadow[n] is known to match the chip.
+		byte shadow[CC1101_CONFIG_SIZE];
+		uint64_t shadowValid = 0;
+
+		// Receive counters for getPackets()
+		cc1101_rx_stats_t rxStats = {0, 0, 0, 0, 0, 0};
+
+		// Length byte of a packet read from the FIFO before the rest of it had arrived,
+		// 0 if none. The next drain carries on from it, SFRX drops it.
+		byte pendingSize = 0;
+		uint32_t pendingSince = 0;
+
+		// Every wait on the chip has a deadline. The first one missed is kept here until the
+		// caller sets it back to CC1101_OK, normally after reset() and a new configuration.
+		cc1101_error_t error = CC1101_OK;
+		cc1101_wait_stats_t waitStats = {0, 0, 0, 0};
+
+		// Frequency synthesiser calibration. With MCSM0 FS_AUTOCAL the chip calibrates on
+		// every IDLE -> RX/TX, ~720us on top of ~90us settling, and a frame arriving
+		// meanwhile is lost. setManualCalibration(true) turns that off and calibrate()
+		// keeps the result (FSCAL3..FSCAL1), written back by setRXstate() after a power
+		// down or WOR. The caller calibrates again when the temperature has moved or
+		// after a while, setFrequency() does it itself. A new FSCTRL0 needs one too.
+		bool manualCal = false;
+		bool fscalValid = false;		// fscal holds a calibration for the current frequency
+		bool fscalRestore = false;		// fscal to be written back before the next SRX
+		byte fscal[3];					// FSCAL3, FSCAL2, FSCAL1
+		cc1101_cal_stats_t calStats = {0, 0, 0};
+		void restoreCalibration();
+
+		// Called between the polls of a wait that started at startUs, false once timeoutUs
+		// has passed. Sleeps a tick per poll after CC1101_WAIT_SPIN_US.
+		bool waitPoll(uint32_t startUs, uint32_t timeoutUs);
+		// Counts a finished wait in waitStats and a failure in error, returns result
+		cc1101_error_t waitDone(uint32_t startUs, cc1101_error_t result);
+
+		// Reads RXBYTES until two reads agree (errata SWRZ020)
+		byte readRxBytes();
+
+		// getPackets() into an array (frames) or through pointers (slots)
+		byte drainPackets(cc1101_frame_t *frames, cc1101_frame_t *const *slots, byte maxFrames);
+
 		// Only for debugging
 		void printRegs();
 
@@ -196,20 +334,56 @@ class CC1101 {
 		
 		void begin(const uint32_t freq);
 
+		// Alternative to begin(freq). Resets the chip and uploads a complete register image
+		// (CC1101_CONFIG_SIZE bytes, CC1101_IOCFG2 to CC1101_TEST0) in a single burst.
+		// Sets the chip to IDLE state.
+		void begin(const byte *config);
+
+		// Uploads a complete register image in a single burst. Sets the chip to IDLE state.
+		void writeConfiguration(const byte *config);
+
+		// Reads the configuration registers back in a single burst and returns true if they
+		// match config. FSCAL3..FSCAL1 are not compared as calibration changes them.
+		bool verifyConfiguration(const byte *config);
+
+		// Reads the configuration registers back in a single burst and returns true if they
+		// match everything written since the reset, including changes made after the upload.
+		bool verifyConfiguration();
+
 		// this is a sendPacket variant that should work with very low MCU clock rates and/or SPI bus speed.
 		// Fills the TX buffer before actually start the transmission.
 		// It cannot send packet with long preamble (to wake a remote WakeOnRadio chip)
 		bool sendPacketSlowMCU(const byte *txBuffer, byte size);
 
-		// Sets the chip to RX. Actually waits until the state is RX.
-		void setRXstate(void);
+		// Sets the chip to RX. Actually waits until the state is RX, up to
+		// CC1101_STATE_TIMEOUT_US.
+		cc1101_error_t setRXstate(void);
 
 		// read data received from CC1101 RXFIFO. Stores the data to packet and returns the packet size.
 		// reurns 0 if no data is pending.
 		// The packet must be checked for size>0 && crcok() before used.
 		// Sets the state to RX
+		// A getPackets() of one packet, any further packets stay in the FIFO for the next call.
 		byte getPacket(byte *packet);
 
+		// Drains every complete packet in the RX FIFO into frames (up to maxFrames) and
+		// returns the number read. Intended for MCSM1 RXOFF_MODE = RX (stay in RX) so
+		// back to back packets are kept and no IDLE -> RX calibration is needed. The
+		// FIFO is only flushed on overflow, a corrupt length byte or a packet still short
+		// RX_COMPLETE_TIMEOUT after its length byte; one still arriving is left for the
+		// next call (its end of packet) rather than waited for. If the chip has
+		// left RX it is put back in RX.
+		// Each frame must be checked with frameCrcOk() before used.
+		byte getPackets(cc1101_frame_t *frames, byte maxFrames);
+		// Same, but frame i is written to *slots[i] so the frames can go straight into
+		// buffers that aren't next to each other (no copy afterwards).
+		byte getPackets(cc1101_frame_t *const *slots, byte maxFrames);
+
+		// Same as getRSSIdbm(), getLQI() and crcok() for a frame from getPackets()
+		static int16_t frameRSSIdbm(const cc1101_frame_t *frame);
+		static byte frameLQI(const cc1101_frame_t *frame);
+		static bool frameCrcOk(const cc1101_frame_t *frame);
+
 		// Sends a strobe (1 byte command) to the CC1101 chip.
 		byte strobe(byte strobe);
 		
@@ -270,8 +444,17 @@ class CC1101 {
 		// Reports if the last received packet had a correct CRC.
 		bool crcok();
 
-		// Sends the IDLE strobe to chip and waits until the state becomes IDLE.
-		void setIDLEstate();
+		// Sends the IDLE strobe to chip and waits until the state becomes IDLE, up to
+		// CC1101_STATE_TIMEOUT_US.
+		cc1101_error_t setIDLEstate();
+
+		// Turns FS_AUTOCAL off (on) and calibrates once, see manualCal. Sets the chip to
+		// IDLE state when turning it on. Call again after begin() or reset().
+		cc1101_error_t setManualCalibration(bool on);
+
+		// Calibrates the frequency synthesiser (SCAL) and caches the result. Sets the chip
+		// to IDLE state, waits up to CC1101_STATE_TIMEOUT_US.
+		cc1101_error_t calibrate();
 		
 		// Sends packets using printf formatting. Somewhat heavy for small microcontrollers
 		// but very flexible. Sets the chip to RX state
@@ -298,7 +481,7 @@ class CC1101 {
 		byte getState();
 		
 		// Sets the frequency of the carrier signal. Sets the chip to IDLE state.
-		// No need to use it in setup as begin calls it internally
+		// No need to use it in setup as begin calls it internally. Calibrates if manualCal.
 		void setFrequency(const uint32_t freq);
 		
 		// Do not use it unless for interoperability with an already installed system
@@ -343,6 +526,7 @@ class CC1101 {
 		// Sets the chip to WakeOnRadio state. The chip sleeps for "timeout" milliseconds
 		// and briefly wakes up to check for incoming message or preamble. If no message is
 		// present it is going for sleep and the cycle repeats.
+		// Both this and wor2rx() leave MCSM0 FS_AUTOCAL off after setManualCalibration(true).
 		void wor(uint16_t timeout=1000); //  1000ms=1sec cycle
 
 		// Should be used immediatelly after WOR -> WakeUp -> getPacket() see the WOR example
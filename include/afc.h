@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+#include "CC1101_RFx.h"
+
+/*
+    Automatic frequency control. Cheap CC1101 modules are all a little off frequency
+    (see the README frequency table) and drift with temperature. After each good packet
+    the CC1101 reports the offset it measured (FREQEST, f_xosc/2^14 = ~1.59kHz steps),
+    which is filtered and applied through FSCTRL0. FSCTRL0 moves both receive and
+    transmit, so our requests follow the main unit as well.
+
+    FREQEST is only good until the next packet starts, so the radio task reads it as soon
+    as it is woken at the end of a packet, before draining the FIFO.
+
+    The correction is saved in NVS so the next boot starts on frequency. The radio task
+    changes it, the decode task saves it (afc_save()), a flash write would hold up the radio.
+*/
+
+#define AFC_STEP_HZ         (CC1101_CRYSTAL_FREQUENCY / 16384.0)   // FREQEST/FSCTRL0 resolution
+#define AFC_MAX_OFFSET      48          // Largest correction applied (steps, ~76kHz), the channel filter is 325kHz wide
+#define AFC_FILTER          8           // Weight of the running estimate against a new FREQEST reading
+#define AFC_LOCK_FRAMES     4           // Good frames before the first correction is applied
+#define AFC_SAVE_INTERVAL   3600000     // Minimum time between NVS writes (ms), flash wears out
+
+typedef struct {
+    int8_t fsctrl0;             // Correction in use (steps)
+    int8_t saved_fsctrl0;       // Correction stored in NVS, decode task only
+    int8_t last_freqest;        // Last FREQEST reading (steps, relative to fsctrl0)
+    float estimate;             // Filtered absolute offset (steps)
+    uint32_t frames_good;       // Frames with a good CRC
+    uint32_t frames_bad;        // Frames with a bad CRC
+    uint32_t updates;           // FREQEST readings used
+    uint32_t corrections;       // Times FSCTRL0 was changed
+    uint32_t saves;             // NVS writes
+    uint32_t last_save_ms;
+    volatile bool b_restarted;  // afc_restart() since the last save, saved without waiting for AFC_SAVE_INTERVAL
+} afc_state_t;
+
+void afc_begin(afc_state_t *afc);
+void afc_apply(CC1101 &radio, const afc_state_t *afc);
+void afc_restart(afc_state_t *afc);
+void afc_count_frame(afc_state_t *afc, bool b_crc_ok);
+bool afc_update(CC1101 &radio, afc_state_t *afc, int8_t freqest);
+void afc_save(afc_state_t *afc);
+int32_t afc_offset_hz(const afc_state_t *afc);
@@ -7,3 +7,11 @@
 #define MQTT_USER "MQTTUSER"
 #define MQTT_USER_PASSWORD "MQTTPASSWORD"
 #define SNTP_TIME_SERVER "pool.ntp.org"
+
+// iBoost units to monitor (the address is the first two bytes of every packet), the first
+// one is displayed. Leave undefined to use the strongest unit in range.
+// #define IBOOST_ADDRESSES {0x23b3}
+
+// Copies of a frame heard within this long of the first are dropped (ms), 0 keeps them all.
+// Leave undefined for 2 seconds.
+// #define DEDUP_HORIZON 2000
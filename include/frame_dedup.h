@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Drops repeats of a frame we have already handled. Buddies, the sender and the main
+    unit all send the same frame more than once, and each copy used to cost a decode,
+    JSON, MQTT publishes, display events and an LED blink for nothing new.
+
+    Frames are keyed on address, type, length and a 32 bit FNV-1a hash of the whole
+    frame, and kept in a small open addressed table indexed by the hash. A frame with
+    the same key as one first seen less than the horizon ago is a duplicate. The first
+    sighting isn't moved on by its copies, so an unchanging frame still gets through
+    once per horizon. When the probe run is full the oldest entry in it goes.
+
+    Plain C with no Arduino dependency so the host tools can use it. Only the decode
+    task uses it, so no lock.
+*/
+
+#define DEDUP_SLOTS             16          // Table size, a power of 2
+#define DEDUP_PROBES            4           // Slots looked at from the hash index
+#define DEDUP_DEFAULT_HORIZON   2000        // Copies within this of the first are dropped (ms), see config_example.h
+
+typedef struct {
+    uint32_t hash;              // FNV-1a of the frame
+    uint16_t address;
+    uint8_t type;
+    uint8_t size;
+    uint32_t first_ms;          // First sighting
+    bool b_used;
+} dedup_entry_t;
+
+typedef struct {
+    uint32_t horizon_ms;        // 0 and nothing is a duplicate
+    uint32_t frames;            // Frames checked
+    uint32_t duplicates;        // Frames dropped
+    uint32_t evictions;         // Entries replaced before their horizon was up
+    dedup_entry_t entries[DEDUP_SLOTS];
+} frame_dedup_t;
+
+void frame_dedup_begin(frame_dedup_t *dedup, uint32_t horizon_ms);
+bool frame_dedup_check(frame_dedup_t *dedup, const uint8_t *packet, uint8_t size, uint32_t now_ms);
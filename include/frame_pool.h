@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "CC1101_RFx.h"
+
+/*
+    Fixed pool of receive buffers between the radio and the decoder. The radio task
+    takes free buffers, has CC1101::getPackets() drain the FIFO straight into them and
+    queues their indices, then goes back to the radio. The decode task handles each buffer
+    (parsing, units, display, MQTT) and gives it back. Only the one byte index goes
+    through the queues, the frame is never copied and nothing is allocated after
+    frame_pool_begin().
+
+    If the decoder falls behind and the pool is empty the frame is left in the CC1101's
+    FIFO (and lost if that overflows), each time is counted in exhausted.
+*/
+
+#define FRAME_POOL_SIZE     8           // Buffers, two RX_BATCH_SIZE drains
+
+typedef struct {
+    cc1101_frame_t frame;       // Payload, RSSI and CRC OK / LQI
+    int64_t arrival_us;         // GDO0 interrupt time (esp_timer_get_time()), 0 if found by the backstop poll
+    uint32_t arrival_ms;        // Same on the millis() clock
+} rx_buffer_t;
+
+typedef struct {
+    uint32_t submitted;         // Buffers queued for the decoder
+    uint32_t exhausted;         // Drains cut short with no free buffer
+    uint8_t in_use;             // Buffers held by the radio or decoder now
+    uint8_t max_in_use;         // High water mark of in_use
+} frame_pool_stats_t;
+
+bool frame_pool_begin(void);
+uint8_t frame_pool_alloc(uint8_t *indices, uint8_t count);
+void frame_pool_exhausted(void);
+rx_buffer_t *frame_pool_get(uint8_t index);
+void frame_pool_submit(uint8_t index);
+bool frame_pool_receive(uint8_t *index, TickType_t wait);
+void frame_pool_release(uint8_t index);
+void frame_pool_snapshot(frame_pool_stats_t *copy);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Grid power between main unit answers, from the sender's (clamp's) own frames. The 40
+    sample bytes of a sender frame look like the rectified current waveform, and their
+    sum follows the size of the main unit's P1 reading closely, e.g. in notes/packet.txt
+    ~230 for 250W, ~350 for 460W and ~2130 for 3500W. The clamp can't tell import from
+    export, so the direction comes from the last main unit frame.
+
+    The sum to watts line is fitted as we go: each main unit reading is paired with the
+    sender frame heard just before it and added to a least squares fit that slowly
+    forgets old pairs. Until the pairs cover a wide enough range the line goes through
+    zero. No estimate is given before GRID_MIN_PAIRS pairs or once the direction is more
+    than GRID_SIGN_TIMEOUT old.
+
+    Plain C with no Arduino dependency so the host tools can use it.
+*/
+
+#define GRID_MIN_PAIRS      3           // Pairs before an estimate is given
+#define GRID_PAIR_WINDOW    6000        // Sender frame must be this recent to pair with a main unit reading (ms)
+#define GRID_SIGN_TIMEOUT   60000       // Import/export direction is trusted this long (ms)
+#define GRID_FIT_DECAY      0.98f       // Weight kept by the fit per new pair, ~50 pairs memory
+#define GRID_MIN_SPREAD     100.0f      // Sample sum standard deviation needed to fit an offset
+
+typedef struct {
+    float weight;               // Decayed sums for the least squares fit
+    float sum_x;                // x = sample sum
+    float sum_y;                // y = watts, always positive
+    float sum_xx;
+    float sum_xy;
+    uint32_t pairs;             // Pairs ever added
+    int8_t sign;                // 1 importing, -1 exporting, 0 unknown
+    uint32_t main_unit_ms;      // Last main unit reading
+    uint32_t sender_ms;         // Last sender frame
+    uint32_t sender_sum;        // Its sample sum
+    bool b_sender_valid;        // Not yet paired or too old
+    uint32_t estimates;         // Sender frames turned into readings
+} grid_estimate_t;
+
+void grid_estimate_begin(grid_estimate_t *grid);
+bool grid_estimate_sender(grid_estimate_t *grid, const uint8_t *samples, uint8_t count, uint32_t now_ms, int32_t *watts);
+void grid_estimate_main_unit(grid_estimate_t *grid, int32_t watts, uint32_t now_ms);
+bool grid_estimate_line(const grid_estimate_t *grid, float *scale, float *offset);
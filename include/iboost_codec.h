@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Layout of the iBoost frames and a decoder/encoder for them. Header only with no
+    Arduino dependency so the host tools (support/host) use exactly the same code.
+
+    Every frame starts with the 16 bit address of the installation (big endian, e.g.
+    23,b3) and a frame type byte. Multi-byte values are little endian and read a byte
+    at a time, so nothing depends on alignment or on the size of long.
+
+    Offsets are of the payload as CC1101::getPackets() returns it, without the length
+    byte or the appended status bytes. See notes/packet.txt for captures.
+*/
+
+// Frame types, byte 2
+enum {
+    IBOOST_FRAME_SENDER = 0x01,         // Clamp on the meter tails, about every 10s
+    IBOOST_FRAME_BUDDY = 0x21,          // Buddy (or us) asking the main unit for a counter
+    IBOOST_FRAME_MAIN_UNIT = 0x22       // Main unit status and the counter asked for
+};
+
+typedef struct {
+    uint8_t offset;
+    uint8_t size;                       // Bytes, 1, 2 or 4
+} iboost_field_t;
+
+// Common to all frames
+static constexpr iboost_field_t IBOOST_ADDRESS = {0, 2};           // Big endian
+static constexpr iboost_field_t IBOOST_TYPE = {2, 1};
+
+// Sender, 0x01
+static constexpr uint8_t IBOOST_SENDER_SIZE = 44;
+static constexpr iboost_field_t IBOOST_SENDER_SAMPLES = {4, 40};   // Run of sample bytes, not decoded yet
+
+// Buddy request, 0x21
+static constexpr uint8_t IBOOST_BUDDY_SIZE = 29;
+static constexpr iboost_field_t IBOOST_BUDDY_REQUEST = {12, 1};    // SAVED_* code
+
+// Main unit, 0x22
+static constexpr uint8_t IBOOST_MAIN_UNIT_SIZE = 37;
+static constexpr iboost_field_t IBOOST_MAIN_BOOST_TIME = {5, 1};   // Manual boost remaining (minutes)
+static constexpr iboost_field_t IBOOST_MAIN_NOT_HEATING = {6, 1};  // 0 while solar is heating the tank
+static constexpr iboost_field_t IBOOST_MAIN_TANK_HOT = {7, 1};     // 1 once the tank is hot
+static constexpr iboost_field_t IBOOST_MAIN_BATTERY_LOW = {12, 1}; // Sender battery, 0 if OK
+static constexpr iboost_field_t IBOOST_MAIN_HEATING = {16, 2};     // Power into the tank (W), signed
+static constexpr iboost_field_t IBOOST_MAIN_P1 = {18, 4};          // Grid, MAGIC_NUMBER per watt, negative exporting
+static constexpr iboost_field_t IBOOST_MAIN_REQUEST = {24, 1};     // SAVED_* code being answered
+static constexpr iboost_field_t IBOOST_MAIN_P2 = {25, 4};          // Counter asked for (Wh)
+
+constexpr bool iboost_field_fits(iboost_field_t field, uint8_t frame_size) {
+    return field.offset + field.size <= frame_size;
+}
+
+static_assert(iboost_field_fits(IBOOST_SENDER_SAMPLES, IBOOST_SENDER_SIZE), "sender samples run past the frame");
+static_assert(iboost_field_fits(IBOOST_BUDDY_REQUEST, IBOOST_BUDDY_SIZE), "buddy request runs past the frame");
+static_assert(iboost_field_fits(IBOOST_MAIN_BOOST_TIME, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_NOT_HEATING, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_TANK_HOT, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_BATTERY_LOW, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_HEATING, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_P1, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_REQUEST, IBOOST_MAIN_UNIT_SIZE) &&
+    iboost_field_fits(IBOOST_MAIN_P2, IBOOST_MAIN_UNIT_SIZE), "main unit field runs past the frame");
+static_assert(IBOOST_MAIN_P1.offset + IBOOST_MAIN_P1.size <= IBOOST_MAIN_REQUEST.offset &&
+    IBOOST_MAIN_REQUEST.offset < IBOOST_MAIN_P2.offset, "main unit fields overlap");
+
+// A decoded frame, the fields for other frame types are left at 0
+typedef struct {
+    uint16_t address;
+    uint8_t type;                       // IBOOST_FRAME_*
+    uint8_t request;                    // Buddy and main unit, SAVED_* code
+    // Main unit
+    int16_t heating;                    // W
+    int32_t p1;                         // MAGIC_NUMBER per watt
+    int32_t p2;                         // Wh
+    uint8_t boost_time;                 // Minutes
+    bool b_heating_by_solar;
+    bool b_tank_hot;
+    bool b_battery_ok;
+    // Sender
+    const uint8_t *samples;             // Points into the frame passed to iboost_decode()
+} iboost_frame_t;
+
+/**
+ * @brief Read an unsigned little endian field.
+ *
+ * @param data Frame
+ * @param field Field
+ * @return uint32_t value
+ */
+static inline uint32_t iboost_get(const uint8_t *data, iboost_field_t field) {
+    uint32_t value = 0;
+    for (uint8_t i = field.size; i > 0; i--) {
+        value = value << 8 | data[field.offset + i - 1];
+    }
+    return value;
+}
+
+/**
+ * @brief Write an unsigned little endian field.
+ *
+ * @param data Frame
+ * @param field Field
+ * @param value Value, truncated to the field size
+ */
+static inline void iboost_put(uint8_t *data, iboost_field_t field, uint32_t value) {
+    for (uint8_t i = 0; i < field.size; i++) {
+        data[field.offset + i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+/**
+ * @brief Length a frame type should have.
+ *
+ * @param type Frame type
+ * @return uint8_t length, 0 for an unknown type
+ */
+static inline uint8_t iboost_frame_size(uint8_t type) {
+    switch (type) {
+        case IBOOST_FRAME_SENDER:
+            return IBOOST_SENDER_SIZE;
+        case IBOOST_FRAME_BUDDY:
+            return IBOOST_BUDDY_SIZE;
+        case IBOOST_FRAME_MAIN_UNIT:
+            return IBOOST_MAIN_UNIT_SIZE;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Decode a frame.
+ *
+ * @param data Payload
+ * @param size Payload length
+ * @param frame Decoded frame
+ * @return true if it is a sender, buddy or main unit frame of the right length
+ */
+static inline bool iboost_decode(const uint8_t *data, uint8_t size, iboost_frame_t *frame) {
+    memset(frame, 0, sizeof(iboost_frame_t));
+    if (size < IBOOST_TYPE.offset + IBOOST_TYPE.size) {
+        return false;
+    }
+    frame->address = (uint16_t)(data[IBOOST_ADDRESS.offset] << 8 | data[IBOOST_ADDRESS.offset + 1]);
+    frame->type = data[IBOOST_TYPE.offset];
+    if (iboost_frame_size(frame->type) == 0 || size != iboost_frame_size(frame->type)) {
+        return false;
+    }
+
+    switch (frame->type) {
+        case IBOOST_FRAME_SENDER:
+            frame->samples = &data[IBOOST_SENDER_SAMPLES.offset];
+            break;
+        case IBOOST_FRAME_BUDDY:
+            frame->request = (uint8_t)iboost_get(data, IBOOST_BUDDY_REQUEST);
+            break;
+        case IBOOST_FRAME_MAIN_UNIT:
+            frame->request = (uint8_t)iboost_get(data, IBOOST_MAIN_REQUEST);
+            frame->heating = (int16_t)iboost_get(data, IBOOST_MAIN_HEATING);
+            frame->p1 = (int32_t)iboost_get(data, IBOOST_MAIN_P1);
+            frame->p2 = (int32_t)iboost_get(data, IBOOST_MAIN_P2);
+            frame->boost_time = (uint8_t)iboost_get(data, IBOOST_MAIN_BOOST_TIME);
+            frame->b_heating_by_solar = iboost_get(data, IBOOST_MAIN_NOT_HEATING) == 0;
+            frame->b_tank_hot = iboost_get(data, IBOOST_MAIN_TANK_HOT) == 1;
+            frame->b_battery_ok = iboost_get(data, IBOOST_MAIN_BATTERY_LOW) == 0;
+            break;
+    }
+    return true;
+}
+
+/**
+ * @brief Build the buddy request we send to the main unit. The bytes other than the
+ * address and request code are copied from a real buddy.
+ *
+ * @param data Buffer of at least IBOOST_BUDDY_SIZE bytes
+ * @param address Main unit address
+ * @param request SAVED_* code
+ * @return uint8_t frame length
+ */
+static inline uint8_t iboost_encode_request(uint8_t *data, uint16_t address, uint8_t request) {
+    static constexpr uint8_t buddy_template[IBOOST_BUDDY_SIZE] = {
+        0x00, 0x00, IBOOST_FRAME_BUDDY, 0x08, 0x92, 0x07, 0x00, 0x00, 0x24, 0x00,
+        0xa0, 0xa0, 0x00, 0x00, 0xa0, 0xa0, 0xc8
+    };
+
+    memcpy(data, buddy_template, IBOOST_BUDDY_SIZE);
+    data[IBOOST_ADDRESS.offset] = (uint8_t)(address >> 8);
+    data[IBOOST_ADDRESS.offset + 1] = (uint8_t)(address & 0xff);
+    iboost_put(data, IBOOST_BUDDY_REQUEST, request);
+    return IBOOST_BUDDY_SIZE;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "main.h"
+#include "iboost_units.h"
+#include "grid_estimate.h"
+#include "frame_dedup.h"
+
+/*
+    Turns good iBoost frames into what the rest of the system sees: display events
+    (electricity_event_t), MQTT messages and the unit table. Where they go is up to the
+    sink, the firmware sends them to g_main_queue and the broker, the host replay tool
+    (support/host/replay.cpp) prints them, so both run exactly the same code.
+
+    Repeats of a frame are dropped before anything else, see frame_dedup.h.
+
+    Only the decode task calls iboost_events_frame(), so the state needs no lock.
+*/
+
+#define MAGIC_NUMBER 380 // value used to convert iBoost value to watts
+
+// iboost_events_frame() results
+#define EVENTS_USED         0x01        // From a tracked unit, worth an LED blink
+#define EVENTS_PUBLISHED    0x02        // iboost/iboost was published
+#define EVENTS_DUPLICATE    0x04        // A repeat, dropped
+
+typedef struct  {
+    long today;
+    long yesterday;
+    long last7;
+    long last28;
+    long total;
+    uint8_t address[2];
+    uint8_t lqi;
+    bool b_is_address_valid;
+    bool b_sender_battery_ok;
+} iboost_information_t;
+
+typedef struct {
+    void (*event)(const electricity_event_t *event);            // For the display
+    bool (*publish)(const char *topic, JsonDocument &doc, int64_t arrival_us);     // To MQTT, true if sent
+    void (*primary_changed)(uint16_t address);                  // Requests go to this unit now
+    void (*publish_failed)(void);                               // iboost/iboost wasn't sent
+} iboost_events_sink_t;
+
+typedef struct {
+    iboost_units_t *units;
+    const iboost_events_sink_t *sink;
+    iboost_information_t information;   // The primary unit, as displayed
+    grid_estimate_t grid;               // Grid power from the primary's sender frames, see grid_estimate.h
+    frame_dedup_t dedup;                // Recent frames
+    uint8_t receive_lqi;                // Last sender/buddy frame, main unit frames report it
+    int64_t arrival_us;                 // Frame being handled, passed on for the latency histograms (latency.h)
+} iboost_events_t;
+
+void iboost_events_begin(iboost_events_t *events, iboost_units_t *units, const iboost_events_sink_t *sink);
+uint8_t iboost_events_frame(iboost_events_t *events, const uint8_t *packet, uint8_t size, int16_t rssi, uint8_t lqi, uint32_t now_ms, int64_t arrival_us);
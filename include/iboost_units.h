@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include "main.h"
+#include "request_schedule.h"
+
+/*
+    Table of the iBoost installations in range, keyed by the 16 bit address that every
+    frame of an installation (sender, buddy and main unit) starts with. Each entry keeps
+    the unit's saved counters, water tank state, link quality and its own request
+    schedule.
+
+    With IBOOST_ADDRESSES defined in config.h, e.g. {0x23b3, 0x1c7b}, only those units
+    are tracked and all of them are asked for data; the first one is the primary. Without
+    it any unit heard is tracked, up to UNIT_TABLE_SIZE, but only the primary (the one
+    with the best filtered LQI) is asked, so a neighbour's system is never sent requests
+    and can't take over because of a single strong frame. The primary drives the
+    display and iboost/iboost, every unit is published to iboost/unit/<address>.
+*/
+
+#define UNIT_TABLE_SIZE         4
+#define UNIT_MIN_FRAMES         3       // Sender/buddy frames before a unit can become the primary
+#define UNIT_LQI_FILTER         8       // Weight of the filtered LQI against a new reading
+#define UNIT_LQI_HYSTERESIS     2.0f    // Another unit must be this much better to become the primary
+#define UNIT_TIMEOUT            600000  // Not heard for this long and the unit is out of range (ms)
+
+typedef struct {
+    uint16_t address;
+    bool b_in_use;
+    bool b_pinned;              // Listed in IBOOST_ADDRESSES
+    uint32_t first_seen_ms;
+    uint32_t last_seen_ms;
+    uint32_t frames;            // Sender/buddy frames
+    uint32_t main_unit_frames;
+    float lqi;                  // Filtered LQI of sender/buddy frames, lower is better
+    int16_t rssi;               // Last RSSI (dBm)
+    long today;                 // Saved counters (Wh)
+    long yesterday;
+    long last7;
+    long last28;
+    long total;
+    short heating;              // Solar power going to the tank (W)
+    ib_info_t tank;             // IB_WT_OFF, IB_WT_HEATING or IB_WT_HOT
+    bool b_battery_ok;          // Sender battery
+    request_schedule_t requests;
+} iboost_unit_t;
+
+typedef struct {
+    iboost_unit_t units[UNIT_TABLE_SIZE];
+    iboost_unit_t *primary;     // NULL until a unit qualifies
+    uint8_t next_request;       // Round robin position over the requested units
+    bool b_pinned;              // Addresses come from IBOOST_ADDRESSES
+} iboost_units_t;
+
+void units_begin(iboost_units_t *units);
+iboost_unit_t *units_find(iboost_units_t *units, uint16_t address);
+iboost_unit_t *units_observe(iboost_units_t *units, uint16_t address, uint8_t lqi, int16_t rssi, uint32_t now_ms, bool *b_primary_changed);
+void units_main_unit_frame(iboost_unit_t *unit, uint8_t code, long value, short heating, ib_info_t tank, bool b_battery_ok, uint32_t now_ms);
+bool units_next_request(iboost_units_t *units, uint32_t now_ms, uint16_t *address, uint8_t *request);
+void units_request_sent(iboost_units_t *units, uint16_t address, uint8_t request, uint32_t now_ms);
+uint8_t units_in_range(iboost_units_t *units, uint32_t now_ms);
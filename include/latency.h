@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+#include "main.h"
+
+/*
+    How long a main unit frame takes to become something useful, measured from its GDO0
+    interrupt (esp_timer_get_time()) to the MQTT publish returning and to the value
+    being drawn on the TFT. The arrival time travels with the frame, in each
+    electricity_event_t and to the publish sink (see iboost_events.h).
+
+    Each path keeps a histogram per kind: MQTT per topic (LATENCY_TOPIC_*), the display
+    per sl_event_t. Buckets are powers of 2, bucket 0 is everything under 128us,
+    bucket n from 2^(n+6) to 2^(n+7) us, the last is open ended (over 2.1s). The
+    display task and decode task both record, so access goes through a spinlock and
+    latency_snapshot() takes a copy for publishing.
+*/
+
+#define LATENCY_BUCKETS     16
+#define LATENCY_FIRST_SHIFT 7           // Bucket 0 is below 2^7 us
+#define LATENCY_KINDS       (SL_LQI + 1)    // Most kinds on a path
+
+typedef enum {
+    LATENCY_MQTT,               // Frame to publish returned
+    LATENCY_DISPLAY,            // Frame to value drawn
+    LATENCY_PATHS
+} latency_path_t;
+
+// LATENCY_MQTT kinds
+typedef enum {
+    LATENCY_TOPIC_IBOOST,       // iboost/iboost
+    LATENCY_TOPIC_GRID,         // iboost/grid
+    LATENCY_TOPIC_UNIT,         // iboost/unit/<address>
+    LATENCY_TOPICS
+} latency_topic_t;
+
+typedef struct {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;          // For the average
+} latency_histogram_t;
+
+void latency_record(latency_path_t path, uint8_t kind, int64_t arrival_us);
+void latency_snapshot(latency_path_t path, uint8_t kind, latency_histogram_t *copy);
+uint8_t latency_kinds(latency_path_t path);
+const char *latency_kind_name(latency_path_t path, uint8_t kind);
@@ -36,6 +36,7 @@ typedef struct {
     sl_event_t event;       // Event that has happened
     ib_info_t info;         // iBoost information (if present)
     float value;            // Value in watts/lqi
+    int64_t arrival_us;     // GDO0 interrupt of the frame it came from (esp_timer_get_time()), 0 if not from a frame
 } electricity_event_t;
 
 void display_task(void *parameter);
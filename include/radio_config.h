@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include "CC1101_RFx.h"
+
+/*
+    CC1101 register image for listening to (and talking to) the iBoost. One byte per
+    configuration register from CC1101_IOCFG2 (0x00) to CC1101_TEST0 (0x2E) so the whole
+    set is uploaded with a single writeBurstRegister() and checked with a single
+    readBurstRegister(), see CC1101::begin(const byte *config).
+
+    Registers not mentioned by the original set up keep their reset value.
+*/
+static constexpr uint8_t iboost_radio_config[] = {
+    0x0B,   // IOCFG2   GDO2 active high serial clock
+    0x2E,   // IOCFG1   GDO1 high impedance (reset value, GDO1 is MISO)
+    0x46,   // IOCFG0   Inverted, asserts when sync word has been sent / received, de-asserts at the end of the packet
+    0x4F,   // FIFOTHR  RX attenuation 0dB, FIFO thresholds 64 bytes RX / 1 byte TX
+    0xD3,   // SYNC1    Sync word high byte (reset value)
+    0x91,   // SYNC0    Sync word low byte (reset value)
+    0x3D,   // PKTLEN   Maximum packet length 61
+    0x04,   // PKTCTRL1 No address check, append RSSI/LQI/CRC OK status bytes, no auto flush on bad CRC
+    0x05,   // PKTCTRL0 Whitening off, FIFO mode, CRC enabled, variable packet length
+    0x00,   // ADDR     Address used for packet filtration (not used)
+    0x00,   // CHANNR   Channel 0
+    0x08,   // FSCTRL1  IF = 203.125kHz
+    0x00,   // FSCTRL0  No frequency offset
+    0x21,   // FREQ2    Carrier 868.35MHz, see README frequency tuning
+    0x65,   // FREQ1
+    0xE8,   // FREQ0
+    0x5B,   // MDMCFG4  CHANBW_E = 1 CHANBW_M = 1 (325kHz), DRATE_E = 11
+    0xF8,   // MDMCFG3  DRATE_M = 248, 99.975kBaud
+    0x03,   // MDMCFG2  DC blocking filter on, 2-FSK, no Manchester, 30/32 sync word bits
+    0x22,   // MDMCFG1  FEC off, 4 preamble bytes, CHANSPC_E = 2
+    0xF8,   // MDMCFG0  CHANSPC_M = 248, 200kHz channel spacing
+    0x47,   // DEVIATN  DEVIATION_E = 4 DEVIATION_M = 7, ±47.607kHz
+    0x07,   // MCSM2    RX timeout until end of packet (reset value)
+    0x3F,   // MCSM1    CCA when RSSI below threshold unless receiving, RX -> RX (see getPackets()), TX -> RX
+    0x18,   // MCSM0    Calibrate going from IDLE to RX or TX (off with RADIO_CACHED_CAL), PO_TIMEOUT 149-155us
+    0x1D,   // FOCCFG   FOC gain 4K before sync, K/2 after, saturation ±BWchannel/8
+    0x1C,   // BSCFG    Clock recovery KI / 2KP before sync, KI/2 / KP after, no data rate offset compensation
+    0xC7,   // AGCCTRL2 3 highest DVGA gains not used, maximum LNA gain, 42dB target amplitude
+    0x00,   // AGCCTRL1 LNA2 gain decreased first, relative carrier sense off, absolute threshold at MAGN_TARGET
+    0xB2,   // AGCCTRL0 Medium hysteresis, 32 samples wait, AGC gain never frozen
+    0x87,   // WOREVT1  Event0 timeout high byte (reset value)
+    0x6B,   // WOREVT0  Event0 timeout low byte (reset value)
+    0xFB,   // WORCTRL  RC oscillator off, EVENT1 = 7, WOR_RES = 3
+    0xB6,   // FREND1   RX front end
+    0x10,   // FREND0   TX front end, PA power index 0
+    0xEA,   // FSCAL3   Frequency synthesizer calibration (SmartRF Studio values)
+    0x2A,   // FSCAL2
+    0x00,   // FSCAL1
+    0x1F,   // FSCAL0
+    0x41,   // RCCTRL1  RC oscillator configuration (reset value)
+    0x00,   // RCCTRL0  RC oscillator configuration (reset value)
+    0x59,   // FSTEST   Test register
+    0x7F,   // PTEST    Production test (reset value)
+    0x3F,   // AGCTEST  AGC test (reset value)
+    0x81,   // TEST2    Values to be used from SmartRF software
+    0x35,   // TEST1
+    0x09    // TEST0
+};
+
+// Power amplifier table, uploaded separately as PATABLE is not a configuration register
+static constexpr uint8_t iboost_radio_pa_table[] = {0xC6, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F};
+
+/*
+    Compile time checks on the register image. A typo in one of the values above would
+    otherwise only show up as "no packets received".
+*/
+// Carrier frequency in Hz from FREQ2/1/0
+constexpr uint32_t radio_config_frequency(const uint8_t *config) {
+    return (uint32_t)((((uint64_t)config[CC1101_FREQ2] << 16) | ((uint64_t)config[CC1101_FREQ1] << 8) |
+            (uint64_t)config[CC1101_FREQ0]) * CC1101_CRYSTAL_FREQUENCY >> 16);
+}
+
+// Symbol rate in baud from MDMCFG4/MDMCFG3
+constexpr uint32_t radio_config_data_rate(const uint8_t *config) {
+    return (uint32_t)(((uint64_t)(256 + config[CC1101_MDMCFG3]) << (config[CC1101_MDMCFG4] & 0x0F)) *
+            CC1101_CRYSTAL_FREQUENCY >> 28);
+}
+
+// FSK deviation in Hz from DEVIATN
+constexpr uint32_t radio_config_deviation(const uint8_t *config) {
+    return (uint32_t)(((uint64_t)(8 + (config[CC1101_DEVIATN] & 0x07)) << ((config[CC1101_DEVIATN] >> 4) & 0x07)) *
+            CC1101_CRYSTAL_FREQUENCY >> 17);
+}
+
+static_assert(sizeof(iboost_radio_config) == CC1101_CONFIG_SIZE, "one byte per register from IOCFG2 to TEST0");
+static_assert(sizeof(iboost_radio_pa_table) == 8, "PATABLE holds 8 entries");
+
+static_assert((iboost_radio_config[CC1101_FREQ2] & 0xC0) == 0, "FREQ2 bits 7:6 must be 0");
+static_assert(radio_config_frequency(iboost_radio_config) >= 868000000ul &&
+              radio_config_frequency(iboost_radio_config) <= 868600000ul, "carrier outside the 868.0-868.6MHz band");
+
+static_assert(((iboost_radio_config[CC1101_MDMCFG2] >> 4) & 0x07) == 0, "iBoost uses 2-FSK (MOD_FORMAT = 0)");
+static_assert((iboost_radio_config[CC1101_MDMCFG1] & 0x0C) == 0, "MDMCFG1 bits 3:2 are not used and must be 0");
+static_assert(radio_config_data_rate(iboost_radio_config) >= 99000ul &&
+              radio_config_data_rate(iboost_radio_config) <= 101000ul, "iBoost data rate is ~100kBaud");
+
+static_assert((iboost_radio_config[CC1101_DEVIATN] & 0x88) == 0, "DEVIATN bits 7 and 3 are not used and must be 0");
+static_assert(radio_config_deviation(iboost_radio_config) >= 45000ul &&
+              radio_config_deviation(iboost_radio_config) <= 50000ul, "iBoost deviation is ~47.6kHz");
+
+static_assert(iboost_radio_config[CC1101_PKTLEN] <= MAX_PACKET_LEN, "PKTLEN larger than the library supports");
+static_assert((iboost_radio_config[CC1101_PKTCTRL0] & 0x07) == 0x05, "getPacket() needs CRC on and variable length");
+static_assert((iboost_radio_config[CC1101_PKTCTRL1] & 0x04) == 0x04, "getPacket() needs the RSSI/LQI status bytes");
+static_assert(iboost_radio_config[CC1101_IOCFG0] == 0x46, "the GDO0 interrupt edge in main.cpp depends on IOCFG0");
+static_assert((iboost_radio_config[CC1101_MCSM1] & 0x03) == 0x03, "radio_transmit() in main.cpp expects TX -> RX");
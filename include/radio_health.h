@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Radio health supervisor. The CC1101 can stop delivering frames without anything
+    else noticing: left in IDLE or a FIFO error state, receiving nothing but noise after
+    a glitch on the supply, or not answering on SPI at all (see CC1101::error). Before
+    this the only way out was a reboot, taking WiFi, MQTT and the display with it.
+
+    The radio task reports every frame and, every HEALTH_CHECK_INTERVAL, the chip state
+    (getState()) and whether a driver wait timed out. A check trips on:
+      - no good frame for the silence limit (the sender transmits about every 10s)
+      - HEALTH_CRC_BAD_PCT% or more of at least HEALTH_CRC_MIN_FRAMES frames in the
+        current HEALTH_CRC_WINDOW failing their CRC
+      - HEALTH_STATE_CHECKS checks in a row finding the chip outside RX (or
+        calibrating/settling on its way there)
+      - a driver wait timing out
+
+    The first trip restarts the receiver (SIDLE, SFRX, SRX), which clears a stuck state
+    or FIFO in well under a millisecond. If the fault is still there HEALTH_ESCALATE
+    later, or the driver timed out, the CC1101 is reset and the configuration uploaded
+    again. Each further reset doubles the silence limit up to HEALTH_SILENCE_MAX, so a
+    main unit that is switched off doesn't reset the radio every minute. A silence or
+    driver outage ends with the first good frame, a CRC or state one with the first
+    check that finds nothing wrong (a few good frames get through a noisy channel), and
+    everything is put back.
+
+    Only decides, the radio task carries out the action, so it is plain C with no
+    Arduino dependency and no lock (radio task only, copied for publishing).
+*/
+
+#define HEALTH_CHECK_INTERVAL   5000        // Time between checks (ms)
+#define HEALTH_SILENCE          60000       // No good frame for this long trips (ms)
+#define HEALTH_SILENCE_MAX      1800000     // Longest silence limit after repeated resets (ms)
+#define HEALTH_ESCALATE         30000       // Still failing this long after a restart, reset (ms)
+#define HEALTH_CRC_WINDOW       60000       // CRC failures are counted over this (ms)
+#define HEALTH_CRC_MIN_FRAMES   8           // Fewest frames in the window for the rate to count
+#define HEALTH_CRC_BAD_PCT      75          // Share of bad frames that trips (%)
+#define HEALTH_STATE_CHECKS     2           // Checks in a row outside RX that trip
+#define HEALTH_STATE_UNKNOWN    0xff        // Pass as the state when the chip wasn't looked at (e.g. asleep in WOR)
+
+typedef enum {
+    HEALTH_ACTION_NONE,
+    HEALTH_ACTION_RESTART_RX,   // SIDLE, SFRX, SRX
+    HEALTH_ACTION_RESET,        // reset(), configuration upload and SRX, see radio_setup()
+    HEALTH_ACTIONS
+} health_action_t;
+
+typedef enum {
+    HEALTH_CAUSE_NONE,
+    HEALTH_CAUSE_SILENCE,       // No good frame
+    HEALTH_CAUSE_CRC,           // Mostly bad frames
+    HEALTH_CAUSE_STATE,         // Chip not in RX
+    HEALTH_CAUSE_DRIVER,        // A driver wait timed out
+    HEALTH_CAUSES
+} health_cause_t;
+
+typedef struct {
+    uint8_t level;              // Last action taken for this outage (health_action_t), NONE when healthy
+    bool b_outage;              // Tripped and not yet ended
+    uint32_t outage_start_ms;   // Last good frame for silence, else the trip
+    uint32_t quiet_since_ms;    // Last good frame or action
+    uint32_t last_good_ms;      // Last good frame
+    uint32_t last_action_ms;
+    uint32_t last_check_ms;
+    uint32_t silence_ms;        // Silence limit in use, also how long an action is given to work
+    uint32_t backoff_ms;        // Silence limit after the next reset
+    uint32_t window_start_ms;   // Start of the CRC window
+    uint16_t window_good;
+    uint16_t window_bad;
+    uint8_t bad_states;         // Checks in a row outside RX
+    uint8_t last_state;         // From the last check, HEALTH_STATE_UNKNOWN if not read
+    health_cause_t last_cause;
+    uint32_t trips[HEALTH_CAUSES];      // By cause
+    uint32_t actions[HEALTH_ACTIONS];   // By action, [NONE] unused
+    uint32_t outages;           // Outages ended
+    uint32_t last_outage_ms;    // From outage_start_ms to the end
+    uint32_t longest_outage_ms;
+    uint32_t last_action_us;    // How long the last action took to carry out
+    uint32_t max_action_us;
+} radio_health_t;
+
+void radio_health_begin(radio_health_t *health, uint32_t now_ms);
+void radio_health_frame(radio_health_t *health, bool b_crc_ok, uint32_t now_ms);
+bool radio_health_due(const radio_health_t *health, uint32_t now_ms);
+health_action_t radio_health_check(radio_health_t *health, uint8_t state, bool b_driver_error, uint32_t now_ms);
+void radio_health_action_done(radio_health_t *health, health_action_t action, uint32_t duration_us);
+const char *radio_health_cause_name(health_cause_t cause);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include "esp_attr.h"
+
+/*
+    Radio link statistics. Counts every frame drained from the CC1101 by type, CRC
+    failures, frames of the wrong length for their type and GDO0 interrupts, plus our
+    requests against the main unit's answers and their time on air (the 868MHz band
+    has duty cycle limits). Good frames also go into fixed bucket RSSI and LQI
+    histograms for their source address, so range problems show up per unit. The
+    counters are shared between the GDO0 interrupt and the radio tasks so all access
+    goes through a spinlock; radio_stats_snapshot() takes a consistent copy for
+    publishing.
+*/
+
+#define STATS_SOURCES       4           // Addresses tracked, the least recently heard is replaced
+#define STATS_RSSI_BUCKETS  8
+#define STATS_RSSI_MIN      -110        // Lower edge of the first RSSI bucket (dBm), everything below counts there
+#define STATS_RSSI_STEP     10          // Width of an RSSI bucket (dB), the last bucket is open ended
+#define STATS_LQI_BUCKETS   8
+#define STATS_LQI_STEP      16          // LQI is 0..127, lower is better
+
+typedef enum {
+    STATS_SENDER,               // 0x01
+    STATS_BUDDY,                // 0x21
+    STATS_MAIN_UNIT,            // 0x22
+    STATS_OTHER,
+    STATS_TYPES
+} stats_frame_type_t;
+
+// How a transmission ended
+typedef enum {
+    TX_RESULT_OK,               // End of packet interrupt, back in RX
+    TX_RESULT_UNDERFLOW,        // TX FIFO ran dry, the packet was cut short
+    TX_RESULT_TIMEOUT           // No end of packet in time, may or may not have gone
+} tx_result_t;
+
+typedef struct {
+    uint16_t address;
+    uint32_t frames;
+    uint32_t last_ms;
+    int32_t rssi_total;         // For the average (dBm)
+    uint32_t rssi[STATS_RSSI_BUCKETS];
+    uint32_t lqi[STATS_LQI_BUCKETS];
+} stats_source_t;
+
+typedef struct {
+    uint32_t frames[STATS_TYPES];   // Good CRC
+    uint32_t crc_failures;
+    uint32_t size_rejects;      // Good CRC, wrong length for the type
+    uint32_t interrupts;        // GDO0 end of packet, includes our own transmissions
+    uint32_t requests;          // Sent by us (TX_RESULT_OK or TX_RESULT_TIMEOUT)
+    uint32_t responses;         // Main unit answers to our requests
+    uint32_t tx_underflows;
+    uint32_t tx_timeouts;
+    uint64_t airtime_us;        // STX to end of packet (includes calibration), TX_RESULT_OK only
+    uint32_t airtime_last_us;
+    uint32_t airtime_max_us;
+    stats_source_t sources[STATS_SOURCES];
+} radio_stats_t;
+
+void IRAM_ATTR radio_stats_interrupt(void);
+void radio_stats_frame(const uint8_t *packet, uint8_t size, bool b_crc_ok, int16_t rssi, uint8_t lqi, uint32_t now_ms);
+void radio_stats_transmit(tx_result_t result, uint32_t airtime_us);
+void radio_stats_response(void);
+void radio_stats_snapshot(radio_stats_t *copy);
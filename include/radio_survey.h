@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+    Carrier frequency survey. Rather than trying the README frequency table one reflash
+    at a time the radio task steps the carrier across it, SURVEY_STEP_HZ at a time
+    around SURVEY_CENTRE_HZ, and listens on each step for SURVEY_DWELL counting good
+    frames, CRC failures and their RSSI and LQI. The step with the most good frames wins,
+    then the lower (better) mean LQI, then the stronger mean RSSI. Fewer than
+    SURVEY_MIN_FRAMES good frames everywhere and nothing changes.
+
+    The winner is saved in NVS and applied by radio_setup() from then on, so it survives
+    resets and reboots. The AFC correction (see afc.h) is for the old carrier so it is
+    held at zero during the survey and learnt again afterwards.
+
+    Runs at the first boot (no survey finished yet, even one that heard nothing) and on
+    "survey" to iboost/radio/command. Retunes and resets asked for over MQTT are refused
+    while it runs. Radio task only, a copy goes out with the driver's counters for
+    publishing.
+*/
+
+#define SURVEY_CENTRE_HZ    868300000   // The README default
+#define SURVEY_STEP_HZ      25000
+#define SURVEY_STEPS        11          // 868.175 to 868.425MHz, the README table
+#define SURVEY_DWELL        30000       // Listening time per step (ms), the sender transmits about every 10s
+#define SURVEY_MIN_FRAMES   2           // Good frames for a step to be picked
+
+typedef struct {
+    uint32_t frequency;         // Hz
+    uint16_t good;              // Frames with a good CRC
+    uint16_t bad;               // Frames with a bad CRC
+    int32_t rssi_total;         // dBm, good frames
+    uint32_t lqi_total;         // Good frames
+} survey_step_t;
+
+typedef struct {
+    bool b_active;
+    uint8_t step;               // Step being listened to
+    int8_t best;                // Step picked by the last survey, -1 if none was good enough
+    uint32_t step_start_ms;
+    uint32_t previous_hz;       // Carrier before the survey, back to it if nothing is heard
+    uint32_t saved_hz;          // Carrier in NVS, 0 if never surveyed or nothing was heard
+    bool b_surveyed;            // A survey has finished on this device (NVS), with or without a result
+    uint32_t surveys;           // Surveys finished
+    survey_step_t steps[SURVEY_STEPS];
+} radio_survey_t;
+
+void radio_survey_begin(radio_survey_t *survey);
+uint32_t radio_survey_start(radio_survey_t *survey, uint32_t current_hz, uint32_t now_ms);
+void radio_survey_frame(radio_survey_t *survey, bool b_crc_ok, int16_t rssi_dbm, uint8_t lqi);
+bool radio_survey_update(radio_survey_t *survey, uint32_t now_ms, uint32_t *frequency);
+int16_t radio_survey_rssi(const survey_step_t *step);
+uint8_t radio_survey_lqi(const survey_step_t *step);
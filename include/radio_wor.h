@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+#include "CC1101_RFx.h"
+#include "tx_schedule.h"
+
+/*
+    Wake-on-Radio receive mode, build with -DRADIO_WOR. Rather than listening all the time
+    the CC1101 only has its receiver on when tx_schedule.h expects something: around the
+    sender's frame (about every 10s) and from our request until the main unit answers.
+    The rest of the time it is left in WOR (CC1101::wor()), asleep apart from a short
+    carrier sense poll every WOR_EVENT0 ms which can still catch an unexpected frame.
+
+    The windows are timed by the ESP32, the CC1101's own Event 0 timer runs off the RC
+    oscillator which is only good to about 1%, ~100ms over a sender period. Until the
+    sender has been locked onto (and whenever it is lost) the receiver stays on.
+
+    Registers FSTEST to TEST0 are lost while the CC1101 sleeps so they are put back each
+    time it wakes, including to transmit a request (radio_wor_wake()).
+*/
+
+#define WOR_EVENT0          1000        // Poll period while asleep (ms)
+#define WOR_GUARD           150         // Listen this long either side of the expected sender frame (ms)
+
+typedef enum {
+    WOR_STATE_RX,
+    WOR_STATE_WOR
+} wor_state_t;
+
+typedef struct {
+    wor_state_t state;
+    uint32_t since_ms;          // Time of the last state change
+    uint64_t rx_ms;             // Time spent with the receiver on
+    uint64_t wor_ms;            // Time spent in WOR
+    uint32_t windows;           // Times the receiver was switched on
+    uint32_t sender_windows;    // Of which were for the sender's frame
+    uint32_t sender_missed;     // Sender windows that closed without the frame
+    uint32_t wakes;             // Frames caught by the carrier sense poll while asleep
+    uint32_t window_start_ms;
+    uint32_t sender_frames_at_start;
+    bool b_sender_window;
+} radio_wor_t;
+
+void radio_wor_begin(radio_wor_t *wor, uint32_t now_ms);
+uint32_t radio_wor_update(CC1101 &radio, radio_wor_t *wor, tx_schedule_t *schedule, bool b_drained, uint32_t now_ms);
+void radio_wor_wake(CC1101 &radio, radio_wor_t *wor, uint32_t now_ms);
+void radio_wor_listening(radio_wor_t *wor, uint32_t now_ms);
+float radio_wor_duty_cycle(const radio_wor_t *wor, uint32_t now_ms);
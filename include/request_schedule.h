@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+    Chooses which "saved" counter to ask the main unit for next. Each counter has a
+    staleness budget and the most overdue one is requested, so "today" is refreshed on
+    most requests while the daily counters are only asked for after they become invalid:
+    when a unit is first heard (a full refresh, see iboost_units.h), and after midnight,
+    seen either on the local clock or as "today" going back to a lower value. The running
+    totals (last 7, last 28, total) include today so they also get a long backstop budget.
+
+    Answers to a real buddy's requests count as well, they refresh the same counters.
+*/
+
+// codes for the various requests and responses
+enum {
+    SAVED_TODAY = 0xCA,
+    SAVED_YESTERDAY = 0xCB,
+    SAVED_LAST_7 = 0xCC,
+    SAVED_LAST_28 = 0xCD,
+    SAVED_TOTAL = 0xCE
+};
+
+#define REQUEST_COUNTERS        5
+#define REQUEST_RETRY           30000       // Don't ask for an invalid counter again for this long (ms)
+#define REQUEST_TODAY_BUDGET    0           // Always due, requested whenever nothing else is
+#define REQUEST_TOTALS_BUDGET   3600000     // Last 7/28 days and total grow with today (ms)
+#define REQUEST_DAILY_BUDGET    86400000    // Yesterday, backstop in case midnight is missed (ms)
+
+typedef struct {
+    uint8_t code;               // SAVED_*
+    uint32_t budget_ms;         // Age at which the counter is due again
+    uint32_t updated_ms;        // Last answer
+    uint32_t requested_ms;      // Last request
+    uint32_t requests;
+    uint32_t answers;
+    long value;
+    bool b_is_valid;            // Answered since the last invalidation
+} request_counter_t;
+
+typedef struct {
+    request_counter_t counters[REQUEST_COUNTERS];
+    int day;                    // Local day of the year last seen, -1 until the clock is set
+    uint32_t rollovers;         // Midnights seen
+    uint32_t last_device_rollover_ms;   // "Today" last went down, 0 if never
+} request_schedule_t;
+
+void request_schedule_begin(request_schedule_t *schedule);
+uint8_t request_schedule_next(request_schedule_t *schedule, uint32_t now_ms);
+void request_schedule_sent(request_schedule_t *schedule, uint8_t code, uint32_t now_ms);
+void request_schedule_answered(request_schedule_t *schedule, uint8_t code, long value, uint32_t now_ms);
+int32_t request_schedule_age(request_schedule_t *schedule, uint8_t code, uint32_t now_ms);
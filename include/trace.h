@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Timeline of what the firmware is doing, for finding where the time goes between a
+    GDO0 interrupt, draining the FIFO, decoding, JSON, the MQTT publish and the display
+    redraw. Each hook writes an 8 byte entry (time, event, phase, core and task,
+    argument) to a ring in RAM, the oldest entries are overwritten.
+
+    Only built with -DTRACE in platformio.ini build_flags, without it the TRACE_*
+    macros are empty and cost nothing. With it a hook is a spinlock and a timer read.
+
+    trace_dump() prints the ring to the serial port as "trace:" lines (send 't' to the
+    serial monitor), support/host/trace_to_chrome.py turns a monitor log holding them
+    into Chrome trace_event JSON for chrome://tracing or https://ui.perfetto.dev.
+
+    The Arduino core's FreeRTOS is prebuilt without trace hooks, so task switches can't
+    be recorded. Instead every entry carries the task it came from (each task is a row
+    in the viewer) and the places tasks block, queue and semaphore waits, are traced.
+*/
+
+#define TRACE_ENTRIES   1024        // Ring size, a power of 2 (8 bytes each)
+#define TRACE_TASKS     15          // Tasks given their own row, the rest share the last
+#define TRACE_ISR       15          // Task number of interrupt handlers
+
+// Entry phases, Chrome's "ph"
+#define TRACE_PHASE_INSTANT     0
+#define TRACE_PHASE_BEGIN       1
+#define TRACE_PHASE_END         2
+
+// Keep trace_names[] in trace.cpp in step
+typedef enum {
+    TRACE_GDO0,                 // End of packet interrupt, arg = 1 for our own transmission
+    TRACE_STROBE,               // CC1101 command strobe, arg = strobe
+    TRACE_GET_PACKETS,          // Draining the RX FIFO, arg = frames at the end
+    TRACE_SEND_PACKET,          // Loading the TX FIFO and waiting for it to go, arg = size, 1 if sent at the end
+    TRACE_RADIO_COMMAND,        // Radio task carrying out a command, arg = radio_command_type_t, result at the end
+    TRACE_POOL_SUBMIT,          // Frame queued for the decoder, arg = pool index
+    TRACE_POOL_WAIT,            // Decoder waiting for a frame, arg = pool index at the end, 0xffff if none
+    TRACE_DECODE,               // Handling a frame, arg = size, EVENTS_* at the end
+    TRACE_MQTT_WAIT,            // Waiting for keep_alive_mqtt_semaphore, arg = 1 if taken at the end
+    TRACE_JSON,                 // serializeJson(), arg = bytes at the end
+    TRACE_PUBLISH,              // mqtt_client.publish(), arg = 1 if sent at the end
+    TRACE_DISPLAY_SEND,         // Event queued for the display, arg = sl_event_t
+    TRACE_DISPLAY_RECEIVE,      // Display task took an event, arg = sl_event_t
+    TRACE_DRAW,                 // Redrawing part of the screen, arg = sl_event_t shown (SL_IMPORT the grid), 0xff the log
+    TRACE_EVENTS
+} trace_event_t;
+
+typedef struct {
+    uint32_t time_us;           // esp_timer_get_time(), wraps after 71 minutes
+    uint8_t event;              // trace_event_t
+    uint8_t flags;              // Phase (bits 0-1), core (bit 2), task (bits 4-7)
+    uint16_t arg;
+} trace_entry_t;
+
+#ifdef TRACE    // declared in platformio.ini build_flags
+#define TRACE_INSTANT(event, arg)   trace_record(event, TRACE_PHASE_INSTANT, arg)
+#define TRACE_BEGIN(event, arg)     trace_record(event, TRACE_PHASE_BEGIN, arg)
+#define TRACE_END(event, arg)       trace_record(event, TRACE_PHASE_END, arg)
+#else
+#define TRACE_INSTANT(event, arg)   do { } while (0)
+#define TRACE_BEGIN(event, arg)     do { } while (0)
+#define TRACE_END(event, arg)       do { } while (0)
+#endif
+
+void trace_record(uint8_t event, uint8_t phase, uint16_t arg);
+void trace_dump(void);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+    Transmit slot scheduler. Rather than sending the fake buddy request on a free running
+    timer, whatever is on air at the time, the arrival times of sender (0x01), buddy (0x21)
+    and main unit (0x22) frames are used to learn the period and phase of each. The
+    request is then sent in one of a few candidate slots a fixed time after the expected
+    sender frame, away from the sender's next frame and any real buddy, and the slot that
+    gets the most answers is preferred. With several units in range only the primary
+    unit's traffic is followed (tx_schedule_set_address()). Until the sender has been locked onto the
+    request goes out every interval_ms as before (the "fallback" slot).
+*/
+
+#define TX_SLOTS            4           // Candidate slots per sender cycle
+#define TX_SLOT_FALLBACK    TX_SLOTS    // Index used for requests sent without a lock
+#define TX_SLOT_OFFSETS     {250, 1000, 2500, 5000}     // Slot start after the sender frame (ms)
+#define TX_GUARD            300         // Keep this far from expected traffic (ms)
+#define TX_RESPONSE_WINDOW  1000        // Main unit answer must arrive within this of our request (ms)
+#define TX_SLOT_MIN_TRIES   5           // Requests per slot before the answer rate is trusted
+#define TX_EXPLORE_EVERY    10          // Every n-th request goes to the least used slot
+#define TX_PERIOD_MIN       2000        // Plausible frame periods (ms)
+#define TX_PERIOD_MAX       60000
+#define TX_LOCK_COUNT       3           // Matching intervals before a period is trusted
+#define TX_LISTEN_RECHECK   1000        // How often tx_schedule_listen() wants asking again without a lock (ms)
+
+// Learnt timing of one frame type
+typedef struct {
+    uint32_t last_ms;           // Arrival of the last frame
+    uint32_t period_ms;         // Estimated period, 0 if unknown
+    uint32_t frames;            // Frames seen
+    uint8_t matches;            // Consecutive intervals that agreed with period_ms
+} tx_traffic_t;
+
+typedef struct {
+    uint16_t offset_ms;         // After the expected sender frame
+    uint32_t sent;
+    uint32_t answered;
+} tx_slot_t;
+
+typedef struct {
+    tx_traffic_t sender;        // 0x01
+    tx_traffic_t buddy;         // 0x21
+    tx_traffic_t main_unit;     // 0x22
+    tx_slot_t slots[TX_SLOTS + 1];      // + fallback
+    uint16_t address;           // Unit whose traffic is tracked, 0 for any
+    uint32_t interval_ms;       // Request interval without a lock
+    uint32_t last_tx_ms;
+    uint32_t requests;
+    uint8_t pending_slot;       // Slot of the request waiting for an answer
+    uint8_t pending_request;
+    uint16_t pending_address;
+    bool b_is_pending;
+} tx_schedule_t;
+
+void tx_schedule_begin(tx_schedule_t *schedule, uint32_t interval_ms);
+bool tx_schedule_observe(tx_schedule_t *schedule, const uint8_t *packet, uint8_t size, uint32_t now_ms);
+uint32_t tx_schedule_next(tx_schedule_t *schedule, uint32_t now_ms, uint8_t *slot);
+void tx_schedule_set_address(tx_schedule_t *schedule, uint16_t address);
+void tx_schedule_sent(tx_schedule_t *schedule, uint8_t slot, uint16_t address, uint8_t request, uint32_t now_ms);
+bool tx_schedule_is_locked(tx_schedule_t *schedule, uint32_t now_ms);
+bool tx_schedule_listen(tx_schedule_t *schedule, uint32_t guard_ms, uint32_t now_ms, uint32_t *change_ms);
@@ -58,44 +58,145 @@ On Oct 22, 2016 10:07 PM, "Simon Monk" <srmonk@gmail.com> wrote:
 #include <stdarg.h>
 #include <Arduino.h>
 #include <CC1101_RFx.h>
+#include "trace.h"
+#if defined(ARDUINO_ARCH_ESP32)
+    #include "soc/gpio_reg.h"
+    #include "esp_attr.h"
+#endif
+#ifndef DMA_ATTR
+    #define DMA_ATTR
+#endif
 
 #define     WRITE_BURST         0x40                        //write burst
 #define     READ_SINGLE         0x80                        //read single
 #define     READ_BURST          0xC0                        //read burst
 #define     BYTES_IN_RXFIFO     0x7F                        //byte number in RXfifo
+#define     RXFIFO_OVERFLOW     0x80                        //RXBYTES overflow flag
+
+// How long getPackets() leaves a packet whose length byte has been read to finish
+// arriving before it is given up on. A 61 byte packet takes ~5ms on air at 100kBaud.
+#define     RX_COMPLETE_TIMEOUT 8000                        // us
+
+// How long sendPacket() waits for the chip to leave TX. A 61 byte packet takes ~120ms
+// at 4800 baud.
+#define     TX_END_TIMEOUT      200000                      // us
+
+// MCSM0 FS_AUTOCAL field, 01 calibrates going from IDLE to RX or TX
+#define     MCSM0_FS_AUTOCAL        0x30
+#define     MCSM0_AUTOCAL_FROM_IDLE 0x10
+
+// FSCAL3..FSCAL1 are rewritten by the chip at every calibration so they are never
+// served from the shadow copy. FSTEST..TEST0 are not retained in power down (SPWD) or
+// while asleep between WOR polls (SWOR).
+#define     SHADOW_VOLATILE     ((1ull<<CC1101_FSCAL3) | (1ull<<CC1101_FSCAL2) | (1ull<<CC1101_FSCAL1))
+#define     SHADOW_LOST_IN_SLEEP ((1ull<<CC1101_FSTEST) | (1ull<<CC1101_PTEST) | (1ull<<CC1101_AGCTEST) | \
+                                  (1ull<<CC1101_TEST2) | (1ull<<CC1101_TEST1) | (1ull<<CC1101_TEST0))
+
+#ifdef CC1101_BLOCK_TRANSFER
+// Header byte + a full FIFO. Preallocated in DMA capable internal RAM so a burst never
+// needs a bounce buffer or the heap. Shared by all instances, bursts are not re-entrant.
+static DMA_ATTR byte burst_tx[CC1101::BUFFER_SIZE + 1];
+static DMA_ATTR byte burst_rx[CC1101::BUFFER_SIZE + 1];
+#endif
 
 CC1101::CC1101(const byte _csn, byte wiredToMisoPin, SPIClass& _spi)
 : CSNpin(_csn),MISOpin(wiredToMisoPin), spi(_spi) {
 }
 
+// Opens a chip select cycle. Calls nest, only the outermost pair drives CSN so a
+// sequence of register accesses can share one cycle (the CC1101 accepts a new
+// header byte after each single access while CSN stays low, see restartBurstCycle()).
+void CC1101::beginTransaction() {
+    if (transactionDepth++ == 0) {
+        chipSelect();
+        waitMiso();
+        spiStats.transactions++;
+    }
+}
+
+// Closes the chip select cycle opened by the matching beginTransaction()
+void CC1101::endTransaction() {
+    if (transactionDepth > 0 && --transactionDepth == 0) {
+        chipDeselect();
+    }
+}
+
+// A burst access only ends when CSN goes high. Inside an outer transaction the next
+// header byte would be taken as burst data, so the cycle is closed and reopened.
+void CC1101::restartBurstCycle() {
+    if (transactionDepth > 1) {
+        chipDeselect();
+        chipSelect();
+        waitMiso();
+        spiStats.transactions++;
+    }
+}
+
+// Clocks one byte over the bus and counts it
+byte CC1101::spiTransfer(byte value) {
+    spiStats.bytes++;
+    return spi.transfer(value);
+}
+
+void CC1101::resetSpiStats() {
+    memset(&spiStats, 0, sizeof(spiStats));
+}
+
 // writes a byte to a register address
+// configuration registers already holding the value are not written again
 void CC1101::writeRegister(byte addr, byte value) {
-    chipSelect();
-    waitMiso();
-    spi.transfer(addr);
-    spi.transfer(value);
-    chipDeselect();
+    if (addr < CC1101_CONFIG_SIZE) {
+        uint64_t mask = 1ull << addr;
+        if ((shadowValid & mask) && !(SHADOW_VOLATILE & mask) && shadow[addr] == value) {
+            spiStats.writesSkipped++;
+            return;
+        }
+        shadow[addr] = value;
+        shadowValid |= mask;
+    }
+    beginTransaction();
+    spiTransfer(addr);
+    spiTransfer(value);
+    endTransaction();
 }
 
 // writes a buffer to a register address
 void CC1101::writeBurstRegister(byte addr, const byte *buffer, byte num) {
     byte i, temp;
     temp = addr | WRITE_BURST;
-    chipSelect();
-    waitMiso();
-    spi.transfer(temp);
-    for (i = 0; i < num; i++) {
-        spi.transfer(buffer[i]);
+    beginTransaction();
+#ifdef CC1101_BLOCK_TRANSFER
+    if (burstMode == CC1101_BURST_BLOCK && num <= BUFFER_SIZE) {
+        burst_tx[0] = temp;
+        memcpy(&burst_tx[1], buffer, num);
+        spi.transferBytes(burst_tx, burst_rx, num + 1);
+        spiStats.bytes += num + 1;
+    } else
+#endif
+    {
+        spiTransfer(temp);
+        for (i = 0; i < num; i++) {
+            spiTransfer(buffer[i]);
+        }
+    }
+    restartBurstCycle();
+    endTransaction();
+    // keep the shadow in step with a burst over the configuration registers
+    for (i = 0; i < num && addr + i < CC1101_CONFIG_SIZE; i++) {
+        shadow[addr + i] = buffer[i];
+        shadowValid |= 1ull << (addr + i);
     }
-    chipDeselect();
 }
 
 // sends a strobe(a command) to CC1101
 byte CC1101::strobe(byte strobe) {
-    chipSelect();
-    waitMiso();
-    byte reply = spi.transfer(strobe);
-    chipDeselect();
+    TRACE_INSTANT(TRACE_STROBE, strobe);
+    beginTransaction();
+    byte reply = spiTransfer(strobe);
+    endTransaction();
+    if (strobe == CC1101_SPWD || strobe == CC1101_SWOR) shadowValid &= ~SHADOW_LOST_IN_SLEEP;
+    if (strobe == CC1101_SFRX) pendingSize = 0;
+    if ((strobe == CC1101_SPWD || strobe == CC1101_SWOR) && manualCal && fscalValid) fscalRestore = true;
     return reply;
 }
 
@@ -104,11 +205,10 @@ byte CC1101::strobe(byte strobe) {
 byte CC1101::readRegister(byte addr) {
     byte temp, value;
     temp = addr|READ_SINGLE; // bit 7 is set for signe register read
-    chipSelect();
-    waitMiso();
-    spi.transfer(temp);
-    value=spi.transfer(0);
-    chipDeselect();
+    beginTransaction();
+    spiTransfer(temp);
+    value=spiTransfer(0);
+    endTransaction();
     return value;
 }
 
@@ -118,24 +218,34 @@ byte CC1101::readRegister(byte addr) {
 void CC1101::readBurstRegister(byte addr, byte *buffer, byte num) {
     byte i,temp;
     temp = addr | READ_BURST;
-    chipSelect();
-    waitMiso();
-    spi.transfer(temp);
-    for(i=0;i<num;i++) {
-        buffer[i]=spi.transfer(0);
+    beginTransaction();
+#ifdef CC1101_BLOCK_TRANSFER
+    if (burstMode == CC1101_BURST_BLOCK && num <= BUFFER_SIZE) {
+        burst_tx[0] = temp;
+        memset(&burst_tx[1], 0, num);
+        spi.transferBytes(burst_tx, burst_rx, num + 1);
+        spiStats.bytes += num + 1;
+        memcpy(buffer, &burst_rx[1], num);
+    } else
+#endif
+    {
+        spiTransfer(temp);
+        for(i=0;i<num;i++) {
+            buffer[i]=spiTransfer(0);
+        }
     }
-    chipDeselect();
+    restartBurstCycle();
+    endTransaction();
 }
 
 // readStatus : read status register
 byte CC1101::readStatusRegister(byte addr) {
     byte value,temp;
     temp = addr | READ_BURST;
-    chipSelect();
-    waitMiso();
-    spi.transfer(temp);
-    value=spi.transfer(0);
-    chipDeselect();
+    beginTransaction();
+    spiTransfer(temp);
+    value=spiTransfer(0);
+    endTransaction();
     return value;
 }
 
@@ -172,6 +282,12 @@ void CC1101::setCommonRegisters()
 }
 
 void CC1101::reset (void) {
+    transactionDepth = 0;
+    pendingSize = 0;
+    shadowValid = 0;        // every register is back at its default
+    manualCal = false;      // and MCSM0 with them
+    fscalValid = false;
+    fscalRestore = false;
     chipDeselect();
     delayMicroseconds(50);
     chipSelect();
@@ -180,9 +296,10 @@ void CC1101::reset (void) {
     delayMicroseconds(50);
     chipSelect();
     waitMiso();
-    spi.transfer(CC1101_SRES);
+    spiTransfer(CC1101_SRES);
     waitMiso();
     chipDeselect();
+    spiStats.transactions++;
 }
 
 // CC1101 pin & registers initialization
@@ -203,6 +320,56 @@ void CC1101::begin(const uint32_t freq) {
     disableAddressCheck();
 }
 
+// CC1101 pin initialization with a complete register image, CC1101_CONFIG_SIZE bytes
+// from CC1101_IOCFG2 to CC1101_TEST0. The registers are uploaded in one burst instead
+// of the register by register set up done by begin(freq).
+void CC1101::begin(const byte *config) {
+    pinMode(MISOpin, INPUT);
+    pinMode(CSNpin, OUTPUT);
+    reset();
+    writeConfiguration(config);
+}
+
+// Uploads a complete register image in one burst. Sets the chip to IDLE state.
+void CC1101::writeConfiguration(const byte *config) {
+    setIDLEstate();
+    writeBurstRegister(CC1101_IOCFG2, config, CC1101_CONFIG_SIZE);
+}
+
+// Reads every configuration register back in one burst and compares it with config.
+// FSCAL3..FSCAL1 are skipped as the chip rewrites them at each calibration.
+bool CC1101::verifyConfiguration(const byte *config) {
+    byte readback[CC1101_CONFIG_SIZE];
+    readBurstRegister(CC1101_IOCFG2, readback, CC1101_CONFIG_SIZE);
+    for (byte addr = 0; addr < CC1101_CONFIG_SIZE; addr++) {
+        if ((SHADOW_VOLATILE >> addr) & 1) continue;
+        if (readback[addr] != config[addr]) {
+            PRINT("Register mismatch at 0x");
+            PRINTLN(addr, HEX);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads every configuration register back in one burst and compares it with what has
+// been written since the reset (the shadow copy), so changes made after the upload such
+// as setFrequency() are included. Registers never written or lost in sleep are skipped,
+// as are FSCAL3..FSCAL1.
+bool CC1101::verifyConfiguration() {
+    byte readback[CC1101_CONFIG_SIZE];
+    readBurstRegister(CC1101_IOCFG2, readback, CC1101_CONFIG_SIZE);
+    for (byte addr = 0; addr < CC1101_CONFIG_SIZE; addr++) {
+        if (((SHADOW_VOLATILE >> addr) & 1) || !((shadowValid >> addr) & 1)) continue;
+        if (readback[addr] != shadow[addr]) {
+            PRINT("Register mismatch at 0x");
+            PRINTLN(addr, HEX);
+            return false;
+        }
+    }
+    return true;
+}
+
 
 bool CC1101::sendPacketSlowMCU(const byte *txBuffer,byte size) {
     if (txBuffer==NULL || size==0) {
@@ -237,9 +404,17 @@ bool CC1101::sendPacketSlowMCU(const byte *txBuffer,byte size) {
         PRINTLN("send=false");
         return false;
     } else  {
+        uint32_t start = micros();
         while(1) {
             state = getState();
             if (state==0) break;
+            if (!waitPoll(start, TX_END_TIMEOUT)) {
+                waitDone(start, CC1101_ERROR_STATE);
+                setIDLEstate();
+                strobe(CC1101_SFTX);
+                setRXstate();
+                return false;
+            }
         }
     }
     setIDLEstate();
@@ -293,71 +468,196 @@ bool CC1101::sendPacket(const char* msg) {
 
 // Sends the SRX strobe (if needed) and waits until the state actually goes RX
 // flushes FIFOs if needed
-void CC1101::setRXstate(void) {
+cc1101_error_t CC1101::setRXstate(void) {
+    cc1101_error_t result = CC1101_OK;
+    uint32_t start = micros();
+    bool waited = false;
+
+    beginTransaction();
     while(1) {
         byte state=getState();
         if      (state==0b001) break; // RX state = 1 SWRS061I doc page 31
         else if (state==0b110) strobe(CC1101_SFRX);
         else if (state==0b111) strobe(CC1101_SFTX);
+        else if (state==0b000 && fscalRestore) restoreCalibration();
+        if (waited && !waitPoll(start, CC1101_STATE_TIMEOUT_US)) {
+            result = CC1101_ERROR_STATE;
+            break;
+        }
+        waited = true;
         strobe(CC1101_SRX);
     }
+    if (waited) waitDone(start, result);
+    endTransaction();
+    return result;
 }
 
-// getPacket read sdata received from RXfifo. Assumes (1 byte PacketLength) + (payload) + (2bytes CRCok, RSSI, LQI)
-// a buffer with 64 bytes is OK (max payload = 61) TODO
+// getPacket reads the first complete packet through the same drain as getPackets(),
+// any further packets stay in the FIFO for the next call.
 byte CC1101::getPacket(byte *rxBuffer) {
-    byte state = getState();
-    if (state==1) { // RX
-        return 0;
+    cc1101_frame_t frame;
+    byte size = drainPackets(&frame, NULL, 1) ? frame.size : 0;
+    if (size) memcpy(rxBuffer, frame.data, size);
+    else memset(status,0,2); // sets the crc to be wrong and clears old LQI RSSI values
+    return size;
+}
+
+byte CC1101::readRxBytes() {
+    byte rx1, rx2;
+    beginTransaction();
+    rx1 = readStatusRegister(CC1101_RXBYTES);
+    for (byte reads=0; reads<8; reads++) {      // only differs while a byte is arriving
+        rx2 = rx1;
+        rx1 = readStatusRegister(CC1101_RXBYTES);
+        if (rx1 == rx2) break;
     }
-    byte rxbytes = readStatusRegister(CC1101_RXBYTES);
-    rxbytes = rxbytes & BYTES_IN_RXFIFO;
-    byte size=0;
-    if(rxbytes) {
-        size=readRegister(CC1101_RXFIFO);
-        if (size>0 && size<=MAX_PACKET_LEN) {
-            if ( (size+3)<=rxbytes ) { // TODO
-                readBurstRegister(CC1101_RXFIFO, rxBuffer, size);
-                readBurstRegister(CC1101_RXFIFO, status, 2);
-                byte rem=rxbytes-(size+3);
-                if (rem>0) {
-                    PRINT("FIFO STILL HAS BYTES :");
-                    PRINTLN(rem);
-                }
-            } else {
-                PRINTLN("size+3<=rxbytes");
-                size=0;
+    endTransaction();
+    return rx1;
+}
+
+// Drains complete packets without leaving RX. The length byte is only read when at least
+// one more byte follows it, so the last byte of the FIFO is never read while the chip
+// may still be writing to it.
+// The whole drain runs in one chip select cycle.
+byte CC1101::getPackets(cc1101_frame_t *frames, byte maxFrames) {
+    return drainPackets(frames, NULL, maxFrames);
+}
+
+// Same drain into buffers the caller owns (e.g. a pool), frame i goes to *slots[i]
+byte CC1101::getPackets(cc1101_frame_t *const *slots, byte maxFrames) {
+    return drainPackets(NULL, slots, maxFrames);
+}
+
+// Either frames (an array) or slots (pointers) is used
+byte CC1101::drainPackets(cc1101_frame_t *frames, cc1101_frame_t *const *slots, byte maxFrames) {
+    byte count = 0;
+    cc1101_frame_t *last = NULL;
+    bool flush = false;
+
+    TRACE_BEGIN(TRACE_GET_PACKETS, 0);
+    beginTransaction();
+    while (count < maxFrames) {
+        byte rxbytes = readRxBytes();
+        if (rxbytes & RXFIFO_OVERFLOW) {
+            // whatever is in the FIFO can not be trusted to be whole packets
+            rxStats.overflows++;
+            flush = true;
+            break;
+        }
+
+        if (pendingSize == 0) {
+            if (rxbytes < 2) break;
+            byte size = readRegister(CC1101_RXFIFO);
+            if (size == 0 || size > MAX_PACKET_LEN) {
+                PRINT("Wrong rx size=");
+                PRINTLN(size);
+                flush = true;
+                break;
+            }
+            pendingSize = size;
+            pendingSince = micros();
+            continue;           // RXBYTES again, without the length byte
+        }
+
+        // the first packet is complete when GDO0 fires, a later one may still be arriving.
+        // Rather than hold the bus waiting for it, the end of packet interrupt brings the
+        // caller back for the rest.
+        if ((rxbytes & BYTES_IN_RXFIFO) < pendingSize + 2) {
+            if (micros() - pendingSince > RX_COMPLETE_TIMEOUT) {
+                rxStats.incomplete++;
+                flush = true;   // the length byte has gone, the rest can't be framed
             }
-        } else { 
-            PRINT("Wrong rx size=");
-            PRINTLN(size);
-            size=0;
+            break;
         }
+
+        cc1101_frame_t *frame = slots ? slots[count] : &frames[count];
+        frame->size = pendingSize;
+        readBurstRegister(CC1101_RXFIFO, frame->data, pendingSize);
+        readBurstRegister(CC1101_RXFIFO, frame->status, 2);
+        pendingSize = 0;
+        last = frame;
+        count++;
     }
-    setIDLEstate();
-    strobe(CC1101_SFRX);
-    setRXstate();
-    if (size==0) memset(status,0,2); // sets the crc to be wrong and clears old LQI RSSI values
-    return size;
+
+    if (flush) {
+        rxStats.flushes++;
+        setIDLEstate();
+        strobe(CC1101_SFRX);    // drops pendingSize
+    }
+    if (flush || getState() != 0b001) {
+        setRXstate();   // RXOFF_MODE = IDLE, or an overflow
+    }
+    endTransaction();
+
+    if (count > 0) {
+        rxStats.drains++;
+        rxStats.frames += count;
+        rxStats.recovered += count - 1;
+        memcpy(status, last->status, 2);   // getRSSIdbm() etc. report the last one
+    }
+    TRACE_END(TRACE_GET_PACKETS, count);
+    return count;
 }
 
-void CC1101::waitMiso() {
+bool CC1101::waitMiso() {
     // The pin is the actual MISO pin EXCEPT when the MCU cannot digitalRead(MISO)
     // if SPI is active (esp8266). In this case we connect another pin with MISO
     // and we digitalRead this instead
-    while (digitalRead(MISOpin)>0);
+    if (digitalRead(MISOpin)==0) return true;   // ready, the usual case
+    uint32_t start = micros();
+    while (digitalRead(MISOpin)>0) {
+        if (!waitPoll(start, CC1101_MISO_TIMEOUT_US)) {
+            waitDone(start, CC1101_ERROR_MISO);
+            return false;
+        }
+    }
+    waitDone(start, CC1101_OK);
+    return true;
+}
+
+// Spins for the first CC1101_WAIT_SPIN_US of a wait, then sleeps a tick per poll so a
+// wedged chip can't starve lower priority tasks
+bool CC1101::waitPoll(uint32_t startUs, uint32_t timeoutUs) {
+    uint32_t waited = micros() - startUs;
+    if (waited >= timeoutUs) return false;
+    if (waited >= CC1101_WAIT_SPIN_US) delay(1);
+    return true;
+}
+
+cc1101_error_t CC1101::waitDone(uint32_t startUs, cc1101_error_t result) {
+    uint32_t waited = micros() - startUs;
+    waitStats.waits++;
+    waitStats.totalUs += waited;
+    if (waited > waitStats.maxUs) waitStats.maxUs = waited;
+    if (result != CC1101_OK) {
+        waitStats.timeouts++;
+        if (error == CC1101_OK) error = result;
+    }
+    return result;
 }
 
 // Drives CSN to LOW and according to the SPI standard,
 // CC1101 starts listening to SPI bus
+// On the ESP32 the GPIO set/clear registers are written directly, digitalWrite()
+// costs a pin lookup on every call and CSN toggles twice per register access.
 void CC1101::chipSelect() {
+#if defined(ARDUINO_ARCH_ESP32)
+    if (CSNpin < 32) REG_WRITE(GPIO_OUT_W1TC_REG, BIT(CSNpin));
+    else REG_WRITE(GPIO_OUT1_W1TC_REG, BIT(CSNpin - 32));
+#else
     digitalWrite(CSNpin, LOW);
+#endif
 }
 
 // Drives CSN HIGH and CC1101 ignores the SPI bus
 // TODO not quite drives MISO
 void CC1101::chipDeselect() {
+#if defined(ARDUINO_ARCH_ESP32)
+    if (CSNpin < 32) REG_WRITE(GPIO_OUT_W1TS_REG, BIT(CSNpin));
+    else REG_WRITE(GPIO_OUT1_W1TS_REG, BIT(CSNpin - 32));
+#else
     digitalWrite(CSNpin, HIGH);
+#endif
 }
 
 // settings from RF studio. This is the defauklt
@@ -458,9 +758,82 @@ uint8_t CC1101::getLQI() {
     // return 0x3F - status[1]&0b01111111;;
 }
 
-void CC1101::setIDLEstate() {
+// the same three for a frame drained by getPackets()
+int16_t CC1101::frameRSSIdbm(const cc1101_frame_t *frame) {
+    uint8_t rssi_dec = frame->status[0];
+    const int16_t rssi_offset = 74;
+    if (rssi_dec >= 128) {
+        return (int16_t)((int16_t)(rssi_dec - 256) / 2) - rssi_offset;
+    }
+    return (rssi_dec / 2) - rssi_offset;
+}
+
+bool CC1101::frameCrcOk(const cc1101_frame_t *frame) {
+    return frame->status[1]>>7;
+}
+
+byte CC1101::frameLQI(const cc1101_frame_t *frame) {
+    return frame->status[1]&0b01111111;
+}
+
+cc1101_error_t CC1101::setIDLEstate() {
+    cc1101_error_t result = CC1101_OK;
+    uint32_t start = micros();
+    bool waited = false;
+
+    beginTransaction();
     strobe(CC1101_SIDLE);
-    while (getState()!=0); // wait until state is IDLE(=0)
+    while (getState()!=0) { // wait until state is IDLE(=0)
+        if (!waitPoll(start, CC1101_STATE_TIMEOUT_US)) {
+            result = CC1101_ERROR_STATE;
+            break;
+        }
+        waited = true;
+    }
+    if (waited || result != CC1101_OK) waitDone(start, result);
+    endTransaction();
+    return result;
+}
+
+cc1101_error_t CC1101::setManualCalibration(bool on) {
+    byte mcsm0 = readRegister(CC1101_MCSM0) & ~MCSM0_FS_AUTOCAL;
+    manualCal = on;
+    fscalValid = false;
+    fscalRestore = false;
+    writeRegister(CC1101_MCSM0, on ? mcsm0 : mcsm0 | MCSM0_AUTOCAL_FROM_IDLE);
+    return on ? calibrate() : CC1101_OK;
+}
+
+cc1101_error_t CC1101::calibrate() {
+    cc1101_error_t result = setIDLEstate();
+    if (result != CC1101_OK) return result;
+
+    uint32_t start = micros();
+    beginTransaction();
+    strobe(CC1101_SCAL);
+    while (getState()!=0) { // CALIBRATE, back to IDLE when done
+        if (!waitPoll(start, CC1101_STATE_TIMEOUT_US)) {
+            result = CC1101_ERROR_STATE;
+            break;
+        }
+    }
+    waitDone(start, result);
+    if (result == CC1101_OK) {
+        readBurstRegister(CC1101_FSCAL3, fscal, sizeof(fscal));
+        fscalValid = true;
+        fscalRestore = false;
+        calStats.calibrations++;
+        calStats.lastUs = micros() - start;
+    }
+    endTransaction();
+    return result;
+}
+
+// Puts the cached calibration back, the chip must be IDLE
+void CC1101::restoreCalibration() {
+    writeBurstRegister(CC1101_FSCAL3, fscal, sizeof(fscal));
+    fscalRestore = false;
+    calStats.restores++;
 }
 
 bool CC1101::printf(const char* fmt, ...) {
@@ -500,15 +873,17 @@ void CC1101::whitening(const bool w) {
 }
 
 // return the state of the chip SWRS061I page 31
+// both SNOP reads share one chip select cycle
 byte CC1101::getState() { // we read 2 times due to errata note
-    byte old_state=strobe(CC1101_SNOP);
-    while(1) {
-        byte state = strobe(CC1101_SNOP);
-        if (state==old_state) {
-            return (state>>4)&0b00111;
-        }
+    beginTransaction();
+    byte old_state=spiTransfer(CC1101_SNOP);
+    for (byte reads=0; reads<8; reads++) {      // only differs while the state is changing
+        byte state = spiTransfer(CC1101_SNOP);
+        if (state==old_state) break;
         old_state=state;
     }
+    endTransaction();
+    return (old_state>>4)&0b00111;
 }
 
 /* calculate the value that is written to the register for settings the base frequency
@@ -529,6 +904,7 @@ void CC1101::setFrequency(const uint32_t freq) {
     writeRegister(CC1101_FREQ2, FREQ2);
     writeRegister(CC1101_FREQ1, FREQ1);
     writeRegister(CC1101_FREQ0, FREQ0);
+    if (manualCal) calibrate();     // the cached one is for the old frequency
     #ifdef CC1101_DEBUG
         PRINT("FREQ2=");
         PRINTLN(FREQ2, HEX);
@@ -603,7 +979,8 @@ void CC1101::wor(uint16_t timeout) {
     // 6 :       12.50% duty cycle but not consumed actually, because RX_TIME_RSSI=1
     writeRegister(CC1101_MCSM2,   0b11000+6); 
     //
-    writeRegister(CC1101_MCSM0,  0x38); // kanei autocal kathe 4i fora apo rx/tx->idle
+    // kanei autocal kathe 4i fora apo rx/tx->idle, unless the calibration is cached
+    writeRegister(CC1101_MCSM0,  manualCal ? 0x38 & ~MCSM0_FS_AUTOCAL : 0x38);
     //
     uint16_t evt01=timeout*(CC1101_CRYSTAL_FREQUENCY/1000)/750;
     PRINT("WOREVT0=");
@@ -623,7 +1000,7 @@ void CC1101::wor(uint16_t timeout) {
 void CC1101::wor2rx() {
     writeRegister(CC1101_WORCTRL,0xFB);
     writeRegister(CC1101_MCSM2, 0x07);
-    writeRegister(CC1101_MCSM0, 0x18);
+    writeRegister(CC1101_MCSM0, manualCal ? 0x18 & ~MCSM0_FS_AUTOCAL : 0x18);   // as setManualCalibration() left it
     writeRegister(CC1101_WOREVT0, 0x6B); // probably not needed
     writeRegister(CC1101_WOREVT1, 0x87); // probably not needed
 }
@@ -638,6 +1015,7 @@ bool CC1101::sendPacket(const byte *txBuffer, byte size, const uint32_t duration
         PRINTLN("Warning, packet truncated");
         size=MAX_PACKET_LEN;
     }
+    TRACE_BEGIN(TRACE_SEND_PACKET, size);
     byte txbytes = readStatusRegister(CC1101_TXBYTES); // contains Bit:8 FIFO_UNDERFLOW + other bytes FIFO bytes
     if (txbytes!=0 || getState()!=1 ) {
         if (txbytes) PRINTLN("BYTES IN TX");
@@ -658,6 +1036,7 @@ bool CC1101::sendPacket(const byte *txBuffer, byte size, const uint32_t duration
         // high RSSI
         // No IDLE strobe here, we have potentially an incoming packet.
         PRINTLN("send=false");
+        TRACE_END(TRACE_SEND_PACKET, 0);
         return false;
     } else  {
         uint32_t t = millis();
@@ -666,15 +1045,27 @@ bool CC1101::sendPacket(const byte *txBuffer, byte size, const uint32_t duration
         writeBurstRegister(CC1101_TXFIFO, txBuffer, size); // write the packet data to txbuffer
         delayMicroseconds(500); // it helps ?
         //
+        // Wait for the end of the packet, the chip then goes to IDLE or RX as MCSM1
+        // TXOFF_MODE says (or TX underflow)
+        uint32_t start = micros();
         while(1) {
             state = getState();
-            if (state==0) break; // we wait for IDLE state
+            if (state!=0b010 && state!=0b100 && state!=0b101) break;   // TX, calibrating or settling
+            if (!waitPoll(start, TX_END_TIMEOUT)) {
+                waitDone(start, CC1101_ERROR_STATE);
+                setIDLEstate();
+                strobe(CC1101_SFTX);
+                setRXstate();
+                TRACE_END(TRACE_SEND_PACKET, 0);
+                return false;
+            }
         }
     }
     setIDLEstate();
     strobe(CC1101_SFTX);
     setRXstate();
     PRINTLN("true");
+    TRACE_END(TRACE_SEND_PACKET, 1);
     return true;
 }
 
@@ -0,0 +1,157 @@
+#include <Preferences.h>
+#include "afc.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "AFC";
+
+static Preferences preferences;
+
+
+/**
+ * @brief Load the correction saved by a previous run. Call once before radio_setup(),
+ * which applies it.
+ *
+ * @param afc AFC state to initialise
+ */
+void afc_begin(afc_state_t *afc) {
+    memset(afc, 0, sizeof(afc_state_t));
+
+    if (preferences.begin("radio", true)) {
+        afc->fsctrl0 = preferences.getChar("fsctrl0", 0);
+        preferences.end();
+    }
+    afc->fsctrl0 = constrain(afc->fsctrl0, -AFC_MAX_OFFSET, AFC_MAX_OFFSET);
+    afc->saved_fsctrl0 = afc->fsctrl0;
+    afc->estimate = afc->fsctrl0;
+
+    ESP_LOGI(TAG, "Saved frequency correction: %d steps (%" PRId32 " Hz)", afc->fsctrl0, afc_offset_hz(afc));
+}
+
+
+/**
+ * @brief Write the correction to the radio. FSCTRL0 is used at the next calibration so
+ * the radio should be idle. With the calibration cached (CC1101::manualCal) that is now.
+ *
+ * @param radio CC1101 to correct
+ * @param afc AFC state
+ */
+void afc_apply(CC1101 &radio, const afc_state_t *afc) {
+    radio.writeRegister(CC1101_FSCTRL0, (byte)afc->fsctrl0);
+    if (radio.manualCal) {
+        radio.calibrate();
+    }
+}
+
+
+/**
+ * @brief Forget the correction after the carrier has moved (see radio_survey.h), it is
+ * learnt again from the next frames. Write it with afc_apply(). The next afc_save() puts
+ * the zero in NVS straight away, or after a reset the old correction would be applied to
+ * the new carrier.
+ *
+ * @param afc AFC state
+ */
+void afc_restart(afc_state_t *afc) {
+    afc->fsctrl0 = 0;
+    afc->estimate = 0;
+    afc->updates = 0;
+    afc->b_restarted = true;
+}
+
+
+/**
+ * @brief Count a received frame for the packet yield.
+ *
+ * @param afc AFC state
+ * @param b_crc_ok CRC result of the frame
+ */
+void afc_count_frame(afc_state_t *afc, bool b_crc_ok) {
+    if (b_crc_ok) {
+        afc->frames_good++;
+    } else {
+        afc->frames_bad++;
+    }
+}
+
+
+/**
+ * @brief Use FREQEST of a good iBoost frame and move FSCTRL0 when the filtered offset
+ * is more than a step away from the correction in use. A change takes the radio through
+ * IDLE to recalibrate, afc_save() puts it in NVS.
+ *
+ * @param radio CC1101 that received the frame
+ * @param afc AFC state
+ * @param freqest FREQEST latched at the end of the frame, before the FIFO was drained
+ * @return true if the correction changed
+ */
+bool afc_update(CC1101 &radio, afc_state_t *afc, int8_t freqest) {
+    float measured = afc->fsctrl0 + freqest;      // FREQEST is relative to the current correction
+
+    afc->last_freqest = freqest;
+    if (afc->updates == 0) {
+        afc->estimate = measured;
+    } else {
+        afc->estimate += (measured - afc->estimate) / AFC_FILTER;
+    }
+    afc->updates++;
+
+    bool b_changed = false;
+    if (afc->updates >= AFC_LOCK_FRAMES && fabsf(afc->estimate - afc->fsctrl0) >= 1.0f) {
+        int8_t fsctrl0 = (int8_t)constrain(lroundf(afc->estimate), -AFC_MAX_OFFSET, AFC_MAX_OFFSET);
+        if (fsctrl0 != afc->fsctrl0) {      // not already at the limit
+            ESP_LOGI(TAG, "Frequency correction %d -> %d steps (%" PRId32 " Hz), FREQEST %d",
+                afc->fsctrl0, fsctrl0, (int32_t)(fsctrl0 * AFC_STEP_HZ), freqest);
+            afc->fsctrl0 = fsctrl0;
+            afc->corrections++;
+            b_changed = true;
+
+            radio.setIDLEstate();
+            afc_apply(radio, afc);
+            radio.setRXstate();
+        }
+    }
+
+    return b_changed;
+}
+
+
+/**
+ * @brief Save a changed correction to NVS, at most once per AFC_SAVE_INTERVAL unless it
+ * was restarted. A flash write can take milliseconds so this is called from the decode
+ * task, not the radio task that changes the correction.
+ *
+ * @param afc AFC state
+ */
+void afc_save(afc_state_t *afc) {
+    bool b_restarted = afc->b_restarted;
+    int8_t fsctrl0 = afc->fsctrl0;      // the radio task may change it meanwhile
+
+    if (fsctrl0 == afc->saved_fsctrl0 ||
+        (!b_restarted && afc->saves != 0 && millis() - afc->last_save_ms < AFC_SAVE_INTERVAL)) {
+        return;
+    }
+    if (preferences.begin("radio", false)) {
+        preferences.putChar("fsctrl0", fsctrl0);
+        preferences.end();
+        afc->saved_fsctrl0 = fsctrl0;
+        afc->last_save_ms = millis();
+        afc->saves++;
+        if (b_restarted) {
+            afc->b_restarted = false;
+        }
+    } else {
+        ESP_LOGE(TAG, "Unable to open NVS namespace");
+    }
+}
+
+
+/**
+ * @brief Correction in use in Hz.
+ *
+ * @param afc AFC state
+ * @return int32_t offset from the configured carrier (Hz)
+ */
+int32_t afc_offset_hz(const afc_state_t *afc) {
+    return (int32_t)(afc->fsctrl0 * AFC_STEP_HZ);
+}
@@ -0,0 +1,73 @@
+#include <string.h>
+#include "frame_dedup.h"
+
+#define FNV_OFFSET  2166136261u
+#define FNV_PRIME   16777619u
+
+
+/**
+ * @brief Start with an empty table.
+ *
+ * @param dedup Table
+ * @param horizon_ms Copies within this of the first sighting are duplicates, 0 to keep everything
+ */
+void frame_dedup_begin(frame_dedup_t *dedup, uint32_t horizon_ms) {
+    memset(dedup, 0, sizeof(frame_dedup_t));
+    dedup->horizon_ms = horizon_ms;
+}
+
+
+/**
+ * @brief Check a frame against the recent ones and remember it if it is new.
+ *
+ * @param dedup Table
+ * @param packet Frame data, starting with the address and type
+ * @param size Frame length
+ * @param now_ms Arrival time
+ * @return true if it is a duplicate and can be dropped
+ */
+bool frame_dedup_check(frame_dedup_t *dedup, const uint8_t *packet, uint8_t size, uint32_t now_ms) {
+    uint32_t hash = FNV_OFFSET;
+    uint16_t address;
+    uint8_t type;
+    dedup_entry_t *slot = NULL;
+
+    dedup->frames++;
+    if (dedup->horizon_ms == 0 || size < 3) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < size; i++) {
+        hash = (hash ^ packet[i]) * FNV_PRIME;
+    }
+    address = (uint16_t)(packet[0] << 8 | packet[1]);
+    type = packet[2];
+
+    for (uint8_t probe = 0; probe < DEDUP_PROBES; probe++) {
+        dedup_entry_t *entry = &dedup->entries[(hash + probe) & (DEDUP_SLOTS - 1)];
+        bool b_expired = !entry->b_used || now_ms - entry->first_ms >= dedup->horizon_ms;
+
+        if (!b_expired && entry->hash == hash && entry->address == address && entry->type == type && entry->size == size) {
+            dedup->duplicates++;
+            return true;
+        }
+        // First free or expired slot, else the oldest in the run
+        if (slot == NULL || (slot->b_used && (b_expired || (int32_t)(entry->first_ms - slot->first_ms) < 0))) {
+            slot = entry;
+        }
+        if (b_expired) {
+            entry->b_used = false;
+        }
+    }
+
+    if (slot->b_used) {
+        dedup->evictions++;
+    }
+    slot->hash = hash;
+    slot->address = address;
+    slot->type = type;
+    slot->size = size;
+    slot->first_ms = now_ms;
+    slot->b_used = true;
+    return false;
+}
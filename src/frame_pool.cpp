@@ -0,0 +1,137 @@
+#include "frame_pool.h"
+#include "esp_log.h"
+#include "trace.h"
+
+// Logging tag
+static const char* TAG = "POOL";
+
+static rx_buffer_t buffers[FRAME_POOL_SIZE];
+static QueueHandle_t free_queue = NULL;        // Indices of buffers nobody holds
+static QueueHandle_t ready_queue = NULL;       // Indices of filled buffers, oldest first
+static frame_pool_stats_t stats;
+static portMUX_TYPE pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/**
+ * @brief Create the queues and put every buffer on the free list.
+ *
+ * @return true if the queues were created
+ */
+bool frame_pool_begin(void) {
+    free_queue = xQueueCreate(FRAME_POOL_SIZE, sizeof(uint8_t));
+    ready_queue = xQueueCreate(FRAME_POOL_SIZE, sizeof(uint8_t));
+    if (free_queue == NULL || ready_queue == NULL) {
+        ESP_LOGE(TAG, "Error creating frame pool queues");
+        return false;
+    }
+    memset(&stats, 0, sizeof(stats));
+    for (uint8_t i = 0; i < FRAME_POOL_SIZE; i++) {
+        xQueueSend(free_queue, &i, 0);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Take up to count free buffers without waiting.
+ *
+ * @param indices Set to the buffers taken
+ * @param count Buffers wanted
+ * @return uint8_t buffers taken
+ */
+uint8_t frame_pool_alloc(uint8_t *indices, uint8_t count) {
+    uint8_t taken = 0;
+
+    while (taken < count && xQueueReceive(free_queue, &indices[taken], 0) == pdTRUE) {
+        taken++;
+    }
+
+    portENTER_CRITICAL(&pool_mux);
+    stats.in_use += taken;
+    if (stats.in_use > stats.max_in_use) {
+        stats.max_in_use = stats.in_use;
+    }
+    portEXIT_CRITICAL(&pool_mux);
+    return taken;
+}
+
+
+/**
+ * @brief Count a drain that stopped (or never started) for want of a free buffer.
+ *
+ */
+void frame_pool_exhausted(void) {
+    portENTER_CRITICAL(&pool_mux);
+    stats.exhausted++;
+    portEXIT_CRITICAL(&pool_mux);
+    ESP_LOGW(TAG, "Frame pool exhausted, decoder behind");
+}
+
+
+/**
+ * @brief Buffer for an index.
+ *
+ * @param index Pool index
+ * @return rx_buffer_t* buffer
+ */
+rx_buffer_t *frame_pool_get(uint8_t index) {
+    return &buffers[index];
+}
+
+
+/**
+ * @brief Hand a filled buffer to the decoder. The ready queue holds the whole pool so
+ * this never blocks.
+ *
+ * @param index Pool index
+ */
+void frame_pool_submit(uint8_t index) {
+    TRACE_INSTANT(TRACE_POOL_SUBMIT, index);
+    xQueueSend(ready_queue, &index, 0);
+
+    portENTER_CRITICAL(&pool_mux);
+    stats.submitted++;
+    portEXIT_CRITICAL(&pool_mux);
+}
+
+
+/**
+ * @brief Wait for a filled buffer.
+ *
+ * @param index Set to the buffer
+ * @param wait Ticks to wait
+ * @return true if there is a buffer, it must be given back with frame_pool_release()
+ */
+bool frame_pool_receive(uint8_t *index, TickType_t wait) {
+    TRACE_BEGIN(TRACE_POOL_WAIT, 0);
+    bool b_received = xQueueReceive(ready_queue, index, wait) == pdTRUE;
+    TRACE_END(TRACE_POOL_WAIT, b_received ? *index : 0xffff);
+    return b_received;
+}
+
+
+/**
+ * @brief Give a buffer back, filled or not.
+ *
+ * @param index Pool index
+ */
+void frame_pool_release(uint8_t index) {
+    buffers[index].frame.size = 0;
+    xQueueSend(free_queue, &index, 0);
+
+    portENTER_CRITICAL(&pool_mux);
+    stats.in_use--;
+    portEXIT_CRITICAL(&pool_mux);
+}
+
+
+/**
+ * @brief Copy the pool counters.
+ *
+ * @param copy Where to put them
+ */
+void frame_pool_snapshot(frame_pool_stats_t *copy) {
+    portENTER_CRITICAL(&pool_mux);
+    memcpy(copy, &stats, sizeof(frame_pool_stats_t));
+    portEXIT_CRITICAL(&pool_mux);
+}
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "grid_estimate.h"
+
+
+/**
+ * @brief Start with no pairs and no direction. Also call when the primary unit changes,
+ * another installation's clamp has its own line.
+ *
+ * @param grid Estimate
+ */
+void grid_estimate_begin(grid_estimate_t *grid) {
+    memset(grid, 0, sizeof(grid_estimate_t));
+}
+
+
+/**
+ * @brief The fitted line, watts = scale * sample sum + offset.
+ *
+ * @param grid Estimate
+ * @param scale Watts per unit of sample sum
+ * @param offset Watts at a sample sum of 0
+ * @return true if there are enough pairs
+ */
+bool grid_estimate_line(const grid_estimate_t *grid, float *scale, float *offset) {
+    if (grid->pairs < GRID_MIN_PAIRS || grid->sum_x <= 0.0f) {
+        return false;
+    }
+
+    float mean_x = grid->sum_x / grid->weight;
+    float mean_y = grid->sum_y / grid->weight;
+    float var_x = grid->sum_xx / grid->weight - mean_x * mean_x;
+
+    if (var_x >= GRID_MIN_SPREAD * GRID_MIN_SPREAD) {
+        *scale = (grid->sum_xy / grid->weight - mean_x * mean_y) / var_x;
+        *offset = mean_y - *scale * mean_x;
+    } else {
+        *scale = grid->sum_y / grid->sum_x;         // through zero
+        *offset = 0.0f;
+    }
+    return *scale > 0.0f;
+}
+
+
+/**
+ * @brief Record a sender frame and turn it into a grid reading if possible.
+ *
+ * @param grid Estimate
+ * @param samples Sample bytes of the frame (IBOOST_SENDER_SAMPLES)
+ * @param count Number of samples
+ * @param now_ms Arrival time
+ * @param watts Set to the reading, negative exporting
+ * @return true if there is a reading
+ */
+bool grid_estimate_sender(grid_estimate_t *grid, const uint8_t *samples, uint8_t count, uint32_t now_ms, int32_t *watts) {
+    uint32_t sum = 0;
+    float scale, offset;
+
+    for (uint8_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    grid->sender_sum = sum;
+    grid->sender_ms = now_ms;
+    grid->b_sender_valid = true;
+
+    if (grid->sign == 0 || now_ms - grid->main_unit_ms > GRID_SIGN_TIMEOUT || !grid_estimate_line(grid, &scale, &offset)) {
+        return false;
+    }
+    float magnitude = scale * sum + offset;
+    *watts = magnitude > 0.0f ? grid->sign * (int32_t)(magnitude + 0.5f) : 0;
+    grid->estimates++;
+    return true;
+}
+
+
+/**
+ * @brief Record a main unit grid reading, which sets the direction and, paired with the
+ * sender frame just before it, refines the line.
+ *
+ * @param grid Estimate
+ * @param watts P1 / MAGIC_NUMBER, negative exporting
+ * @param now_ms Arrival time
+ */
+void grid_estimate_main_unit(grid_estimate_t *grid, int32_t watts, uint32_t now_ms) {
+    if (watts != 0) {
+        grid->sign = watts > 0 ? 1 : -1;
+    }
+    grid->main_unit_ms = now_ms;
+
+    if (!grid->b_sender_valid || now_ms - grid->sender_ms > GRID_PAIR_WINDOW) {
+        return;
+    }
+    grid->b_sender_valid = false;       // one pair per sender frame
+
+    float x = grid->sender_sum;
+    float y = watts < 0 ? -watts : watts;
+    grid->weight = grid->weight * GRID_FIT_DECAY + 1.0f;
+    grid->sum_x = grid->sum_x * GRID_FIT_DECAY + x;
+    grid->sum_y = grid->sum_y * GRID_FIT_DECAY + y;
+    grid->sum_xx = grid->sum_xx * GRID_FIT_DECAY + x * x;
+    grid->sum_xy = grid->sum_xy * GRID_FIT_DECAY + x * y;
+    grid->pairs++;
+}
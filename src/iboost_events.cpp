@@ -0,0 +1,273 @@
+#include "iboost_events.h"
+#include "iboost_codec.h"
+#include "config.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "EVENTS";
+
+
+/**
+ * @brief Send an event to the display.
+ *
+ * @param events State
+ * @param event Event
+ * @param value Watts, Wh or LQI
+ * @param info iBoost information
+ */
+static void send_event(iboost_events_t *events, sl_event_t event, float value, ib_info_t info) {
+    electricity_event_t electricity_event;
+
+    electricity_event.event = event;
+    electricity_event.value = value;
+    electricity_event.info = info;
+    electricity_event.arrival_us = events->arrival_us;
+    events->sink->event(&electricity_event);
+}
+
+
+/**
+ * @brief Send a grid reading to the display and publish it to iboost/grid.
+ *
+ * @param events State
+ * @param watts Grid power, negative when exporting
+ * @param source "main" for the main unit's P1, "sender" for an estimate from a sender frame
+ */
+static void report_grid(iboost_events_t *events, long watts, const char *source) {
+    JsonDocument doc;
+
+    if (watts < 0) {            // exporting
+        send_event(events, SL_EXPORT, labs(watts), IB_NONE);
+    } else if (watts > 0) {     // importing
+        send_event(events, SL_IMPORT, watts, IB_NONE);
+    }
+
+    doc["watts"] = watts;
+    doc["source"] = source;
+    events->sink->publish("iboost/grid", doc, events->arrival_us);
+}
+
+
+/**
+ * @brief Publish what we know about a unit to iboost/unit/<address>.
+ *
+ * @param events State
+ * @param unit Unit
+ */
+static void publish_unit(iboost_events_t *events, const iboost_unit_t *unit) {
+    static const char *tank[] = {"", "", "", "Off", "Heating by Solar", "HOT"};     // indexed by ib_info_t
+    JsonDocument doc;
+    char topic[32];
+
+    doc["savedToday"] = unit->today;
+    doc["savedYesterday"] = unit->yesterday;
+    doc["savedLast7"] = unit->last7;
+    doc["savedLast28"] = unit->last28;
+    doc["savedTotal"] = unit->total;
+    doc["hotWater"] = tank[unit->tank];
+    doc["heating"] = unit->heating;
+    doc["battery"] = unit->b_battery_ok ? "OK" : "LOW";
+    doc["lqi"] = (int)(unit->lqi + 0.5f);
+    doc["rssi"] = unit->rssi;
+    snprintf(topic, sizeof(topic), "iboost/unit/%04x", unit->address);
+    events->sink->publish(topic, doc, events->arrival_us);
+}
+
+
+/**
+ * @brief Start with nothing known.
+ *
+ * @param events State
+ * @param units Unit table, also used by the transmit task
+ * @param sink Where the events go
+ */
+void iboost_events_begin(iboost_events_t *events, iboost_units_t *units, const iboost_events_sink_t *sink) {
+    memset(events, 0, sizeof(iboost_events_t));
+    events->units = units;
+    events->sink = sink;
+    events->information.lqi = 255;
+    grid_estimate_begin(&events->grid);
+#ifdef DEDUP_HORIZON    // declared in config.h
+    frame_dedup_begin(&events->dedup, DEDUP_HORIZON);
+#else
+    frame_dedup_begin(&events->dedup, DEDUP_DEFAULT_HORIZON);
+#endif
+}
+
+
+/**
+ * @brief Handle a frame with a good CRC: drop repeats, track the unit, decode main unit
+ * frames, update the display and publish to MQTT.
+ *
+ * @param events State
+ * @param packet Frame data
+ * @param size Frame length
+ * @param rssi Signal strength (dBm)
+ * @param lqi Link quality (lower is better)
+ * @param now_ms Arrival time
+ * @param arrival_us Arrival time (esp_timer_get_time()) for the latency histograms, 0 if not known
+ * @return uint8_t EVENTS_* flags
+ */
+uint8_t iboost_events_frame(iboost_events_t *events, const uint8_t *packet, uint8_t size, int16_t rssi, uint8_t lqi, uint32_t now_ms, int64_t arrival_us) {
+    iboost_information_t *information = &events->information;
+    iboost_units_t *units = events->units;
+    iboost_frame_t decoded;
+    uint8_t result = EVENTS_USED;
+
+    if (frame_dedup_check(&events->dedup, packet, size, now_ms)) {
+        ESP_LOGD(TAG, "Duplicate frame dropped: length=%d, type=%02x", size, size > 2 ? packet[2] : 0);
+        return EVENTS_DUPLICATE;
+    }
+    events->arrival_us = arrival_us;
+    bool b_is_decoded = iboost_decode(packet, size, &decoded);     // see iboost_codec.h
+
+    //   buddy request                            sender packet
+    if (b_is_decoded && (decoded.type == IBOOST_FRAME_BUDDY || decoded.type == IBOOST_FRAME_SENDER)) {
+        events->receive_lqi = lqi;
+        ESP_LOGI(TAG, "Buddy/Sender frame received: length=%d, RSSI=%d, LQI=%d", size, rssi, lqi);
+
+        bool b_primary_changed;
+        iboost_unit_t *unit = units_observe(units, decoded.address, lqi, rssi, now_ms, &b_primary_changed);
+        if (b_primary_changed) { // a stronger (or the pinned) unit, it gets the requests
+            information->address[0] = units->primary->address >> 8;
+            information->address[1] = units->primary->address & 0xff;
+            information->b_is_address_valid = true;
+            grid_estimate_begin(&events->grid);         // another clamp
+
+            ESP_LOGI(TAG, "Updated iBoost address to: %02x,%02x", information->address[0], information->address[1]);
+            events->sink->primary_changed(units->primary->address);
+        }
+
+        if (unit != NULL && unit == units->primary && lqi != information->lqi) {
+            information->lqi = lqi;
+            send_event(events, SL_LQI, lqi, IB_NONE);
+        }
+
+        // Grid readings in between the main unit's, without asking it for anything
+        int32_t grid_watts;
+        if (unit != NULL && unit == units->primary && decoded.type == IBOOST_FRAME_SENDER &&
+            grid_estimate_sender(&events->grid, decoded.samples, IBOOST_SENDER_SAMPLES.size, now_ms, &grid_watts)) {
+            ESP_LOGI(TAG, "Sender estimate: %s %ld Watts", grid_watts < 0 ? "Exporting" : "Importing", (long)labs(grid_watts));
+            report_grid(events, grid_watts, "sender");
+        }
+    }
+
+    // main unit (sending info to iBoost Buddy)
+    if (b_is_decoded && decoded.type == IBOOST_FRAME_MAIN_UNIT) {
+        #ifdef HEXDUMP  // declared in platformio.ini
+            // log level needs to be ESP_LOG_ERROR to get something to print!!
+            ESP_LOG_BUFFER_HEXDUMP(TAG, packet, size, ESP_LOG_ERROR);
+        #endif
+        ESP_LOGI(TAG, "iBoost frame received: length=%d, RSSI=%d, LQI=%d", size, rssi, events->receive_lqi);
+        short heating = decoded.heating;
+        long p1 = decoded.p1;
+        long p2 = decoded.p2; // this depends on the request
+        byte boostTime = decoded.boost_time; // boost time remaining (minutes)
+        bool b_is_water_heating_by_solar = decoded.b_heating_by_solar;
+        bool b_is_cylinder_hot = decoded.b_tank_hot;
+        bool b_is_battery_ok = decoded.b_battery_ok;
+
+        ESP_LOGI(TAG, "packet[6]: %d, packet[7]: %d", packet[6], packet[7]);
+
+        // Every unit keeps its own counters, only the primary drives the display and iboost/iboost
+        iboost_unit_t *unit = units_find(units, decoded.address);
+        if (unit == NULL) {
+            ESP_LOGD(TAG, "Main unit frame from %04x ignored, unit not tracked", decoded.address);
+            return 0;
+        }
+        units_main_unit_frame(unit, decoded.request, p2, heating,
+            b_is_cylinder_hot ? IB_WT_HOT : (b_is_water_heating_by_solar ? IB_WT_HEATING : IB_WT_OFF),
+            b_is_battery_ok, now_ms);
+        publish_unit(events, unit);
+        if (unit != units->primary) {
+            return 0;
+        }
+
+        ESP_LOGI(TAG, "Heating: %d Watts  P1: %ld  %s: %ld Watts  P2: %ld",
+            heating, p1, (p1/MAGIC_NUMBER < 0 ? "Exporting": "Importing"),
+            (p1/MAGIC_NUMBER < 0 ? labs(p1/MAGIC_NUMBER): p1/MAGIC_NUMBER), p2);
+
+        // Importing or exporting electricity, also sets the direction for the sender estimates
+        grid_estimate_main_unit(&events->grid, p1/MAGIC_NUMBER, now_ms);
+        report_grid(events, p1/MAGIC_NUMBER, "main");
+
+        switch (decoded.request) {
+            case   SAVED_TODAY:
+                if (information->today != p2) {   // only update if value changed
+                    information->today = p2;
+                    send_event(events, SL_WT_TODAY, p2, IB_NONE);
+                }
+            break;
+
+            case   SAVED_YESTERDAY:
+                information->yesterday = p2;
+            break;
+
+            case   SAVED_LAST_7:
+                information->last7 = p2;
+            break;
+
+            case   SAVED_LAST_28:
+                information->last28 = p2;
+            break;
+
+            case   SAVED_TOTAL:
+                information->total = p2;
+            break;
+        }
+
+        if (b_is_cylinder_hot)
+            ESP_LOGI(TAG, "Water Tank HOT");
+        else if (boostTime > 0)
+            ESP_LOGI(TAG, "Manual Boost ON");
+        else if (b_is_water_heating_by_solar) {
+            ESP_LOGI(TAG, "Heating by Solar = %d Watts", heating);
+        }
+        else {
+            ESP_LOGI(TAG, "Water Heating OFF");
+        }
+
+        ESP_LOGI(TAG, "Today: %ld Wh   Yesterday: %ld Wh   Last 7 Days: %ld Wh   Last 28 Days: %ld Wh   Total: %ld Wh   Boost Time: %d",
+            information->today, information->yesterday, information->last7, information->last28, information->total, boostTime);
+
+        // Create JSON for sending via MQTT to MQTT server
+        // How much solar we have used today to heat the hot water
+        JsonDocument doc;
+        doc["savedToday"] = information->today;
+
+        // Water tank status
+        if (b_is_cylinder_hot) {
+            doc["hotWater"] =  "HOT";
+            send_event(events, SL_WT_STATUS, 0, IB_WT_HOT);
+        } else if (b_is_water_heating_by_solar) {
+            ESP_LOGI(TAG, "Heating by solar detected");
+            doc["hotWater"] =  "Heating by Solar";
+            send_event(events, SL_WT_NOW, heating, IB_WT_HEATING);      // equates to PV being used now
+        } else {
+            doc["hotWater"] =  "Off";
+            send_event(events, SL_WT_STATUS, 0, IB_WT_OFF);
+        }
+
+        // Status of the sender battery
+        if (b_is_battery_ok) {
+            information->b_sender_battery_ok = true;
+            ESP_LOGI(TAG, "Sender Battery OK");
+            doc["battery"] =  "OK";
+            send_event(events, SL_BATTERY, 0, IB_BATTERY_OK);
+        } else {
+            information->b_sender_battery_ok = false;
+            ESP_LOGI(TAG, "Warning - Sender Battery LOW");
+            doc["battery"] = "LOW";
+            send_event(events, SL_BATTERY, 0, IB_BATTERY_LOW);
+        }
+
+        if (events->sink->publish("iboost/iboost", doc, events->arrival_us)) {
+            result |= EVENTS_PUBLISHED;
+        } else {
+            ESP_LOGW(TAG, "Unable to publish iboost/iboost to MQTT");
+            events->sink->publish_failed();
+        }
+    }
+
+    return result;
+}
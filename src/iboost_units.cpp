@@ -0,0 +1,265 @@
+#include "iboost_units.h"
+#include "config.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "UNITS";
+
+static portMUX_TYPE units_mux = portMUX_INITIALIZER_UNLOCKED;      // Receive and transmit tasks both use the table
+
+
+/**
+ * @brief Start an entry for a unit.
+ *
+ * @param unit Entry
+ * @param address Unit address
+ * @param b_pinned From IBOOST_ADDRESSES
+ */
+static void init_unit(iboost_unit_t *unit, uint16_t address, bool b_pinned) {
+    memset(unit, 0, sizeof(iboost_unit_t));
+    unit->address = address;
+    unit->b_in_use = true;
+    unit->b_pinned = b_pinned;
+    unit->tank = IB_WT_OFF;
+    unit->b_battery_ok = true;
+    request_schedule_begin(&unit->requests);
+}
+
+
+/**
+ * @brief Find an entry, call with units_mux held.
+ *
+ * @param units Table
+ * @param address Unit address
+ * @return iboost_unit_t* entry, NULL if the unit isn't in the table
+ */
+static iboost_unit_t *find_unit(iboost_units_t *units, uint16_t address) {
+    for (uint8_t i = 0; i < UNIT_TABLE_SIZE; i++) {
+        if (units->units[i].b_in_use && units->units[i].address == address) {
+            return &units->units[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Set up the table, with the IBOOST_ADDRESSES units if configured.
+ *
+ * @param units Table to initialise
+ */
+void units_begin(iboost_units_t *units) {
+    memset(units, 0, sizeof(iboost_units_t));
+
+#ifdef IBOOST_ADDRESSES     // declared in config.h
+    static const uint16_t pinned[] = IBOOST_ADDRESSES;
+    for (uint8_t i = 0; i < sizeof(pinned) / sizeof(pinned[0]) && i < UNIT_TABLE_SIZE; i++) {
+        init_unit(&units->units[i], pinned[i], true);
+        ESP_LOGI(TAG, "Pinned unit %04x", pinned[i]);
+    }
+    units->primary = &units->units[0];
+    units->b_pinned = true;
+#endif
+}
+
+
+/**
+ * @brief Find a unit.
+ *
+ * @param units Table
+ * @param address Unit address
+ * @return iboost_unit_t* entry, NULL if the unit isn't tracked
+ */
+iboost_unit_t *units_find(iboost_units_t *units, uint16_t address) {
+    portENTER_CRITICAL(&units_mux);
+    iboost_unit_t *unit = find_unit(units, address);
+    portEXIT_CRITICAL(&units_mux);
+    return unit;
+}
+
+
+/**
+ * @brief Record a sender or buddy frame. A new unit takes a free entry or the one heard
+ * least recently (never the primary or a pinned unit), then the primary is chosen again.
+ *
+ * @param units Table
+ * @param address Unit address
+ * @param lqi Link quality of the frame
+ * @param rssi Signal strength of the frame (dBm)
+ * @param now_ms Arrival time
+ * @param b_primary_changed Set true if the primary unit changed (or was heard for the first time)
+ * @return iboost_unit_t* entry, NULL if the unit is ignored (not pinned)
+ */
+iboost_unit_t *units_observe(iboost_units_t *units, uint16_t address, uint8_t lqi, int16_t rssi, uint32_t now_ms, bool *b_primary_changed) {
+    *b_primary_changed = false;
+
+    portENTER_CRITICAL(&units_mux);
+    iboost_unit_t *unit = find_unit(units, address);
+    if (unit == NULL && !units->b_pinned) {
+        for (uint8_t i = 0; i < UNIT_TABLE_SIZE; i++) {
+            iboost_unit_t *entry = &units->units[i];
+            if (entry == units->primary) {
+                continue;
+            }
+            if (unit == NULL || !entry->b_in_use ||
+                (unit->b_in_use && now_ms - entry->last_seen_ms > now_ms - unit->last_seen_ms)) {
+                unit = entry;
+            }
+        }
+        if (unit != NULL) {
+            init_unit(unit, address, false);
+            unit->first_seen_ms = now_ms;
+        }
+    }
+
+    if (unit != NULL) {
+        if (unit->frames == 0) {
+            unit->lqi = lqi;
+            if (unit == units->primary) {
+                *b_primary_changed = true;      // pinned primary heard for the first time
+            }
+        } else {
+            unit->lqi += (lqi - unit->lqi) / UNIT_LQI_FILTER;
+        }
+        unit->frames++;
+        unit->rssi = rssi;
+        unit->last_seen_ms = now_ms;
+
+        if (!units->b_pinned) {
+            iboost_unit_t *best = NULL;
+            for (uint8_t i = 0; i < UNIT_TABLE_SIZE; i++) {
+                iboost_unit_t *entry = &units->units[i];
+                if (entry->b_in_use && entry->frames >= UNIT_MIN_FRAMES && now_ms - entry->last_seen_ms < UNIT_TIMEOUT &&
+                    (best == NULL || entry->lqi < best->lqi)) {
+                    best = entry;
+                }
+            }
+            iboost_unit_t *primary = units->primary;
+            if (best != NULL && best != primary && (primary == NULL || now_ms - primary->last_seen_ms >= UNIT_TIMEOUT ||
+                best->lqi < primary->lqi - UNIT_LQI_HYSTERESIS)) {
+                units->primary = best;
+                *b_primary_changed = true;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&units_mux);
+
+    if (*b_primary_changed) {
+        ESP_LOGI(TAG, "Primary unit %04x (LQI %.1f), %d units in range", units->primary->address, units->primary->lqi,
+            units_in_range(units, now_ms));
+    }
+    return unit;
+}
+
+
+/**
+ * @brief Record a main unit frame.
+ *
+ * @param unit Unit that sent it
+ * @param code Request code the frame answers (SAVED_*)
+ * @param value Counter value for the request (Wh)
+ * @param heating Solar power going to the tank (W)
+ * @param tank Water tank state
+ * @param b_battery_ok Sender battery state
+ * @param now_ms Arrival time
+ */
+void units_main_unit_frame(iboost_unit_t *unit, uint8_t code, long value, short heating, ib_info_t tank, bool b_battery_ok, uint32_t now_ms) {
+    portENTER_CRITICAL(&units_mux);
+    switch (code) {
+        case SAVED_TODAY:
+            unit->today = value;
+            break;
+        case SAVED_YESTERDAY:
+            unit->yesterday = value;
+            break;
+        case SAVED_LAST_7:
+            unit->last7 = value;
+            break;
+        case SAVED_LAST_28:
+            unit->last28 = value;
+            break;
+        case SAVED_TOTAL:
+            unit->total = value;
+            break;
+    }
+    unit->heating = heating;
+    unit->tank = tank;
+    unit->b_battery_ok = b_battery_ok;
+    unit->main_unit_frames++;
+    unit->last_seen_ms = now_ms;
+    portEXIT_CRITICAL(&units_mux);
+
+    // Outside units_mux, the schedule has its own lock and may log
+    request_schedule_answered(&unit->requests, code, value, now_ms);
+}
+
+
+/**
+ * @brief Choose the next unit to ask and what to ask it for. Pinned units that have been
+ * heard take turns, otherwise only the primary is asked.
+ *
+ * @param units Table
+ * @param now_ms Time now
+ * @param address Set to the unit address
+ * @param request Set to the request code (SAVED_*)
+ * @return true if there is a unit to ask
+ */
+bool units_next_request(iboost_units_t *units, uint32_t now_ms, uint16_t *address, uint8_t *request) {
+    iboost_unit_t *unit = NULL;
+
+    portENTER_CRITICAL(&units_mux);
+    if (units->b_pinned) {
+        for (uint8_t i = 0; i < UNIT_TABLE_SIZE && unit == NULL; i++) {
+            iboost_unit_t *entry = &units->units[(units->next_request + i) % UNIT_TABLE_SIZE];
+            if (entry->b_in_use && entry->frames > 0) {
+                unit = entry;
+                units->next_request = (units->next_request + i + 1) % UNIT_TABLE_SIZE;
+            }
+        }
+    } else if (units->primary != NULL) {
+        unit = units->primary;
+    }
+    portEXIT_CRITICAL(&units_mux);
+
+    if (unit == NULL) {
+        return false;
+    }
+    *address = unit->address;
+    *request = request_schedule_next(&unit->requests, now_ms);
+    return true;
+}
+
+
+/**
+ * @brief Record a request that has been sent.
+ *
+ * @param units Table
+ * @param address Unit asked
+ * @param request Request code sent
+ * @param now_ms Time the request went out
+ */
+void units_request_sent(iboost_units_t *units, uint16_t address, uint8_t request, uint32_t now_ms) {
+    iboost_unit_t *unit = units_find(units, address);
+    if (unit != NULL) {
+        request_schedule_sent(&unit->requests, request, now_ms);
+    }
+}
+
+
+/**
+ * @brief Number of units heard recently.
+ *
+ * @param units Table
+ * @param now_ms Time now
+ * @return uint8_t units in range
+ */
+uint8_t units_in_range(iboost_units_t *units, uint32_t now_ms) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < UNIT_TABLE_SIZE; i++) {
+        const iboost_unit_t *unit = &units->units[i];
+        if (unit->b_in_use && unit->frames > 0 && now_ms - unit->last_seen_ms < UNIT_TIMEOUT) {
+            count++;
+        }
+    }
+    return count;
+}
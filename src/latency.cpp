@@ -0,0 +1,82 @@
+#include "latency.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static latency_histogram_t histograms[LATENCY_PATHS][LATENCY_KINDS];
+static portMUX_TYPE latency_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// For the MQTT topics, indexed by latency_topic_t and sl_event_t
+static const char *topic_names[LATENCY_TOPICS] = {"iboost", "grid", "unit"};
+static const char *event_names[LATENCY_KINDS] = {"export", "import", "pvNow", "pvToday", "wtNow", "wtToday",
+    "battery", "wtStatus", "lqi"};
+
+
+/**
+ * @brief Add the time since a frame arrived to a histogram.
+ *
+ * @param path MQTT or display
+ * @param kind latency_topic_t for MQTT, sl_event_t for the display
+ * @param arrival_us GDO0 interrupt time of the frame (esp_timer_get_time()), 0 if not from a frame
+ */
+void latency_record(latency_path_t path, uint8_t kind, int64_t arrival_us) {
+    if (arrival_us == 0 || kind >= latency_kinds(path)) {
+        return;         // from MQTT or found by the backstop poll, nothing to measure against
+    }
+
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - arrival_us);
+    uint8_t bucket = 0;
+    if (latency_us >> LATENCY_FIRST_SHIFT) {
+        bucket = 32 - __builtin_clz(latency_us) - LATENCY_FIRST_SHIFT;
+        if (bucket >= LATENCY_BUCKETS) {
+            bucket = LATENCY_BUCKETS - 1;
+        }
+    }
+
+    portENTER_CRITICAL(&latency_mux);
+    latency_histogram_t *histogram = &histograms[path][kind];
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->last_us = latency_us;
+    histogram->total_us += latency_us;
+    if (latency_us > histogram->max_us) {
+        histogram->max_us = latency_us;
+    }
+    portEXIT_CRITICAL(&latency_mux);
+}
+
+
+/**
+ * @brief Take a consistent copy of a histogram.
+ *
+ * @param path MQTT or display
+ * @param kind latency_topic_t for MQTT, sl_event_t for the display
+ * @param copy Set to the histogram
+ */
+void latency_snapshot(latency_path_t path, uint8_t kind, latency_histogram_t *copy) {
+    portENTER_CRITICAL(&latency_mux);
+    *copy = histograms[path][kind];
+    portEXIT_CRITICAL(&latency_mux);
+}
+
+
+/**
+ * @brief Number of kinds on a path.
+ *
+ * @param path MQTT or display
+ * @return uint8_t LATENCY_TOPICS or the number of sl_event_t
+ */
+uint8_t latency_kinds(latency_path_t path) {
+    return path == LATENCY_MQTT ? LATENCY_TOPICS : LATENCY_KINDS;
+}
+
+
+/**
+ * @brief Name of a kind for MQTT topics and logging.
+ *
+ * @param path MQTT or display
+ * @param kind latency_topic_t for MQTT, sl_event_t for the display
+ * @return const char* name
+ */
+const char *latency_kind_name(latency_path_t path, uint8_t kind) {
+    return path == LATENCY_MQTT ? topic_names[kind] : event_names[kind];
+}
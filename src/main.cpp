@@ -7,15 +7,53 @@
 #include "my_ringbuf.h"
 #include "config.h"
 #include "CC1101_RFx.h"
+#include "radio_config.h"
+#include "afc.h"
+#include "tx_schedule.h"
+#include "request_schedule.h"
+#include "iboost_units.h"
+#include "radio_stats.h"
+#include "radio_health.h"
+#include "radio_survey.h"
+#include "frame_pool.h"
+#include "iboost_codec.h"
+#include "iboost_events.h"
+#include "trace.h"
+#include "latency.h"
+#ifdef RADIO_WOR
+#include "radio_wor.h"
+#endif
+#include "esp_timer.h"
 
 // Defines
 #define PING_IBOOST_UNIT 10000      // PING_IBOOST_UNIT iBoost main unit for data every 10 seconds
+#define RX_BACKSTOP_POLL 5000       // Poll the radio if no GDO0 interrupt has been seen for this long (ms)
+#define RX_BATCH_SIZE 4             // Most packets getPackets() drains per GDO0 interrupt, see frame_pool.h
+#define AFC_REPORT_INTERVAL 60000   // Publish the frequency correction and packet yield this often (ms)
+#define STATS_REPORT_INTERVAL 300000 // Publish the radio link statistics this often (ms)
+#define SLOT_REPORT_INTERVAL 300000 // Publish the answer rate of each transmit slot this often (ms)
+#define REQUEST_REPORT_INTERVAL 60000 // Publish the age of each saved counter this often (ms)
+#define RADIO_QUEUE_SIZE 4          // Commands waiting for the radio task
+#define RADIO_REPLY_TIMEOUT 1000    // Longest wait for the radio task to carry out a command (ms)
+#define TX_TIMEOUT 20               // Longest wait for the end of our own packet (ms), a request is ~4ms on air
+#define FSCAL_INTERVAL 900000       // RADIO_CACHED_CAL, calibrate the frequency synthesiser again after this long (ms)
+#define FSCAL_TEMP_DELTA 5.0        // or once the temperature has moved this much (C)
+#define FSCAL_CHECK_INTERVAL 10000  // Look at the temperature this often (ms)
+
+// Radio task notification bits
+#define RADIO_NOTIFY_GDO0 0x01      // End of packet interrupt
+#define RADIO_NOTIFY_COMMAND 0x02   // Something in radio_queue
+#define RADIO_NOTIFY_TX_DONE 0x04   // End of our own packet
+
+// Reply notification from the radio task: the command's sequence number above its result
+#define RADIO_REPLY_RESULT 0xff
+#define RADIO_REPLY_SHIFT 8
+#define RADIO_REPLY_SEQUENCE (0xffffffff >> RADIO_REPLY_SHIFT)
 
 // ESP32 Wroom 32: SCK_PIN = 18; MISO_PIN = 19; MOSI_PIN = 23; SS_PIN = 5; GDO0 = 2;
 #define SS_PIN 5
 #define MISO_PIN 19
-
-#define MAGIC_NUMBER 380 // value used to convert iBoost value to watts
+#define GDO0_PIN 2
 
 CC1101 radio(SS_PIN,  MISO_PIN);
 
@@ -24,7 +62,8 @@ CC1101 radio(SS_PIN,  MISO_PIN);
 TaskHandle_t ws2812b_task_handle = NULL;
 
 TaskHandle_t mqqt_keep_alive_task_handle = NULL;
-TaskHandle_t receive_packet_task_handle = NULL;
+TaskHandle_t radio_task_handle = NULL;
+TaskHandle_t decode_packet_task_handle = NULL;
 TaskHandle_t transmit_packet_task_handle = NULL;
 
 TaskHandle_t display_task_handle = NULL;
@@ -32,11 +71,11 @@ TaskHandle_t display_task_handle = NULL;
 // QueueHandle_t inbuilt_led_queue;
 QueueHandle_t ws2812b_queue;
 QueueHandle_t g_main_queue;
+QueueHandle_t radio_queue;
 
 int queue_size = 10;
 
 SemaphoreHandle_t keep_alive_mqtt_semaphore;
-SemaphoreHandle_t radio_semaphore;
 
 RingbufHandle_t buf_handle;
 
@@ -48,15 +87,6 @@ RingbufHandle_t buf_handle;
 // Set up library to control LEDs
 Adafruit_NeoPixel ws2812b(NUM_PIXELS, PIN_WS2812B, NEO_GRB + NEO_KHZ800);
 
-// codes for the various requests and responses
-enum { 
-    SAVED_TODAY = 0xCA,
-    SAVED_YESTERDAY = 0xCB,
-    SAVED_LAST_7 = 0xCC,
-    SAVED_LAST_28 = 0xCD,
-    SAVED_TOTAL = 0xCE
-};
-
 // LEDs that get lit depending on message we want to convey
 enum led_measage_t{ 
     TX_FAKE_BUDDY_REQUEST,
@@ -68,17 +98,42 @@ enum led_measage_t{
     BLANK
 };
 
-typedef struct  {
-    long today;
-    long yesterday;
-    long last7;
-    long last28;
-    long total;
-    uint8_t address[2];
-    uint8_t lqi;
-    bool b_is_address_valid;
-    bool b_sender_battery_ok;
-} iboost_information_t;
+// What the radio task can be asked to do, see radio_command()
+typedef enum {
+    RADIO_CMD_LISTEN,           // Back to RX, e.g. once setup has finished
+    RADIO_CMD_TRANSMIT,         // Send a request to a main unit, then back to RX
+    RADIO_CMD_RETUNE,           // Move to another frequency (Hz)
+    RADIO_CMD_REINIT,           // Reset and upload the configuration again, see radio_setup()
+    RADIO_CMD_STATS,            // Copy the driver's counters
+    RADIO_CMD_SURVEY            // Step the carrier and keep the best, see radio_survey.h
+} radio_command_type_t;
+
+typedef struct {
+    cc1101_rx_stats_t rx;
+    cc1101_spi_stats_t spi;
+    cc1101_wait_stats_t wait;
+    cc1101_cal_stats_t cal;
+    cc1101_error_t last_error;          // Last driver timeout, see radio_check()
+    radio_health_t health;
+    radio_survey_t survey;
+#ifdef RADIO_WOR
+    radio_wor_t wor;
+#endif
+} radio_snapshot_t;
+
+typedef struct {
+    radio_command_type_t type;
+    TaskHandle_t reply_to;              // Notified with the result when done, NULL for no reply
+    uint32_t sequence;                  // Set by radio_command(), returned with the reply
+    struct {
+        uint8_t data[IBOOST_BUDDY_SIZE];    // Payload from iboost_encode_request()
+        uint8_t size;
+        uint8_t slot;                   // For tx_schedule_sent()
+        uint16_t address;
+        uint8_t request;
+    } transmit;                         // RADIO_CMD_TRANSMIT
+    uint32_t frequency;                 // RADIO_CMD_RETUNE, Hz
+} radio_command_t;
 
 // LED colours
 typedef struct {
@@ -100,23 +155,82 @@ colours_t pixel_colours;
 char weather_description[35];    // buffer for the current weather description from OpenWeatherMap
 static portMUX_TYPE myMux = portMUX_INITIALIZER_UNLOCKED;
 
-iboost_information_t volatile iboost_information = {.today = 0, .yesterday = 0, .last7 = 0, .last28 = 0, .total = 0,
-                                            .lqi = 255, .b_is_address_valid = false, .b_sender_battery_ok = false};
+static volatile int64_t rx_arrival_us = 0;     // Time of the last GDO0 end of packet interrupt
+static portMUX_TYPE radio_command_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t radio_sequence = 0;             // Last command handed to the radio task
+// Filled in by RADIO_CMD_STATS. Not on the caller's stack, as the radio task may still
+// write it after the caller has given up waiting, see radio_snapshot_take().
+static radio_snapshot_t radio_snapshot;
+static portMUX_TYPE radio_snapshot_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool b_tx_active = false;       // From STX until the end of packet, GDO0 is then ours
+static volatile int64_t tx_end_us = 0;          // Time of the GDO0 interrupt ending our transmission
+static cc1101_error_t radio_last_error = CC1101_OK;     // Radio task only, see radio_check()
+static uint32_t radio_frequency = 0;            // Carrier in use (Hz), radio task only once set up
+static volatile uint32_t surveys_done = 0;      // Finished surveys, for decode_packet_task to publish
+static volatile bool b_surveying = false;       // radio_survey.b_active for the other tasks
+#ifdef RADIO_CACHED_CAL
+static uint32_t fscal_ms = 0;                   // Radio task only, see radio_calibration()
+static uint32_t fscal_check_ms = 0;
+static float fscal_temperature = 0;
+#endif
+afc_state_t afc;                                // Frequency correction, see afc.h
+tx_schedule_t tx_schedule;                      // When to send our requests, see tx_schedule.h
+iboost_units_t iboost_units;                    // iBoost installations in range, see iboost_units.h
+iboost_events_t iboost_events;                  // Frames to display events and MQTT, see iboost_events.h
+radio_health_t radio_health;                    // Radio task only, see radio_health.h
+radio_survey_t radio_survey;                    // Carrier survey, radio task only, see radio_survey.h
+#ifdef RADIO_WOR
+radio_wor_t radio_wor;                          // Receiver duty cycling, radio task only, see radio_wor.h
+#endif
 
 /* Function prototypes */
 // void blink_led_task(void *parameter);
 void mqtt_keep_alive_task(void *parameter);
-void receive_packet_task(void *parameter);
+void radio_task(void *parameter);
+void decode_packet_task(void *parameter);
 void transmit_packet_task(void *parameter);
 void ws2812b_task(void *parameter);
 ///////
-void radio_setup();
+void IRAM_ATTR gdo0_isr(void);
+static void decode_frame(const rx_buffer_t *buffer);
+bool radio_setup();
+static bool radio_command(radio_command_t *command, bool b_wait, uint32_t *result);
+static bool radio_snapshot_take(radio_snapshot_t *copy);
+static uint32_t radio_execute(const radio_command_t *command);
+static uint32_t radio_receive(bool b_notified);
+static void radio_check(void);
+static void radio_tune(uint32_t frequency);
+static void radio_survey_check(void);
+#ifdef RADIO_CACHED_CAL
+static void radio_calibration(void);
+#endif
+static tx_result_t radio_transmit(const radio_command_t *command);
+static bool publish_json(const char *topic, JsonDocument &doc);
+static void publish_afc_metrics(void);
+static void publish_tx_schedule(void);
+static void publish_request_schedule(void);
+static void display_event(const electricity_event_t *event);
+static bool publish_frame_json(const char *topic, JsonDocument &doc, int64_t arrival_us);
+static void primary_changed(uint16_t address);
+static void publish_failed(void);
+static void publish_radio_stats(void);
+static void publish_latency(void);
+static void publish_survey(void);
+#ifdef RADIO_WOR
+static void publish_wor_metrics(void);
+#endif
+#ifdef RADIO_BENCHMARK
+static void radio_benchmark(void);
+#endif
 void connect_to_wifi(void);
 void connect_to_mqtt(void);
 char * wifi_connection_status_message(wl_status_t wifi_status);
 static void mqtt_callback(char* topic, byte* message, unsigned int length);
 static void ntpTime(void);
 
+// Where iboost_events_frame() sends what it finds
+static const iboost_events_sink_t events_sink = {display_event, publish_frame_json, primary_changed, publish_failed};
+
 /**
  * @brief Set up everything. SPI, WiFi, MQTT, and CC1101 tasks, queues etc.
  * 
@@ -194,8 +308,19 @@ void setup() {
     keep_alive_mqtt_semaphore = xSemaphoreCreateBinary();
     xSemaphoreGive(keep_alive_mqtt_semaphore);            // Stop keep alive when publishing
 
-    radio_semaphore = xSemaphoreCreateBinary();
-    xSemaphoreGive(radio_semaphore);
+    // Commands for the radio task, the only one to touch the CC1101 once it is running
+    radio_queue = xQueueCreate(RADIO_QUEUE_SIZE, sizeof(radio_command_t));
+    if (radio_queue == NULL) {
+        ESP_LOGE(TAG, "Error creating radio_queue");
+        strcpy(tx_item, "Error creating radio_queue");
+        res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
+        memset(tx_item, '\0', sizeof(tx_item));
+        if (res != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to send Ringbuffer item");
+        }
+
+        b_setup_successful = false;
+    }
 
     SPI.begin();
     ESP_LOGI(TAG, "SPI OK");
@@ -206,8 +331,25 @@ void setup() {
         ESP_LOGE(TAG, "Failed to send Ringbuffer item");
     }
 
-    // Set up the radio
-    radio_setup();
+    // Set up the radio, starting from the carrier and frequency correction learnt last time
+    afc_begin(&afc);
+    radio_survey_begin(&radio_survey);
+    tx_schedule_begin(&tx_schedule, PING_IBOOST_UNIT);
+    units_begin(&iboost_units);
+    iboost_events_begin(&iboost_events, &iboost_units, &events_sink);
+    if (iboost_units.primary != NULL) {
+        tx_schedule_set_address(&tx_schedule, iboost_units.primary->address);     // pinned in config.h
+    }
+    if (!radio_setup()) {
+        b_setup_successful = false;
+    }
+#ifdef RADIO_BENCHMARK  // declared in platformio.ini build_flags
+    radio_benchmark();
+#endif
+#ifdef RADIO_WOR        // declared in platformio.ini build_flags
+    radio_wor_begin(&radio_wor, millis());
+#endif
+    radio_health_begin(&radio_health, millis());
     
     /* LED setup - so we can use the module without serial terminal,
        set low to start so it's off and flashes when it receives a packet */
@@ -250,10 +392,22 @@ void setup() {
 
     delay(500);
 
-    x_returned = xTaskCreatePinnedToCore(receive_packet_task, "receive_packet_task", 4096, NULL, 3, &receive_packet_task_handle, 1);
+    // Frames go from the radio task to the decode task through the pool, see frame_pool.h
+    if (!frame_pool_begin()) {
+        strcpy(tx_item, "Error creating frame pool");
+        res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
+        memset(tx_item, '\0', sizeof(tx_item));
+        if (res != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to send Ringbuffer item");
+        }
+        b_setup_successful = false;
+    }
+
+    // Below the radio task so a slow MQTT publish never holds up draining the radio
+    x_returned = xTaskCreatePinnedToCore(decode_packet_task, "decode_packet_task", 8192, NULL, 2, &decode_packet_task_handle, 1);
     if (x_returned != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create receive_packet_task");
-        strcpy(tx_item, "Error creating receivePackeTask");
+        ESP_LOGE(TAG, "Failed to create decode_packet_task");
+        strcpy(tx_item, "Error creating decode_packet_task");
         res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
         if (res != pdTRUE) {
             ESP_LOGE(TAG, "Failed to send Ringbuffer item");
@@ -261,9 +415,25 @@ void setup() {
         b_setup_successful = false;
     }
 
+    x_returned = xTaskCreatePinnedToCore(radio_task, "radio_task", 4096, NULL, 3, &radio_task_handle, 1);
+    if (x_returned != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create radio_task");
+        strcpy(tx_item, "Error creating radio_task");
+        res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
+        if (res != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to send Ringbuffer item");
+        }
+        b_setup_successful = false;
+    } else {
+        // GDO0 wakes the radio task at the end of each packet, see radio_setup() for IOCFG0
+        pinMode(GDO0_PIN, INPUT);
+        attachInterrupt(digitalPinToInterrupt(GDO0_PIN), gdo0_isr, RISING);
+    }
+
     delay(500);
 
-    x_returned = xTaskCreatePinnedToCore(transmit_packet_task, "transmit_packet_task", 4096, NULL, 3, &transmit_packet_task_handle, 1);
+    // Only decides when to ask for what, the radio task does the sending
+    x_returned = xTaskCreatePinnedToCore(transmit_packet_task, "transmit_packet_task", 4096, NULL, 2, &transmit_packet_task_handle, 1);
     if (x_returned != pdPASS) {
         ESP_LOGE(TAG, "Failed to create transmit_packet_task");
         strcpy(tx_item, "Error creating transmit_packet_task");
@@ -291,7 +461,14 @@ void setup() {
         ws2812b.clear();
         ws2812b.show();
 
-        radio.setRXstate();             // Set the current state to RX : listening for RF packets
+        radio_command_t listen = {};
+        listen.type = RADIO_CMD_LISTEN;
+        radio_command(&listen, false, NULL);      // Set the current state to RX : listening for RF packets
+        if (!radio_survey.b_surveyed) {
+            radio_command_t survey = {};
+            survey.type = RADIO_CMD_SURVEY;         // First boot, find the carrier
+            radio_command(&survey, false, NULL);
+        }
     } else {
         ESP_LOGE(TAG, "Setup Failed!!!");
         strcpy(tx_item, "Setup Failed!!!");
@@ -309,6 +486,13 @@ void setup() {
 void loop(void) {
 
     // All happens in tasks
+#ifdef TRACE    // declared in platformio.ini build_flags
+    // Except dumping the trace, send 't' from the serial monitor
+    if (Serial.available() && Serial.read() == 't') {
+        trace_dump();
+    }
+    delay(100);
+#endif
 
 }
 
@@ -454,394 +638,1137 @@ void mqtt_keep_alive_task(void *parameter) {
 
 
 /**
- * @brief Handle the receipt of a packet from the CC1101
+ * @brief The only task that touches the CC1101 once setup has finished. Woken by the GDO0
+ * end of packet interrupt to drain the FIFO into the frame pool (see frame_pool.h), and by
+ * commands from the other tasks (see radio_command()), which are carried out in between
+ * drains. Receiving and transmitting never overlap, so nothing needs to hold the radio.
+ *
+ */
+void radio_task(void *parameter) {
+    uint32_t next_poll_ms = millis() + RX_BACKSTOP_POLL;
+    radio_command_t command;
+
+    //ESP_LOGI(TAG, "Executing on core: %d", xPortGetCoreID());
+
+    for( ;; ) {
+        // Block until GDO0 reports a complete packet or a command arrives, the timeout is
+        // only a backstop in case an edge is missed (e.g. the FIFO overflowed)
+        uint32_t bits = 0;
+        int32_t wait_ms = (int32_t)(next_poll_ms - millis());
+        xTaskNotifyWait(0, 0xffffffff, &bits, wait_ms > 0 ? wait_ms / portTICK_PERIOD_MS : 0);
+
+        // Frames first, a transmission would leave them waiting in the FIFO
+        if ((bits & RADIO_NOTIFY_GDO0) || (int32_t)(millis() - next_poll_ms) >= 0) {
+            next_poll_ms = millis() + radio_receive(bits & RADIO_NOTIFY_GDO0);
+        }
+
+        // Every queued command, not just one per notification
+        while (xQueueReceive(radio_queue, &command, 0) == pdTRUE) {
+            uint32_t result = radio_execute(&command);
+            if (command.reply_to != NULL) {
+                xTaskNotify(command.reply_to, (command.sequence << RADIO_REPLY_SHIFT) | (result & RADIO_REPLY_RESULT),
+                    eSetValueWithOverwrite);
+            }
+        }
+
+        radio_check();
+        radio_survey_check();
+#ifdef RADIO_CACHED_CAL  // declared in platformio.ini build_flags
+        radio_calibration();
+#endif
+    }
+    vTaskDelete (NULL);
+}
+
+
+/**
+ * @brief Hand a command to the radio task.
+ *
+ * @param command What to do, copied into radio_queue, reply_to and sequence are filled in here
+ * @param b_wait Block until the radio task has carried it out (up to RADIO_REPLY_TIMEOUT)
+ * @param result Set to the command's result when waiting, may be NULL
+ * @return true if queued, and when waiting, carried out
+ */
+static bool radio_command(radio_command_t *command, bool b_wait, uint32_t *result) {
+    uint32_t value = 0;
+
+    command->reply_to = b_wait ? xTaskGetCurrentTaskHandle() : NULL;
+    portENTER_CRITICAL(&radio_command_mux);
+    command->sequence = ++radio_sequence & RADIO_REPLY_SEQUENCE;
+    portEXIT_CRITICAL(&radio_command_mux);
+    if (radio_queue == NULL || xQueueSend(radio_queue, command, 0) != pdTRUE) {
+        return false;
+    }
+    if (radio_task_handle != NULL) {
+        xTaskNotify(radio_task_handle, RADIO_NOTIFY_COMMAND, eSetBits);
+    }
+    if (!b_wait) {
+        return true;
+    }
+
+    // A reply to an earlier command that was given up on can still arrive, skip it
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = RADIO_REPLY_TIMEOUT / portTICK_PERIOD_MS;
+    for (;;) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (waited >= timeout || xTaskNotifyWait(0, 0xffffffff, &value, timeout - waited) != pdTRUE) {
+            ESP_LOGW(TAG, "Radio task did not answer command %d", command->type);
+            return false;
+        }
+        if ((value >> RADIO_REPLY_SHIFT) == command->sequence) {
+            break;
+        }
+        ESP_LOGD(TAG, "Late reply to command %" PRIu32 " dropped", value >> RADIO_REPLY_SHIFT);
+    }
+    if (result != NULL) {
+        *result = value & RADIO_REPLY_RESULT;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Have the radio task copy the driver's counters and take a copy of them.
+ *
+ * @param copy Set to the counters
+ * @return true if the radio task answered
+ */
+static bool radio_snapshot_take(radio_snapshot_t *copy) {
+    radio_command_t command = {};
+
+    command.type = RADIO_CMD_STATS;
+    if (!radio_command(&command, true, NULL)) {
+        return false;
+    }
+    portENTER_CRITICAL(&radio_snapshot_mux);
+    *copy = radio_snapshot;
+    portEXIT_CRITICAL(&radio_snapshot_mux);
+    return true;
+}
+
+
+/**
+ * @brief Carry out a command, radio task only.
+ *
+ * @param command What to do
+ * @return uint32_t Result for the caller, a tx_result_t for RADIO_CMD_TRANSMIT, otherwise
+ * 1 if done (0 for RADIO_CMD_REINIT if the configuration did not read back)
+ */
+static uint32_t radio_execute(const radio_command_t *command) {
+    uint32_t result = 1;
+
+    TRACE_BEGIN(TRACE_RADIO_COMMAND, command->type);
+    switch (command->type) {
+        case RADIO_CMD_LISTEN:
+            radio.setRXstate();
+        break;
+        case RADIO_CMD_TRANSMIT:
+            result = radio_transmit(command);
+        break;
+        case RADIO_CMD_RETUNE:
+            if (radio_survey.b_active) {
+                ESP_LOGW(TAG, "Survey in progress, not retuning");      // queued before it started
+                result = 0;
+                break;
+            }
+            radio_tune(command->frequency);
+            ESP_LOGI(TAG, "Radio retuned to %" PRIu32 " Hz", command->frequency);
+        break;
+        case RADIO_CMD_REINIT:
+            if (radio_survey.b_active) {
+                ESP_LOGW(TAG, "Survey in progress, not resetting the radio");
+                result = 0;
+                break;
+            }
+            radio.error = CC1101_OK;
+            result = radio_setup();
+            radio.setRXstate();
+#ifdef RADIO_WOR
+            radio_wor_listening(&radio_wor, millis());
+#endif
+        break;
+        case RADIO_CMD_STATS:
+            portENTER_CRITICAL(&radio_snapshot_mux);
+            radio_snapshot.rx = radio.rxStats;
+            radio_snapshot.spi = radio.spiStats;
+            radio_snapshot.wait = radio.waitStats;
+            radio_snapshot.cal = radio.calStats;
+            radio_snapshot.last_error = radio_last_error;
+            radio_snapshot.health = radio_health;
+            radio_snapshot.survey = radio_survey;
+#ifdef RADIO_WOR
+            radio_snapshot.wor = radio_wor;
+#endif
+            portEXIT_CRITICAL(&radio_snapshot_mux);
+        break;
+        case RADIO_CMD_SURVEY:
+            if (!radio_survey.b_active) {
+                uint32_t frequency = radio_survey_start(&radio_survey, radio_frequency, millis());
+                b_surveying = true;
+                radio.setIDLEstate();
+                radio.writeRegister(CC1101_FSCTRL0, 0);     // steps are absolute, the AFC waits
+                radio_tune(frequency);
+            }
+        break;
+    }
+    TRACE_END(TRACE_RADIO_COMMAND, result);
+
+    return result;
+}
+
+
+/**
+ * @brief Every HEALTH_CHECK_INTERVAL ask the supervisor (see radio_health.h) whether the
+ * CC1101 is still receiving and carry out what it decides: restart the receiver, or
+ * reset the chip and upload the configuration again. Radio task only, nothing else
+ * waits while it happens.
+ *
+ */
+static void radio_check(void) {
+    uint32_t now_ms = millis();
+    uint8_t state = HEALTH_STATE_UNKNOWN;
+
+    if (!radio_health_due(&radio_health, now_ms)) {
+        return;
+    }
+    if (radio_survey.b_active && radio.error == CC1101_OK) {
+        return;                         // silence on the survey's outer steps is expected
+    }
+    bool b_read_state = radio.error == CC1101_OK;       // a wedged chip would only time out again
+#ifdef RADIO_WOR
+    b_read_state = b_read_state && radio_wor.state == WOR_STATE_RX;     // SPI would wake it
+#endif
+    if (b_read_state) {
+        state = radio.getState();
+    }
+    if (radio.error != CC1101_OK) {
+        radio_last_error = radio.error;
+    }
+
+    health_action_t action = radio_health_check(&radio_health, state, radio.error != CC1101_OK, now_ms);
+    if (action == HEALTH_ACTION_NONE) {
+        return;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    if (action == HEALTH_ACTION_RESTART_RX) {
+        ESP_LOGW(TAG, "Radio check failed (%s, state %d), restarting the receiver",
+            radio_health_cause_name(radio_health.last_cause), state);
+        radio.setIDLEstate();
+        radio.strobe(CC1101_SFRX);
+        radio.setRXstate();
+    } else {
+        ESP_LOGE(TAG, "Radio check failed (%s, state %d, driver %s), resetting the CC1101",
+            radio_health_cause_name(radio_health.last_cause), state,
+            radio.error == CC1101_ERROR_MISO ? "MISO high" : radio.error == CC1101_ERROR_STATE ? "state timeout" : "ok");
+        radio.error = CC1101_OK;
+        radio_setup();                  // logs the outcome
+        radio.setRXstate();
+    }
+#ifdef RADIO_WOR
+    radio_wor_listening(&radio_wor, millis());     // either way it is in RX now, not asleep
+#endif
+    radio_health_action_done(&radio_health, action, (uint32_t)(esp_timer_get_time() - start_us));
+    ESP_LOGI(TAG, "Radio %s in %" PRIu32 " us", action == HEALTH_ACTION_RESTART_RX ? "restarted" : "reset",
+        radio_health.last_action_us);
+}
+
+
+/**
+ * @brief Move the carrier, radio task only. Kept over a reset, see radio_setup().
+ *
+ * @param frequency Carrier (Hz)
+ */
+static void radio_tune(uint32_t frequency) {
+    radio.setFrequency(frequency);      // leaves it idle
+    radio.setRXstate();
+    radio_frequency = frequency;
+}
+
+
+/**
+ * @brief Move a survey on to its next step once the dwell time is up, and when it is
+ * over tune to the carrier it picked with the AFC starting again from there (or back
+ * to the correction it had if nothing was heard). Radio task only.
+ *
+ */
+static void radio_survey_check(void) {
+    uint32_t frequency;
+
+    if (!radio_survey_update(&radio_survey, millis(), &frequency)) {
+        return;
+    }
+    if (!radio_survey.b_active) {
+        if (radio_survey.best >= 0) {
+            afc_restart(&afc);
+        }
+        radio.setIDLEstate();
+        afc_apply(radio, &afc);
+        b_surveying = false;
+        surveys_done++;
+    }
+    radio_tune(frequency);
+}
+
+
+#ifdef RADIO_CACHED_CAL
+/**
+ * @brief Calibrate the frequency synthesiser again once the cached calibration (see
+ * CC1101::manualCal) is FSCAL_INTERVAL old or the temperature has moved FSCAL_TEMP_DELTA
+ * since, radio task only. The CC1101's own temperature sensor is only available as an
+ * analogue output on GDO0, so the ESP32's, on the same board, stands in for it.
+ *
+ */
+static void radio_calibration(void) {
+    uint32_t now_ms = millis();
+
+    if (!radio.manualCal || now_ms - fscal_check_ms < FSCAL_CHECK_INTERVAL) {
+        return;                         // radio_setup() turns it on again after a reset
+    }
+#ifdef RADIO_WOR
+    if (radio_wor.state != WOR_STATE_RX) {
+        return;                         // SPI would wake it, the calibration is kept while asleep
+    }
+#endif
+    fscal_check_ms = now_ms;
+    float temperature = temperatureRead();
+    if (now_ms - fscal_ms < FSCAL_INTERVAL && fabsf(temperature - fscal_temperature) < FSCAL_TEMP_DELTA) {
+        return;
+    }
+
+    radio.calibrate();
+    radio.setRXstate();
+    ESP_LOGI(TAG, "Frequency synthesiser calibrated in %" PRIu32 " us at %.1fC (was %.1fC %" PRIu32 " s ago)",
+        radio.calStats.lastUs, temperature, fscal_temperature, (now_ms - fscal_ms) / 1000);
+    fscal_ms = now_ms;
+    fscal_temperature = temperature;
+}
+#endif
+
+
+/**
+ * @brief Drain the CC1101 into the frame pool and pass the frames to decode_packet_task,
+ * radio task only.
+ *
+ * @param b_notified Woken by GDO0 rather than the backstop poll
+ * @return uint32_t How long until the radio should be polled again (ms)
+ */
+static uint32_t radio_receive(bool b_notified) {
+    uint8_t indices[RX_BATCH_SIZE];         // Pool buffers for one drain
+    cc1101_frame_t *slots[RX_BATCH_SIZE];
+    uint32_t wait_ms = RX_BACKSTOP_POLL;
+
+    uint8_t buffer_count = frame_pool_alloc(indices, RX_BATCH_SIZE);
+    byte frame_count = 0;
+    if (buffer_count == 0) {
+        // Decoder behind, leave the frame in the FIFO until a buffer is given back
+        if (b_notified) {
+            frame_pool_exhausted();
+        }
+        return 10;
+    }
+    for (uint8_t i = 0; i < buffer_count; i++) {
+        slots[i] = &frame_pool_get(indices[i])->frame;
+    }
+
+    // rx_arrival_us is left over from the last interrupt when the backstop poll finds a
+    // frame, the real arrival isn't known so it is kept out of the latency histograms
+    int64_t arrival_us = b_notified ? rx_arrival_us : 0;
+    uint32_t arrival_ms = arrival_us ? (uint32_t)(arrival_us / 1000) : millis();
+    cc1101_spi_stats_t spi_before = radio.spiStats;
+    uint32_t recovered_before = radio.rxStats.recovered;
+    bool b_drain = true;
+#ifdef RADIO_WOR
+    // Any SPI access wakes the CC1101, leave it asleep unless GDO0 says there is a packet
+    b_drain = b_notified || radio_wor.state == WOR_STATE_RX;
+#endif
+    // FREQEST belongs to the packet that just ended, read it before the next one can start
+    int8_t freqest = b_drain ? (int8_t)radio.readStatusRegister(CC1101_FREQEST) : 0;
+    frame_count = b_drain ? radio.getPackets(slots, buffer_count) : 0;
+
+    // Only trust it if that packet (the last one drained) was good
+    if (frame_count > 0 && CC1101::frameCrcOk(slots[frame_count - 1]) && !radio_survey.b_active) {
+        afc_update(radio, &afc, freqest);
+    }
+    // Counted here rather than in the decoder, the request slots and WOR windows
+    // need to know about a frame before the radio is looked at again
+    for (byte f = 0; f < frame_count; f++) {
+        afc_count_frame(&afc, CC1101::frameCrcOk(slots[f]));
+        radio_health_frame(&radio_health, CC1101::frameCrcOk(slots[f]), arrival_ms);
+        radio_survey_frame(&radio_survey, CC1101::frameCrcOk(slots[f]), CC1101::frameRSSIdbm(slots[f]), CC1101::frameLQI(slots[f]));
+        if (slots[f]->size > 0 && CC1101::frameCrcOk(slots[f]) &&
+            tx_schedule_observe(&tx_schedule, slots[f]->data, slots[f]->size, arrival_ms)) {
+            radio_stats_response();
+        }
+    }
+
+#ifdef RADIO_WOR
+    if (!radio_survey.b_active) {       // listen all the time while surveying
+        wait_ms = constrain(radio_wor_update(radio, &radio_wor, &tx_schedule, frame_count > 0, millis()), 10, RX_BACKSTOP_POLL);
+    }
+#endif
+
+    if (!b_notified && frame_count > 0) {
+        ESP_LOGW(TAG, "Backstop poll found %d frame(s), GDO0 edge missed", frame_count);
+    }
+    if (frame_count == buffer_count && buffer_count < RX_BATCH_SIZE) {
+        frame_pool_exhausted();     // there may be more in the FIFO
+        wait_ms = 10;
+    }
+    ESP_LOGD(TAG, "getPackets() bus cost: %" PRIu32 " SPI transactions, %" PRIu32 " bytes for %d frame(s)",
+        radio.spiStats.transactions - spi_before.transactions, radio.spiStats.bytes - spi_before.bytes, frame_count);
+    if (radio.rxStats.recovered != recovered_before) {
+        ESP_LOGI(TAG, "Back to back frames: %d in the FIFO, %" PRIu32 " recovered in total (flushes %" PRIu32 ", overflows %" PRIu32 ")",
+            frame_count, radio.rxStats.recovered, radio.rxStats.flushes, radio.rxStats.overflows);
+    }
+
+    for (byte f = 0; f < frame_count; f++) {
+        rx_buffer_t *buffer = frame_pool_get(indices[f]);
+        buffer->arrival_us = arrival_us;
+        buffer->arrival_ms = arrival_ms;
+        frame_pool_submit(indices[f]);
+    }
+    for (uint8_t i = frame_count; i < buffer_count; i++) {
+        frame_pool_release(indices[i]);
+    }
+
+    return wait_ms;
+}
+
+
+/**
+ * @brief Send a request to a main unit, radio task only. Blocks until GDO0 signals the end
+ * of the packet (or TX_TIMEOUT), by which time MCSM1 has the chip back in RX.
+ *
+ * @param command RADIO_CMD_TRANSMIT with the encoded request
+ * @return tx_result_t How it ended
+ */
+static tx_result_t radio_transmit(const radio_command_t *command) {
+    tx_result_t result = TX_RESULT_OK;
+    uint32_t airtime_us = 0;
+    uint32_t bits = 0;
+
+    TRACE_BEGIN(TRACE_SEND_PACKET, command->transmit.size);
+
+#ifdef RADIO_WOR
+    radio_wor_wake(radio, &radio_wor, millis());    // Registers lost asleep, and listen for the reply
+#endif
+    radio.strobe(CC1101_SIDLE);
+    radio.writeRegister(CC1101_TXFIFO, command->transmit.size);             // packet length
+    radio.writeBurstRegister(CC1101_TXFIFO, command->transmit.data, command->transmit.size);    // write the data to the TX FIFO
+    b_tx_active = true;
+    uint32_t start_ms = millis();
+    int64_t start_us = esp_timer_get_time();
+    radio.strobe(CC1101_STX);
+
+    // Anything else that wakes the task meanwhile (a command) is kept for radio_task()
+    while (!(bits & RADIO_NOTIFY_TX_DONE) && millis() - start_ms < TX_TIMEOUT) {
+        uint32_t value = 0;
+        xTaskNotifyWait(0, 0xffffffff, &value, (TX_TIMEOUT - (millis() - start_ms)) / portTICK_PERIOD_MS + 1);
+        bits |= value;
+    }
+    b_tx_active = false;
+    if (bits & ~RADIO_NOTIFY_TX_DONE) {
+        xTaskNotify(xTaskGetCurrentTaskHandle(), bits & ~RADIO_NOTIFY_TX_DONE, eSetBits);
+    }
+
+    if (!(bits & RADIO_NOTIFY_TX_DONE)) {
+        result = TX_RESULT_TIMEOUT;
+        radio.setIDLEstate();
+        radio.strobe(CC1101_SFTX);
+    } else if (radio.getState() == 0b111) {
+        result = TX_RESULT_UNDERFLOW;               // setRXstate() flushes it
+    } else {
+        airtime_us = (uint32_t)(tx_end_us - start_us);
+    }
+    radio.setRXstate();                             // Normally already there
+
+    if (result != TX_RESULT_UNDERFLOW) {
+        tx_schedule_sent(&tx_schedule, command->transmit.slot, command->transmit.address, command->transmit.request, start_ms);
+        units_request_sent(&iboost_units, command->transmit.address, command->transmit.request, start_ms);
+    }
+    radio_stats_transmit(result, airtime_us);
+    TRACE_END(TRACE_SEND_PACKET, result == TX_RESULT_OK);
+
+    return result;
+}
+
+
+/**
+ * @brief Handle the frames the radio task has drained, oldest first, and the periodic
+ * radio reports. Nothing here holds the radio.
  * 
  */
-void receive_packet_task(void *parameter) { 
-    byte packet[65];                // The CC1101 library sets the biggest packet at 61
-    uint8_t address_lqi = 255;      // set received LQI to lowest value
-    uint8_t receive_lqi = 0;        // signal strength test 
-    JsonDocument doc;               // Create JSON message for sending via MQTT
-    char msg[MSG_BUFFER_SIZE];      // MQTT message
+void decode_packet_task(void *parameter) {
+    uint8_t index;
+    uint32_t last_afc_report_ms = 0;
+    uint32_t last_stats_report_ms = 0;
+    uint32_t surveys_published = 0;
+
+    for( ;; ) {
+        if (frame_pool_receive(&index, RX_BACKSTOP_POLL / portTICK_PERIOD_MS)) {
+            decode_frame(frame_pool_get(index));
+            frame_pool_release(index);
+        }
+
+        afc_save(&afc);
+        if (millis() - last_afc_report_ms >= AFC_REPORT_INTERVAL) {
+            last_afc_report_ms = millis();
+            publish_afc_metrics();
+        }
+        if (millis() - last_stats_report_ms >= STATS_REPORT_INTERVAL) {
+            last_stats_report_ms = millis();
+            publish_radio_stats();
+            publish_latency();
+#ifdef RADIO_WOR
+            publish_wor_metrics();
+#endif
+        }
+        if (surveys_done != surveys_published) {
+            surveys_published = surveys_done;
+            publish_survey();
+        }
+    }
+    vTaskDelete (NULL);
+}
+
+
+/**
+ * @brief Handle one frame from the CC1101, see iboost_events.h for what comes of it.
+ * 
+ * @param buffer Frame and its arrival time
+ */
+static void decode_frame(const rx_buffer_t *buffer) {
+    const cc1101_frame_t *frame = &buffer->frame;
     led_measage_t led = RECEIVE;
     bool b_flag = true;
-    electricity_event_t electricity_event;
+
+    radio_stats_frame(frame->data, frame->size, CC1101::frameCrcOk(frame), CC1101::frameRSSIdbm(frame), 
+        CC1101::frameLQI(frame), buffer->arrival_ms);
+    if (frame->size == 0 || !CC1101::frameCrcOk(frame)) {
+        return;
+    }
+
+    TRACE_BEGIN(TRACE_DECODE, frame->size);
+    uint8_t result = iboost_events_frame(&iboost_events, frame->data, frame->size, CC1101::frameRSSIdbm(frame), 
+        CC1101::frameLQI(frame), buffer->arrival_ms, buffer->arrival_us);
+    TRACE_END(TRACE_DECODE, result);
+
+    if (result & EVENTS_PUBLISHED) {
+        latency_histogram_t latency;
+        latency_snapshot(LATENCY_MQTT, LATENCY_TOPIC_IBOOST, &latency);
+        if (latency.count > 0) {
+            ESP_LOGI(TAG, "Frame arrival to publish: %" PRIu32 " us (average %" PRIu32 " us, max %" PRIu32 " us)", 
+                latency.last_us, (uint32_t)(latency.total_us / latency.count), latency.max_us);
+        }
+    }
+
+    if (result & EVENTS_USED) {
+        // Send message to LED task to blink the LED to show we've received a packet
+        led = RECEIVE;
+        // xQueueSend(inbuilt_led_queue, &b_flag, 0); // internal led
+        xQueueSend(ws2812b_queue, &led, 0); // led strip
+    }
+
+    // ESP_LOGI(TAG, "## Receive Task Stack Left: %d", uxTaskGetStackHighWaterMark(NULL));
+}
+
+
+/**
+ * @brief Send a display event to the display task.
+ * 
+ * @param event Event
+ */
+static void display_event(const electricity_event_t *event) {
+    TRACE_INSTANT(TRACE_DISPLAY_SEND, event->event);
+    xQueueSend(g_main_queue, event, 0);
+}
+
+
+/**
+ * @brief Publish a message that came from a frame and add the time since the frame
+ * arrived to its topic's latency histogram.
+ * 
+ * @param topic MQTT topic
+ * @param doc Document to serialise
+ * @param arrival_us Arrival time of the frame (esp_timer_get_time())
+ * @return true if the message was handed to the MQTT client
+ */
+static bool publish_frame_json(const char *topic, JsonDocument &doc, int64_t arrival_us) {
+    bool b_published = publish_json(topic, doc);
+
+    if (b_published) {
+        if (strcmp(topic, "iboost/iboost") == 0) {
+            latency_record(LATENCY_MQTT, LATENCY_TOPIC_IBOOST, arrival_us);
+        } else if (strcmp(topic, "iboost/grid") == 0) {
+            latency_record(LATENCY_MQTT, LATENCY_TOPIC_GRID, arrival_us);
+        } else if (strncmp(topic, "iboost/unit/", 12) == 0) {
+            latency_record(LATENCY_MQTT, LATENCY_TOPIC_UNIT, arrival_us);
+        }
+    }
+    return b_published;
+}
+
+
+/**
+ * @brief Send our requests to a new primary unit.
+ * 
+ * @param address Unit address
+ */
+static void primary_changed(uint16_t address) {
     char tx_item[50];
     UBaseType_t res = pdFALSE;
 
+    tx_schedule_set_address(&tx_schedule, address);
+
     memset(tx_item, '\0', sizeof(tx_item));
+    strcpy(tx_item, "Updated iBoost address");
+    res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
+    if (res != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to send Ringbuffer item");
+    }
+}
 
-    //ESP_LOGI(TAG, "Executing on core: %d", xPortGetCoreID());
 
-    for( ;; ) {
-        if (xSemaphoreTake(radio_semaphore, 250 / portTICK_PERIOD_MS) == pdTRUE) {
-            byte pkt_size = radio.getPacket(packet);
-            if (pkt_size > 0 && radio.crcok()) {        // We have a valid packet with some data
-                short heating;
-                long p1, p2;
-                byte boostTime;
-                bool b_is_water_heating_by_solar, b_is_cylinder_hot, b_is_battery_ok;
-                int16_t rssi = radio.getRSSIdbm();
-
-                //   buddy request                            sender packet
-                if ((packet[2] == 0x21 && pkt_size == 29) || (packet[2] == 0x01 && pkt_size == 44)) {
-                    receive_lqi = radio.getLQI();
-                    ESP_LOGI(TAG, "Buddy/Sender frame received: length=%d, RSSI=%d, LQI=%d", pkt_size, rssi, receive_lqi);
-
-                    if(receive_lqi < address_lqi) { // is the signal stronger than the previous/none
-                        address_lqi = receive_lqi;
-                        iboost_information.address[0] = packet[0]; // save the address of the packet	0x1c7b; //
-                        iboost_information.address[1] = packet[1];
-                        iboost_information.b_is_address_valid = true;
-
-                        ESP_LOGI(TAG, "Updated iBoost address to: %02x,%02x", iboost_information.address[0], iboost_information.address[1]);
-
-                        strcpy(tx_item, "Updated iBoost address");
-                        res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
-                        memset(tx_item, '\0', sizeof(tx_item));
-                        if (res != pdTRUE) {
-                            ESP_LOGE(TAG, "Failed to send Ringbuffer item");
-                        }
-                    }
-
-                    if (receive_lqi != iboost_information.lqi) {
-                        iboost_information.lqi = receive_lqi;
-                        electricity_event.event = SL_LQI;
-                        electricity_event.value = receive_lqi;
-                        electricity_event.info = IB_NONE;
-                        xQueueSend(g_main_queue, &electricity_event, 0);
-                    }
-                }
+/**
+ * @brief Show that iboost/iboost couldn't be published.
+ * 
+ */
+static void publish_failed(void) {
+    led_measage_t led = MQTT_ERROR;
+    char tx_item[50];
+    UBaseType_t res = pdFALSE;
 
-                // main unit (sending info to iBoost Buddy)
-                if (packet[2] == 0x22) {    
-                    #ifdef HEXDUMP  // declared in platformio.ini
-                        // log level needs to be ESP_LOG_ERROR to get something to print!!
-                        ESP_LOG_BUFFER_HEXDUMP(TAG, packet, pkt_size, ESP_LOG_ERROR);
-                    #endif
-                    ESP_LOGI(TAG, "iBoost frame received: length=%d, RSSI=%d, LQI=%d", pkt_size, rssi, receive_lqi);
-                    heating = (* ( short *) &packet[16]);
-                    p1 = (* ( long*) &packet[18]);
-                    p2 = (* ( long*) &packet[25]); // this depends on the request
-
-                    ESP_LOGI(TAG, "packet[6]: %d, packet[7]: %d", packet[6], packet[7]);
-                    if (packet[6]) {
-                        b_is_water_heating_by_solar = false;
-                    } else {
-                        b_is_water_heating_by_solar = true;
-                    }
-
-                    if (packet[7] == 1) {
-                        b_is_cylinder_hot = true;
-                    } else {
-                        b_is_cylinder_hot = false;
-                    }
-
-                    if (packet[12]) {
-                        b_is_battery_ok = false;
-                    } else {
-                        b_is_battery_ok = true;
-                    }
-
-                    boostTime=packet[5]; // boost time remaining (minutes)
-
-                    ESP_LOGI(TAG, "Heating: %d Watts  P1: %ld  %s: %ld Watts  P2: %ld", 
-                        heating, p1, (p1/MAGIC_NUMBER < 0 ? "Exporting": "Importing"), 
-                        (p1/MAGIC_NUMBER < 0 ? abs(p1/MAGIC_NUMBER): p1/MAGIC_NUMBER), p2); 
-
-                    // Importing or exporting electricity
-                    if (p1/MAGIC_NUMBER < 0) {   // exporting
-                        electricity_event.event = SL_EXPORT;
-                        electricity_event.value = abs(p1/MAGIC_NUMBER);
-                        electricity_event.info = IB_NONE;
-                        xQueueSend(g_main_queue, &electricity_event, 0);
-                    } else if (p1/MAGIC_NUMBER > 0){            // importing
-                        electricity_event.event = SL_IMPORT;
-                        electricity_event.value = p1/MAGIC_NUMBER;
-                        electricity_event.info = IB_NONE;
-                        xQueueSend(g_main_queue, &electricity_event, 0);
-                    }
-
-                    switch (packet[24]) {
-                        case   SAVED_TODAY:
-                            if (iboost_information.today != p2) {   // only update if value changed
-                                iboost_information.today = p2;
-                                electricity_event.event = SL_WT_TODAY;
-                                electricity_event.value = p2;
-                                electricity_event.info = IB_NONE;
-                                xQueueSend(g_main_queue, &electricity_event, 0);
-                            } 
-                        break;
-
-                        case   SAVED_YESTERDAY:
-                            iboost_information.yesterday = p2;
-                        break;
-
-                        case   SAVED_LAST_7:
-                            iboost_information.last7 = p2;
-                        break;
-
-                        case   SAVED_LAST_28:
-                            iboost_information.last28 = p2;
-                        break;
-
-                        case   SAVED_TOTAL:
-                            iboost_information.total = p2;
-                        break;
-                    }
-
-                    if (b_is_cylinder_hot)
-                        ESP_LOGI(TAG, "Water Tank HOT");
-                    else if (boostTime > 0)
-                        ESP_LOGI(TAG, "Manual Boost ON"); 
-                    else if (b_is_water_heating_by_solar) {
-                        ESP_LOGI(TAG, "Heating by Solar = %d Watts", heating);
-                    }
-                    else {
-                        ESP_LOGI(TAG, "Water Heating OFF");
-                    }
-
-                    ESP_LOGI(TAG, "Today: %ld Wh   Yesterday: %ld Wh   Last 7 Days: %ld Wh   Last 28 Days: %ld Wh   Total: %ld Wh   Boost Time: %d", 
-                        iboost_information.today, iboost_information.yesterday, iboost_information.last7, iboost_information.last28, iboost_information.total, boostTime);
-
-                    // Create JSON for sending via MQTT to MQTT server
-                    // How much solar we have used today to heat the hot water
-                    doc["savedToday"] = iboost_information.today;
-                    
-                    // Water tank status
-                    if (b_is_cylinder_hot) {
-                        doc["hotWater"] =  "HOT";                        
-                        electricity_event.event = SL_WT_STATUS;
-                        electricity_event.value = 0;
-                        electricity_event.info = IB_WT_HOT;
-                    } else if (b_is_water_heating_by_solar) {
-                        ESP_LOGI(TAG, "Heating by solar detected");
-                        doc["hotWater"] =  "Heating by Solar";                        
-                        electricity_event.event = SL_WT_NOW;
-                        electricity_event.value = heating;          // equates to PV being used now
-                        electricity_event.info = IB_WT_HEATING;
-                    } else {
-                        doc["hotWater"] =  "Off";                        
-                        electricity_event.event = SL_WT_STATUS;
-                        electricity_event.value = 0;
-                        electricity_event.info = IB_WT_OFF;
-                    }
-                    xQueueSend(g_main_queue, &electricity_event, 0);
-                    
-                    // Status of the sender battery
-                    if (b_is_battery_ok) {
-                        iboost_information.b_sender_battery_ok = true;
-                        ESP_LOGI(TAG, "Sender Battery OK");
-                        doc["battery"] =  "OK"; 
-                        electricity_event.info = IB_BATTERY_OK;
-                    } else {
-                        iboost_information.b_sender_battery_ok = false;
-                        ESP_LOGI(TAG, "Warning - Sender Battery LOW");
-                        doc["battery"] = "LOW"; 
-                        electricity_event.info = IB_BATTERY_LOW;
-                    }
-                    electricity_event.event = SL_BATTERY;
-                    electricity_event.value = 0;
-                    xQueueSend(g_main_queue, &electricity_event, 0);
-
-                    if (xSemaphoreTake(keep_alive_mqtt_semaphore, 250 / portTICK_PERIOD_MS) == pdTRUE) {
-                        if (mqtt_client.connected()) {
-                            serializeJson(doc, msg);
-                            mqtt_client.publish("iboost/iboost", msg);
-                            ESP_LOGI(TAG, "Published MQTT message: %s", msg);           
-                        } else {
-                            ESP_LOGW(TAG, "Unable to publish message: %s to MQTT - not connected!", msg); 
-
-                            led = MQTT_ERROR;
-                            xQueueSend(ws2812b_queue, &led, 0);
-
-                            strcpy(tx_item, "Unable to publish MQTT message - not connected");
-                            res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
-                            memset(tx_item, '\0', sizeof(tx_item));
-                            if (res != pdTRUE) {
-                                ESP_LOGE(TAG, "Failed to send Ringbuffer item");
-                            }
-                        }
-                        xSemaphoreGive(keep_alive_mqtt_semaphore);
-                    } else {
-                        ESP_LOGE(TAG, "Unable to take keep_alive_mqtt_semaphore");
-                        strcpy(tx_item, "Unable to take keep_alive_mqtt_semaphore");
-                        res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
-                        memset(tx_item, '\0', sizeof(tx_item));
-                        if (res != pdTRUE) {
-                            ESP_LOGE(TAG, "Failed to send Ringbuffer item");
-                        }
-                    }
-                }
+    xQueueSend(ws2812b_queue, &led, 0);
 
-                // Send message to LED task to blink the LED to show we've received a packet
-                led = RECEIVE;
-                // xQueueSend(inbuilt_led_queue, &b_flag, 0); // internal led
-                xQueueSend(ws2812b_queue, &led, 0); // led strip
+    memset(tx_item, '\0', sizeof(tx_item));
+    strcpy(tx_item, "Unable to publish MQTT message - not connected");
+    res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
+    if (res != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to send Ringbuffer item");
+    }
+}
 
-                // ESP_LOGI(TAG, "## Receive Task Stack Left: %d", uxTaskGetStackHighWaterMark(NULL));
-            }   
 
-            xSemaphoreGive(radio_semaphore);
+/**
+ * @brief GDO0 interrupt. With IOCFG0 = 0x46 (inverted output) GDO0 rises when the CC1101
+ * reaches the end of a packet, received or our own transmission (see radio_transmit()).
+ * 
+ */
+void IRAM_ATTR gdo0_isr(void) {
+    BaseType_t x_higher_priority_task_woken = pdFALSE;
+    int64_t now_us = esp_timer_get_time();
+    uint32_t bits = RADIO_NOTIFY_GDO0;
+
+    if (b_tx_active) {
+        b_tx_active = false;
+        tx_end_us = now_us;
+        bits = RADIO_NOTIFY_TX_DONE;
+    } else {
+        rx_arrival_us = now_us;
+    }
+    TRACE_INSTANT(TRACE_GDO0, bits == RADIO_NOTIFY_TX_DONE);
+    radio_stats_interrupt();
+    if (radio_task_handle != NULL) {
+        xTaskNotifyFromISR(radio_task_handle, bits, eSetBits, &x_higher_priority_task_woken);
+    }
+    portYIELD_FROM_ISR(x_higher_priority_task_woken);
+}
 
-        } else {
-            ESP_LOGE(TAG, "Unable to take radio_semaphore");
-            strcpy(tx_item, "Unable to take radio_semaphore");
-            res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
-            memset(tx_item, '\0', sizeof(tx_item));
-            if (res != pdTRUE) {
-                ESP_LOGE(TAG, "Failed to send Ringbuffer item");
+
+/**
+ * @brief Publish a JSON document to the MQTT broker, if connected.
+ * 
+ * @param topic MQTT topic
+ * @param doc Document to serialise
+ * @return true if the message was handed to the MQTT client
+ */
+static bool publish_json(const char *topic, JsonDocument &doc) {
+    char msg[256];      // PubSubClient's default packet size
+    bool b_published = false;
+
+    TRACE_BEGIN(TRACE_MQTT_WAIT, 0);
+    BaseType_t x_mqtt_taken = xSemaphoreTake(keep_alive_mqtt_semaphore, 250 / portTICK_PERIOD_MS);
+    TRACE_END(TRACE_MQTT_WAIT, x_mqtt_taken == pdTRUE);
+    if (x_mqtt_taken == pdTRUE) {
+        if (mqtt_client.connected()) {
+            TRACE_BEGIN(TRACE_JSON, 0);
+            size_t size = serializeJson(doc, msg, sizeof(msg));
+            TRACE_END(TRACE_JSON, size);
+            TRACE_BEGIN(TRACE_PUBLISH, 0);
+            b_published = mqtt_client.publish(topic, msg);
+            TRACE_END(TRACE_PUBLISH, b_published);
+            ESP_LOGD(TAG, "Published MQTT message: %s %s", topic, msg);
+        }
+        xSemaphoreGive(keep_alive_mqtt_semaphore);
+    } else {
+        ESP_LOGE(TAG, "Unable to take keep_alive_mqtt_semaphore");
+    }
+
+    return b_published;
+}
+
+
+/**
+ * @brief Publish the frequency correction and how many packets arrive with a good CRC.
+ * 
+ */
+static void publish_afc_metrics(void) {
+    JsonDocument doc;
+    uint32_t frames = afc.frames_good + afc.frames_bad;
+
+    doc["offsetHz"] = afc_offset_hz(&afc);
+    doc["fsctrl0"] = afc.fsctrl0;
+    doc["freqest"] = afc.last_freqest;
+    doc["corrections"] = afc.corrections;
+    doc["good"] = afc.frames_good;
+    doc["bad"] = afc.frames_bad;
+    doc["yield"] = frames ? (float)afc.frames_good / frames : 0.0f;
+
+    ESP_LOGI(TAG, "AFC: offset %" PRId32 " Hz, FREQEST %d, %" PRIu32 " good / %" PRIu32 " bad frames", 
+        afc_offset_hz(&afc), afc.last_freqest, afc.frames_good, afc.frames_bad);
+    publish_json("iboost/radio/afc", doc);
+}
+
+
+/**
+ * @brief Publish how many requests were sent and answered in each transmit slot.
+ * 
+ */
+static void publish_tx_schedule(void) {
+    JsonDocument doc;
+    JsonArray offsets = doc["offsetMs"].to<JsonArray>();
+    JsonArray sent = doc["sent"].to<JsonArray>();
+    JsonArray answered = doc["answered"].to<JsonArray>();
+
+    doc["locked"] = tx_schedule_is_locked(&tx_schedule, millis());
+    doc["senderMs"] = tx_schedule.sender.period_ms;
+    doc["buddyMs"] = tx_schedule.buddy.period_ms;
+    for (uint8_t i = 0; i <= TX_SLOT_FALLBACK; i++) {
+        const tx_slot_t *s = &tx_schedule.slots[i];
+        offsets.add(s->offset_ms);      // 0 is the fallback, not aligned to the sender
+        sent.add(s->sent);
+        answered.add(s->answered);
+        ESP_LOGI(TAG, "Slot %d (+%d ms): %" PRIu32 " sent, %" PRIu32 " answered", i, s->offset_ms, s->sent, s->answered);
+    }
+    publish_json("iboost/radio/slots", doc);
+}
+
+
+/**
+ * @brief Publish the age of each saved counter (seconds, -1 until answered) and how often
+ * each has been requested, for every unit we ask.
+ * 
+ */
+static void publish_request_schedule(void) {
+    static const char *names[REQUEST_COUNTERS] = {"today", "yesterday", "last7", "last28", "total"};
+    char topic[40];
+    uint32_t now_ms = millis();
+
+    for (uint8_t u = 0; u < UNIT_TABLE_SIZE; u++) {
+        iboost_unit_t *unit = &iboost_units.units[u];
+        if (!unit->b_in_use || unit->requests.counters[0].requests == 0) {
+            continue;       // never asked
+        }
+
+        JsonDocument doc;
+        JsonArray requests = doc["requests"].to<JsonArray>();
+        for (uint8_t i = 0; i < REQUEST_COUNTERS; i++) {
+            int32_t age = request_schedule_age(&unit->requests, SAVED_TODAY + i, now_ms);
+            doc[names[i]] = age;
+            requests.add(unit->requests.counters[i].requests);
+            ESP_LOGI(TAG, "Unit %04x saved %s: age %" PRId32 " s, %" PRIu32 " requests, %" PRIu32 " answers", unit->address, 
+                names[i], age, unit->requests.counters[i].requests, unit->requests.counters[i].answers);
+        }
+        doc["rollovers"] = unit->requests.rollovers;
+        snprintf(topic, sizeof(topic), "iboost/radio/requests/%04x", unit->address);
+        publish_json(topic, doc);
+    }
+}
+
+
+/**
+ * @brief Publish the radio link statistics, a summary to iboost/radio/stats and the
+ * RSSI/LQI histograms of each source to iboost/radio/stats/<address>.
+ * 
+ */
+static void publish_radio_stats(void) {
+    radio_stats_t stats;
+    frame_pool_stats_t pool;
+    radio_snapshot_t driver;
+    char topic[32];
+    uint32_t now_ms = millis();
+
+    radio_stats_snapshot(&stats);
+    frame_pool_snapshot(&pool);
+    bool b_driver = radio_snapshot_take(&driver);
+
+    JsonDocument doc;
+    JsonArray frames = doc["frames"].to<JsonArray>();       // sender, buddy, main unit, other
+    for (uint8_t i = 0; i < STATS_TYPES; i++) {
+        frames.add(stats.frames[i]);
+    }
+    doc["crcFail"] = stats.crc_failures;
+    doc["sizeReject"] = stats.size_rejects;
+    doc["irq"] = stats.interrupts;
+    if (b_driver) {
+        doc["overflow"] = driver.rx.overflows;
+        doc["flush"] = driver.rx.flushes;
+
+        // Waits on the chip, see CC1101_STATE_TIMEOUT_US, and calibrations
+        JsonDocument wait_doc;
+        static const char *errors[] = {"none", "miso", "state"};
+        wait_doc["waits"] = driver.wait.waits;
+        wait_doc["timeouts"] = driver.wait.timeouts;
+        wait_doc["avgUs"] = driver.wait.waits ? driver.wait.totalUs / driver.wait.waits : 0;
+        wait_doc["maxUs"] = driver.wait.maxUs;
+        wait_doc["lastError"] = errors[driver.last_error];
+        wait_doc["calibrations"] = driver.cal.calibrations;        // RADIO_CACHED_CAL
+        wait_doc["calUs"] = driver.cal.lastUs;
+        publish_json("iboost/radio/waits", wait_doc);
+
+        // Supervisor trips, what was done about them and how long the outages lasted
+        JsonDocument health_doc;
+        radio_health_t *health = &driver.health;
+        health_doc["restarts"] = health->actions[HEALTH_ACTION_RESTART_RX];
+        health_doc["resets"] = health->actions[HEALTH_ACTION_RESET];
+        JsonArray trips = health_doc["trips"].to<JsonArray>();       // silence, CRC, state, driver
+        for (uint8_t i = HEALTH_CAUSE_SILENCE; i < HEALTH_CAUSES; i++) {
+            trips.add(health->trips[i]);
+        }
+        health_doc["lastCause"] = radio_health_cause_name(health->last_cause);
+        health_doc["outages"] = health->outages;
+        health_doc["lastOutageS"] = health->last_outage_ms / 1000;
+        health_doc["longestOutageS"] = health->longest_outage_ms / 1000;
+        health_doc["lastActionUs"] = health->last_action_us;
+        health_doc["maxActionUs"] = health->max_action_us;
+        health_doc["quietS"] = (now_ms - health->last_good_ms) / 1000;
+        health_doc["outage"] = health->b_outage;
+        publish_json("iboost/radio/health", health_doc);
+    }
+    doc["requests"] = stats.requests;
+    doc["responses"] = stats.responses;
+    doc["poolFull"] = pool.exhausted;
+    doc["poolMax"] = pool.max_in_use;
+    doc["duplicates"] = iboost_events.dedup.duplicates;     // this task owns it
+    ESP_LOGI(TAG, "Radio: %" PRIu32 "/%" PRIu32 "/%" PRIu32 " sender/buddy/main unit frames, %" PRIu32 " CRC failures, "
+        "%" PRIu32 " size rejects, %" PRIu32 " duplicates, %" PRIu32 " of %" PRIu32 " requests answered", 
+        stats.frames[STATS_SENDER], stats.frames[STATS_BUDDY], stats.frames[STATS_MAIN_UNIT], stats.crc_failures, 
+        stats.size_rejects, iboost_events.dedup.duplicates, stats.responses, stats.requests);
+    publish_json("iboost/radio/stats", doc);
+
+    // Our own transmissions, against the band's duty cycle limit
+    JsonDocument tx_doc;
+    uint32_t uptime_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    tx_doc["sent"] = stats.requests;
+    tx_doc["underflows"] = stats.tx_underflows;
+    tx_doc["timeouts"] = stats.tx_timeouts;
+    tx_doc["airtimeMs"] = (uint32_t)(stats.airtime_us / 1000);
+    tx_doc["lastUs"] = stats.airtime_last_us;
+    tx_doc["maxUs"] = stats.airtime_max_us;
+    tx_doc["dutyCycle"] = uptime_ms ? (float)(stats.airtime_us / 1000) / uptime_ms : 0.0f;
+    ESP_LOGI(TAG, "TX: %" PRIu32 " sent, %" PRIu32 " timeouts, %" PRIu32 " underflows, %" PRIu32 "us last on air", 
+        stats.requests, stats.tx_timeouts, stats.tx_underflows, stats.airtime_last_us);
+    publish_json("iboost/radio/tx", tx_doc);
+
+    for (uint8_t i = 0; i < STATS_SOURCES; i++) {
+        const stats_source_t *source = &stats.sources[i];
+        if (source->frames == 0) {
+            continue;
+        }
+
+        JsonDocument source_doc;
+        JsonArray rssi = source_doc["rssi"].to<JsonArray>();
+        JsonArray lqi = source_doc["lqi"].to<JsonArray>();
+        for (uint8_t b = 0; b < STATS_RSSI_BUCKETS; b++) {
+            rssi.add(source->rssi[b]);
+        }
+        for (uint8_t b = 0; b < STATS_LQI_BUCKETS; b++) {
+            lqi.add(source->lqi[b]);
+        }
+        source_doc["frames"] = source->frames;
+        source_doc["rssiAvg"] = source->rssi_total / (int32_t)source->frames;
+        source_doc["age"] = (now_ms - source->last_ms) / 1000;
+
+        snprintf(topic, sizeof(topic), "iboost/radio/stats/%04x", source->address);
+        publish_json(topic, source_doc);
+    }
+}
+
+
+/**
+ * @brief Publish the frame to MQTT and frame to display latency histograms, one message
+ * per topic or event type seen, to iboost/latency/mqtt/<topic> and
+ * iboost/latency/display/<event>.
+ * 
+ */
+static void publish_latency(void) {
+    static const char *paths[LATENCY_PATHS] = {"mqtt", "display"};
+    char topic[40];
+
+    for (uint8_t path = 0; path < LATENCY_PATHS; path++) {
+        for (uint8_t kind = 0; kind < latency_kinds((latency_path_t)path); kind++) {
+            latency_histogram_t latency;
+            latency_snapshot((latency_path_t)path, kind, &latency);
+            if (latency.count == 0) {
+                continue;
+            }
+
+            JsonDocument doc;
+            JsonArray buckets = doc["buckets"].to<JsonArray>();     // 128us, 256us, 512us ... 2.1s and over
+            for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+                buckets.add(latency.buckets[b]);
             }
+            doc["count"] = latency.count;
+            doc["avgUs"] = (uint32_t)(latency.total_us / latency.count);
+            doc["maxUs"] = latency.max_us;
+
+            snprintf(topic, sizeof(topic), "iboost/latency/%s/%s", paths[path], 
+                latency_kind_name((latency_path_t)path, kind));
+            publish_json(topic, doc);
         }
-        
-        vTaskDelay(250 / portTICK_PERIOD_MS);       // Give some time so other tasks can run/complete
-        // TODO - can we increase this delay or just use one task for tx and rx - no reason why not
     }
-    vTaskDelete (NULL);
 }
 
 
 /**
- * @brief Transmit a packet to the iBoost main unit to request information, in effect a fake
- * iBuddy message.
+ * @brief Publish the results of the last carrier survey, one row of the table per step
+ * to iboost/radio/survey/<kHz> and what was picked to iboost/radio/survey.
+ * 
+ */
+static void publish_survey(void) {
+    radio_snapshot_t driver;
+    char topic[40];
+
+    if (!radio_snapshot_take(&driver)) {
+        return;
+    }
+    const radio_survey_t *survey = &driver.survey;
+
+    for (uint8_t i = 0; i < SURVEY_STEPS; i++) {
+        const survey_step_t *step = &survey->steps[i];
+        JsonDocument doc;
+        doc["frequency"] = step->frequency;
+        doc["good"] = step->good;
+        doc["bad"] = step->bad;
+        doc["rssi"] = radio_survey_rssi(step);
+        doc["lqi"] = radio_survey_lqi(step);
+        snprintf(topic, sizeof(topic), "iboost/radio/survey/%" PRIu32, step->frequency / 1000);
+        publish_json(topic, doc);
+    }
+
+    JsonDocument doc;
+    doc["best"] = survey->best >= 0 ? survey->steps[survey->best].frequency : 0;
+    doc["saved"] = survey->saved_hz;
+    doc["stepHz"] = SURVEY_STEP_HZ;
+    doc["dwellS"] = SURVEY_DWELL / 1000;
+    doc["surveys"] = survey->surveys;
+    ESP_LOGI(TAG, "Survey %" PRIu32 ": carrier %" PRIu32 " Hz", survey->surveys, survey->saved_hz);
+    publish_json("iboost/radio/survey", doc);
+}
+
+
+#ifdef RADIO_WOR
+/**
+ * @brief Publish how long the receiver has been on and how many sender frames were
+ * missed because of it.
  * 
  */
+static void publish_wor_metrics(void) {
+    radio_snapshot_t driver;
+
+    if (!radio_snapshot_take(&driver)) {
+        return;
+    }
+    const radio_wor_t *wor = &driver.wor;
+    JsonDocument doc;
+    float duty = radio_wor_duty_cycle(wor, millis());
+
+    doc["duty"] = duty;
+    doc["windows"] = wor->windows;
+    doc["senderWindows"] = wor->sender_windows;
+    doc["senderMissed"] = wor->sender_missed;
+    doc["missedRate"] = wor->sender_windows ? (float)wor->sender_missed / wor->sender_windows : 0.0f;
+    doc["wakes"] = wor->wakes;
+
+    ESP_LOGI(TAG, "WOR: receiver on %.1f%% of the time, %" PRIu32 " of %" PRIu32 " sender frames missed", 
+        duty * 100, wor->sender_missed, wor->sender_windows);
+    publish_json("iboost/radio/wor", doc);
+}
+#endif
+
+
+/**
+ * @brief Ask the iBoost main unit for information, in effect a fake iBuddy message. This
+ * task only decides when and what to ask, the radio task sends it in between receiving.
+ *
+ */
 void transmit_packet_task(void *parameter) {
-    uint8_t tx_buffer[32];
-    uint8_t request = 0xca;
+    uint8_t request;
+    uint16_t address;
+    uint8_t slot;
+    uint32_t last_slot_report_ms = 0;
+    uint32_t last_request_report_ms = 0;
     led_measage_t led = TX_FAKE_BUDDY_REQUEST;
 
     //ESP_LOGI(TAG, "Executing on core: %d", xPortGetCoreID());
 
     for( ;; ) {
-        if(iboost_information.b_is_address_valid) {
-            // whilst radio is transmitting no other radio operation should be in progress
-            xSemaphoreTake(radio_semaphore, portMAX_DELAY);
-
-            memset(tx_buffer, 0, sizeof(tx_buffer));
-
-            if ((request < 0xca) || (request > 0xce)) 
-                request = 0xca;
-
-            // Payload
-            tx_buffer[0] = iboost_information.address[0];
-            tx_buffer[1] = iboost_information.address[1];		  
-            tx_buffer[2] = 0x21;
-            tx_buffer[3] = 0x8;
-            tx_buffer[4] = 0x92;
-            tx_buffer[5] = 0x7;
-            tx_buffer[8] = 0x24;
-            tx_buffer[10] = 0xa0;
-            tx_buffer[11] = 0xa0;
-            tx_buffer[12] = request; // request information (on this topic) from the main unit
-            tx_buffer[14] = 0xa0;
-            tx_buffer[15] = 0xa0;
-            tx_buffer[16] = 0xc8;
-
-            radio.strobe(CC1101_SIDLE);
-            radio.writeRegister(CC1101_TXFIFO, 0x1d);             // packet length
-            radio.writeBurstRegister(CC1101_TXFIFO, tx_buffer, 29);   // write the data to the TX FIFO
-            radio.strobe(CC1101_STX);
-            delay(5);
-            radio.strobe(CC1101_SWOR);
-            delay(5);
-            // radio.strobe(CC1101_SFRX);
-            // radio.strobe(CC1101_SIDLE);
-            // radio.strobe(CC1101_SRX);       // Re-enable receive
+        // Wait for the next slot after the sender's frame (or PING_IBOOST_UNIT until the
+        // sender's timing is known)
+        uint32_t wait_ms = tx_schedule_next(&tx_schedule, millis(), &slot);
+        if (wait_ms > 0) {
+            vTaskDelay(wait_ms / portTICK_PERIOD_MS);
+        }
 
-            radio.setRXstate();
+        // The unit to ask and its most out of date counter
+        if(units_next_request(&iboost_units, millis(), &address, &request)) {
+            radio_command_t command = {};
+            command.type = RADIO_CMD_TRANSMIT;
+            command.transmit.size = iboost_encode_request(command.transmit.data, address, request);     // see iboost_codec.h
+            command.transmit.slot = slot;
+            command.transmit.address = address;
+            command.transmit.request = request;
+
+            uint32_t result = TX_RESULT_TIMEOUT;
+            if (!radio_command(&command, true, &result)) {
+                ESP_LOGW(TAG, "Request not sent, radio task busy");
+                vTaskDelay(PING_IBOOST_UNIT / portTICK_PERIOD_MS);
+                continue;
+            }
+            if (result != TX_RESULT_OK) {
+                ESP_LOGW(TAG, "Request %s", result == TX_RESULT_UNDERFLOW ? "cut short, TX FIFO underflow" : "timed out, no end of packet");
+            } else {
+                switch (request) {
+                    case SAVED_TODAY:
+                        ESP_LOGI(TAG, "Sent request: Saved Today");
+                    break;
+                    case SAVED_YESTERDAY:
+                        ESP_LOGI(TAG, "Sent request: Saved Yesterday");
+                    break;
+                    case SAVED_LAST_7:
+                        ESP_LOGI(TAG, "Sent request: Saved Last 7 Days");
+                    break;
+                    case SAVED_LAST_28:
+                        ESP_LOGI(TAG, "Sent request: Saved Last 28 Days");
+                    break;
+                    case SAVED_TOTAL:
+                        ESP_LOGI(TAG, "Sent request: Saved In Total");
+                    break;
+                }
 
-            switch (request) {
-                case SAVED_TODAY:
-                    ESP_LOGI(TAG, "Sent request: Saved Today");
-                break;
-                case SAVED_YESTERDAY:
-                    ESP_LOGI(TAG, "Sent request: Saved Yesterday");
-                break;
-                case SAVED_LAST_7:
-                    ESP_LOGI(TAG, "Sent request: Saved Last 7 Days");
-                break;
-                case SAVED_LAST_28:
-                    ESP_LOGI(TAG, "Sent request: Saved Last 28 Days");
-                break;
-                case SAVED_TOTAL:
-                    ESP_LOGI(TAG, "Sent request: Saved In Total");
-                break;
+                xQueueSend(ws2812b_queue, &led, 0);
             }
 
-            request++;
-                        
-            xSemaphoreGive(radio_semaphore);
+            if (millis() - last_slot_report_ms >= SLOT_REPORT_INTERVAL) {
+                last_slot_report_ms = millis();
+                publish_tx_schedule();
+            }
+            if (millis() - last_request_report_ms >= REQUEST_REPORT_INTERVAL) {
+                last_request_report_ms = millis();
+                publish_request_schedule();
+            }
 
-            xQueueSend(ws2812b_queue, &led, 0);
-                        
             // ESP_LOGI(TAG, "## Transmit Task Stack Left: %d", uxTaskGetStackHighWaterMark(NULL));
+        } else {
+            vTaskDelay(PING_IBOOST_UNIT / portTICK_PERIOD_MS);      // Nothing to send until a unit has been heard
         }
-
-        vTaskDelay(PING_IBOOST_UNIT / portTICK_PERIOD_MS);          // PING_IBOOST_UNIT iBoost unit every n seconds
     }
     vTaskDelete (NULL);
 }
 
 
 /**
- * @brief Set up the CC1101 for receiving iBoost packets
+ * @brief Set up the CC1101 for receiving iBoost packets. The register values live in
+ * radio_config.h and are uploaded and read back in one burst each, so this can also be
+ * used to recover the radio after a fault.
  * 
+ * @return true if the configuration read back from the chip matches
  */
-void radio_setup() {
-    radio.reset();
-    radio.begin(868.350e6); // Freq, do not forget the "e6"
-    radio.setMaxPktSize(61);
-    radio.writeRegister(CC1101_FREQ2, 0x21); 
-    radio.writeRegister(CC1101_FREQ1, 0x65);
-    radio.writeRegister(CC1101_FREQ0, 0xe8);
-    radio.writeRegister(CC1101_FSCTRL1, 0x08); // fif=203.125kHz
-    radio.writeRegister(CC1101_FSCTRL0, 0x00); // No offset
-    radio.writeRegister(CC1101_MDMCFG4, 0x5B); // CHANBW_E = 1 CHANBW_M=1 BWchannel =325kHz   DRATE_E=11
-    radio.writeRegister(CC1101_MDMCFG3, 0xF8); // DRATE_M=248 RDATA=99.975kBaud
-    radio.writeRegister(CC1101_MDMCFG2, 0x03); // Disable digital DC blocking filter before demodulator enabled. MOD_FORMAT=000 (2-FSK) Manchester Coding disabled Combined sync-word qualifier mode = 30/32 sync word bits detected
-    radio.writeRegister(CC1101_MDMCFG1, 0x22); // Forward error correction disabled 4 preamble bytes transmitted CHANSPC_E=2
-    radio.writeRegister(CC1101_MDMCFG0, 0xF8); // CHANSPC_M=248 200kHz channel spacing
-    radio.writeRegister(CC1101_CHANNR, 0x00); // The 8-bit unsigned channel number, which is multiplied by the channel spacing setting and added to the base frequency.
-    radio.writeRegister(CC1101_DEVIATN, 0x47); // DEVIATION_E=4 DEVIATION_M=7 ±47.607 kHz deviation
-    radio.writeRegister(CC1101_FREND1, 0xB6); // Adjusts RX RF device
-    radio.writeRegister(CC1101_FREND0, 0x10); // Adjusts TX RF device
-    radio.writeRegister(CC1101_MCSM0, 0x18); // Calibrates whngoing from IDLE to RX or TX (or FSTXON) PO_TIMEOUT 149-155uS Pin control disabled XOSC off in sleep mode
-    //radio.writeRegister(CC1101_MCSM1, 0x00); // Channel clear = always Return to idle after packet reception Return to idle after transmission
-    radio.writeRegister(CC1101_FOCCFG, 0x1D); // The frequency compensation loop gain to be used before a sync word is detected = 4K The frequency compensation loop gain to be used after a sync word is Detected = K/2 The saturation point for the frequency offset compensation algorithm = ±BWchannel /8
-    radio.writeRegister(CC1101_BSCFG, 0x1C); // The clock recovery feedback loop integral gain to be used before a sync word is detected = KI The clock recovery feedback loop proportional gain to be used before a sync word is detected = 2KP The clock recovery feedback loop integral gain to be used after a sync word is Detected = KI/2 The clock recovery feedback loop proportional gain to be used after a sync word is detected = KP The saturation point for the data rate offset compensation algorithm = ±0 (No data rate offset compensation performed)
-    radio.writeRegister(CC1101_AGCCTRL2, 0xC7); // The 3 highest DVGA gain settings can not be used. Maximum allowable LNA + LNA 2 gain relative to the maximum possible gain. Target value for the averaged amplitude from the digital channel filter = 42dB
-    radio.writeRegister(CC1101_AGCCTRL1, 0x00); // LNA 2 gain is decreased to minimum before decreasing LNA gain Relative carrier sense threshold disabled Sets the absolute RSSI threshold for asserting carrier sense to MAGN_TARGET
-    radio.writeRegister(CC1101_AGCCTRL0, 0xB2); // Sets the level of hysteresis on the magnitude deviation (internal AGC signal that determine gain changes) to Medium hysteresis, medium asymmetric dead zone, medium gain Sets the number of channel filter samples from a gain adjustment has been made until the AGC algorithm starts accumulating new samples to 32 samples AGC gain never frozen
-    radio.writeRegister(CC1101_FSCAL3, 0xEA); // Detailed calibration
-    radio.writeRegister(CC1101_FSCAL2, 0x2A); //
-    radio.writeRegister(CC1101_FSCAL1, 0x00); //
-    radio.writeRegister(CC1101_FSCAL0, 0x1F); //
-    radio.writeRegister(CC1101_FSTEST, 0x59); // Test register
-    radio.writeRegister(CC1101_TEST2, 0x81); // Values to be used from SmartRF software
-    radio.writeRegister(CC1101_TEST1, 0x35); //
-    radio.writeRegister(CC1101_TEST0, 0x09); //
-    radio.writeRegister(CC1101_IOCFG2, 0x0B); // Active High Serial Clock
-    radio.writeRegister(CC1101_IOCFG0, 0x46); // Analog temperature sensor disabled Active High Asserts when sync word has been sent / received, and de-asserts at the end of the packet
-    radio.writeRegister(CC1101_PKTCTRL1, 0x04); // Sync word is always accepted Automatic flush of RX FIFO when CRC is not OK disabled Two status bytes will be appended to the payload of the packet. The status bytes contain RSSI and LQI values, as well as CRC OK. No address checkof received packages.
-    radio.writeRegister(CC1101_PKTCTRL0, 0x05); // Data whitening off Normal mode, use FIFOs for RX and TX CRC calculation in TX and CRC check in RX enabled Variable packet length mode. Packet length configured by the first byte after sync word
-    radio.writeRegister(CC1101_ADDR, 0x00); // Address used for packet filtration. Optional broadcast addresses are 0 (0x00) and 255 (0xFF).
-
-    static uint8_t paTable[] = {0xC6, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F};
-    radio.writeBurstRegister(CC1101_PATABLE, paTable, sizeof(paTable));
-
-    radio.strobe(CC1101_SIDLE); 
-    radio.strobe(CC1101_SPWD); 
+bool radio_setup() {
+    bool b_config_ok;
+    char tx_item[50];
+
+    memset(tx_item, '\0', sizeof(tx_item));
+
+    radio.begin(iboost_radio_config);    // reset and upload every configuration register
+    radio.writeBurstRegister(CC1101_PATABLE, iboost_radio_pa_table, sizeof(iboost_radio_pa_table));
+    // Carrier from the last survey (or retune)
+    if (radio_frequency == 0) {
+        radio_frequency = radio_survey.saved_hz ? radio_survey.saved_hz : radio_config_frequency(iboost_radio_config);
+    }
+    if (radio_frequency != radio_config_frequency(iboost_radio_config)) {
+        radio.setFrequency(radio_frequency);
+    }
+    if (!radio_survey.b_active) {
+        afc_apply(radio, &afc);           // FSCTRL0 no longer matches the image
+    }
+#ifdef RADIO_CACHED_CAL  // declared in platformio.ini build_flags
+    radio.setManualCalibration(true);     // after FSCTRL0, which the calibration depends on
+    fscal_ms = millis();
+    fscal_temperature = temperatureRead();
+#endif
 
     radio.setIDLEstate();                 // Was set to receive, moved so set when all setup of program is finished
+    // Checked as the chip will run it, against everything written including the changes
+    // above. Not put to sleep (SPWD) first, that would lose FSTEST..TEST0.
+    b_config_ok = radio.verifyConfiguration();
 
-    ESP_LOGI(TAG, "CC1101 set up complete, radio set to idle state");
-    char tx_item[] = "C1101 set up complete";
+    if (b_config_ok) {
+        ESP_LOGI(TAG, "CC1101 set up complete, radio set to idle state");
+        strcpy(tx_item, "C1101 set up complete");
+    } else {
+        ESP_LOGE(TAG, "CC1101 configuration read back does not match");
+        strcpy(tx_item, "C1101 configuration mismatch");
+    }
     UBaseType_t res =  xRingbufferSend(buf_handle, tx_item, sizeof(tx_item), pdMS_TO_TICKS(0));
     if (res != pdTRUE) {
         ESP_LOGE(TAG, "Failed to send Ringbuffer item");
     }
+
+    return b_config_ok;
+}
+
+
+#ifdef RADIO_BENCHMARK
+/**
+ * @brief Compare the byte loop and block burst paths of the CC1101 driver. Reads and
+ * writes the configuration registers with the frame sizes we see on air (29 byte buddy
+ * request, 37 byte main unit frame, 44 byte sender frame), the code path is the same as
+ * a FIFO burst without disturbing any packets. Must run while the radio is idle.
+ * 
+ */
+static void radio_benchmark(void) {
+    static const byte sizes[] = {29, 37, 44};
+    const int iterations = 200;
+    byte buffer[CC1101_CONFIG_SIZE];
+    cc1101_burst_mode_t saved_mode = radio.burstMode;
+
+    for (int mode = CC1101_BURST_BYTE_LOOP; mode <= CC1101_BURST_BLOCK; mode++) {
+        radio.burstMode = (cc1101_burst_mode_t)mode;
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            int64_t start = esp_timer_get_time();
+            for (int n = 0; n < iterations; n++) {
+                radio.readBurstRegister(CC1101_IOCFG2, buffer, sizes[i]);
+            }
+            int64_t read_us = esp_timer_get_time() - start;
+
+            start = esp_timer_get_time();
+            for (int n = 0; n < iterations; n++) {
+                radio.writeBurstRegister(CC1101_IOCFG2, iboost_radio_config, sizes[i]);
+            }
+            int64_t write_us = esp_timer_get_time() - start;
+
+            ESP_LOGI(TAG, "Burst %s, %d bytes: read %.2f us, write %.2f us", 
+                (mode == CC1101_BURST_BLOCK ? "block" : "byte loop"), sizes[i], 
+                (float)read_us / iterations, (float)write_us / iterations);
+        }
+    }
+
+    radio.burstMode = saved_mode;
+    radio.writeConfiguration(iboost_radio_config);      // put back anything the writes disturbed
 }
+#endif
 
 
 /**
@@ -870,6 +1797,9 @@ void connect_to_mqtt(void) {
     if (mqtt_client.subscribe("solar/pvtotal", 0)) {
         ESP_LOGI(TAG, "Subscribed to MQTT topic solar/pvtotal");
     }
+    if (mqtt_client.subscribe("iboost/radio/command", 0)) {
+        ESP_LOGI(TAG, "Subscribed to MQTT topic iboost/radio/command");
+    }
     // if (MQTTclient.subscribe("weather/description", 0)) {
     //     ESP_LOGI(TAG, "Subscribed to MQTT topic weather/description");
     // }
@@ -1026,6 +1956,7 @@ static void mqtt_callback(char* topic, byte* message, unsigned int length) {
             electricity_event.event = SL_NOW;   
             electricity_event.value = message_temp.toFloat();
             electricity_event.info = IB_NONE;
+            electricity_event.arrival_us = 0;
             xQueueSend(g_main_queue, &electricity_event, 0);
         }
     }   
@@ -1034,9 +1965,30 @@ static void mqtt_callback(char* topic, byte* message, unsigned int length) {
         electricity_event.event = SL_TODAY;
         electricity_event.value = message_temp.toFloat();
         electricity_event.info = IB_NONE;
+        electricity_event.arrival_us = 0;
         xQueueSend(g_main_queue, &electricity_event, 0);
     }
 
+    // "reinit", "survey" or a frequency in Hz, carried out by the radio task in between packets
+    if (String(topic) == "iboost/radio/command") {
+        radio_command_t command = {};
+        if (message_temp == "reinit") {
+            command.type = RADIO_CMD_REINIT;
+        } else if (message_temp == "survey") {
+            command.type = RADIO_CMD_SURVEY;
+        } else {
+            command.type = RADIO_CMD_RETUNE;
+            command.frequency = strtoul(message_temp.c_str(), NULL, 10);
+        }
+        if (command.type == RADIO_CMD_RETUNE && (command.frequency < 779000000 || command.frequency > 928000000)) {
+            ESP_LOGW(TAG, "Ignoring radio command %s", message_temp.c_str());
+        } else if (b_surveying) {
+            ESP_LOGW(TAG, "Survey in progress, %s ignored", message_temp.c_str());
+        } else if (!radio_command(&command, false, NULL)) {
+            ESP_LOGW(TAG, "Radio queue full, %s dropped", message_temp.c_str());
+        }
+    }
+
     // if (String(topic) == "weather/description") {
     //     message_temp.toCharArray(weatherDescription, 35);
     // }   
@@ -0,0 +1,190 @@
+#include <string.h>
+#include "radio_health.h"
+
+// getState() values that are fine between checks, anything else for long is stuck
+#define STATE_RX            0b001
+#define STATE_CALIBRATE     0b100
+#define STATE_SETTLING      0b101
+
+static const char *cause_names[HEALTH_CAUSES] = {"none", "silence", "crc", "state", "driver"};
+
+
+/**
+ * @brief Close the outage and go back to the healthy limits.
+ *
+ * @param health Supervisor state
+ * @param now_ms End of the outage
+ */
+static void end_outage(radio_health_t *health, uint32_t now_ms) {
+    health->outages++;
+    health->last_outage_ms = now_ms - health->outage_start_ms;
+    if (health->last_outage_ms > health->longest_outage_ms) {
+        health->longest_outage_ms = health->last_outage_ms;
+    }
+    health->b_outage = false;
+    health->level = HEALTH_ACTION_NONE;
+    health->silence_ms = HEALTH_SILENCE;
+    health->backoff_ms = HEALTH_SILENCE;
+}
+
+
+/**
+ * @brief Start the counting, the radio has just been set up so it counts as healthy.
+ *
+ * @param health Supervisor state to initialise
+ * @param now_ms Time now
+ */
+void radio_health_begin(radio_health_t *health, uint32_t now_ms) {
+    memset(health, 0, sizeof(radio_health_t));
+    health->quiet_since_ms = now_ms;
+    health->last_good_ms = now_ms;
+    health->last_check_ms = now_ms;
+    health->window_start_ms = now_ms;
+    health->silence_ms = HEALTH_SILENCE;
+    health->backoff_ms = HEALTH_SILENCE;
+    health->last_state = HEALTH_STATE_UNKNOWN;
+}
+
+
+/**
+ * @brief Count a received frame. A good one ends a silence or driver outage.
+ *
+ * @param health Supervisor state
+ * @param b_crc_ok CRC result of the frame
+ * @param now_ms Arrival time
+ */
+void radio_health_frame(radio_health_t *health, bool b_crc_ok, uint32_t now_ms) {
+    if (!b_crc_ok) {
+        health->window_bad++;
+        return;
+    }
+
+    health->window_good++;
+    if (health->b_outage && (health->last_cause == HEALTH_CAUSE_SILENCE || health->last_cause == HEALTH_CAUSE_DRIVER)) {
+        end_outage(health, now_ms);
+    }
+    health->last_good_ms = now_ms;
+    health->quiet_since_ms = now_ms;
+}
+
+
+/**
+ * @brief Whether radio_health_check() should be called.
+ *
+ * @param health Supervisor state
+ * @param now_ms Time now
+ * @return true if HEALTH_CHECK_INTERVAL has passed since the last check
+ */
+bool radio_health_due(const radio_health_t *health, uint32_t now_ms) {
+    return now_ms - health->last_check_ms >= HEALTH_CHECK_INTERVAL;
+}
+
+
+/**
+ * @brief Look for a fault and decide what to do about it. Once an action has been
+ * taken it is given the silence limit to work before the next one, or before a clean
+ * check ends the outage.
+ *
+ * @param health Supervisor state
+ * @param state getState() of the chip, HEALTH_STATE_UNKNOWN if it wasn't read
+ * @param b_driver_error A driver wait timed out since the last action (CC1101::error)
+ * @param now_ms Time now
+ * @return health_action_t what the radio task should do, report it done with
+ * radio_health_action_done()
+ */
+health_action_t radio_health_check(radio_health_t *health, uint8_t state, bool b_driver_error, uint32_t now_ms) {
+    health_cause_t cause = HEALTH_CAUSE_NONE;
+    uint16_t frames = health->window_good + health->window_bad;
+
+    health->last_check_ms = now_ms;
+    health->last_state = state;
+    if (state == STATE_RX || state == STATE_CALIBRATE || state == STATE_SETTLING) {
+        health->bad_states = 0;
+    } else if (state != HEALTH_STATE_UNKNOWN && health->bad_states < HEALTH_STATE_CHECKS) {
+        health->bad_states++;
+    }
+
+    if (b_driver_error) {
+        cause = HEALTH_CAUSE_DRIVER;
+    } else if (health->bad_states >= HEALTH_STATE_CHECKS) {
+        cause = HEALTH_CAUSE_STATE;
+    } else if (frames >= HEALTH_CRC_MIN_FRAMES && (uint32_t)health->window_bad * 100 >= (uint32_t)frames * HEALTH_CRC_BAD_PCT) {
+        cause = HEALTH_CAUSE_CRC;
+    } else if (now_ms - health->quiet_since_ms >= health->silence_ms) {
+        cause = HEALTH_CAUSE_SILENCE;
+    }
+
+    if (now_ms - health->window_start_ms >= HEALTH_CRC_WINDOW) {
+        health->window_start_ms = now_ms;
+        health->window_good = 0;
+        health->window_bad = 0;
+    }
+
+    // Give the last action time to work, and the counts time to build up again
+    bool b_holding = health->level != HEALTH_ACTION_NONE && now_ms - health->last_action_ms < health->silence_ms;
+    if (cause == HEALTH_CAUSE_NONE) {
+        if (health->b_outage && !b_holding) {
+            end_outage(health, now_ms);
+        }
+        return HEALTH_ACTION_NONE;
+    }
+    if (b_holding) {
+        return HEALTH_ACTION_NONE;
+    }
+
+    health->trips[cause]++;
+    health->last_cause = cause;
+    if (!health->b_outage) {
+        health->b_outage = true;
+        health->outage_start_ms = cause == HEALTH_CAUSE_SILENCE ? health->last_good_ms : now_ms;
+    }
+
+    // Restart first, reset if that didn't help or the chip isn't answering
+    health_action_t action = HEALTH_ACTION_RESTART_RX;
+    if (cause == HEALTH_CAUSE_DRIVER || health->level != HEALTH_ACTION_NONE) {
+        action = HEALTH_ACTION_RESET;
+        health->silence_ms = health->backoff_ms;
+        health->backoff_ms = health->backoff_ms * 2 < HEALTH_SILENCE_MAX ? health->backoff_ms * 2 : HEALTH_SILENCE_MAX;
+    } else {
+        health->silence_ms = HEALTH_ESCALATE;
+    }
+    health->level = action;
+    health->last_action_ms = now_ms;
+    health->quiet_since_ms = now_ms;
+    health->bad_states = 0;
+    health->window_start_ms = now_ms;
+    health->window_good = 0;
+    health->window_bad = 0;
+
+    return action;
+}
+
+
+/**
+ * @brief Record an action carried out by the radio task.
+ *
+ * @param health Supervisor state
+ * @param action From radio_health_check()
+ * @param duration_us How long it took
+ */
+void radio_health_action_done(radio_health_t *health, health_action_t action, uint32_t duration_us) {
+    if (action == HEALTH_ACTION_NONE || action >= HEALTH_ACTIONS) {
+        return;
+    }
+    health->actions[action]++;
+    health->last_action_us = duration_us;
+    if (duration_us > health->max_action_us) {
+        health->max_action_us = duration_us;
+    }
+}
+
+
+/**
+ * @brief Name of a cause for MQTT and logging.
+ *
+ * @param cause Cause
+ * @return const char* name
+ */
+const char *radio_health_cause_name(health_cause_t cause) {
+    return cause < HEALTH_CAUSES ? cause_names[cause] : "?";
+}
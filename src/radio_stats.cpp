@@ -0,0 +1,145 @@
+#include "radio_stats.h"
+#include "iboost_codec.h"
+#include "freertos/FreeRTOS.h"
+
+static radio_stats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/**
+ * @brief Find the entry for a source address, taking over an unused or the least
+ * recently heard one if it's new.
+ *
+ * @param address Source address
+ * @param now_ms Time now
+ * @return stats_source_t* entry
+ */
+static stats_source_t *find_source(uint16_t address, uint32_t now_ms) {
+    stats_source_t *victim = NULL;
+
+    for (uint8_t i = 0; i < STATS_SOURCES; i++) {
+        stats_source_t *source = &stats.sources[i];
+        if (source->frames > 0 && source->address == address) {
+            return source;
+        }
+        if (victim == NULL || (victim->frames > 0 &&
+            (source->frames == 0 || now_ms - source->last_ms > now_ms - victim->last_ms))) {
+            victim = source;
+        }
+    }
+    memset(victim, 0, sizeof(stats_source_t));
+    victim->address = address;
+    return victim;
+}
+
+
+/**
+ * @brief Count a GDO0 end of packet interrupt, call from the ISR.
+ *
+ */
+void IRAM_ATTR radio_stats_interrupt(void) {
+    portENTER_CRITICAL_ISR(&stats_mux);
+    stats.interrupts++;
+    portEXIT_CRITICAL_ISR(&stats_mux);
+}
+
+
+/**
+ * @brief Count a frame drained from the RX FIFO.
+ *
+ * @param packet Frame data
+ * @param size Frame length
+ * @param b_crc_ok CRC result
+ * @param rssi Signal strength (dBm)
+ * @param lqi Link quality (lower is better)
+ * @param now_ms Arrival time
+ */
+void radio_stats_frame(const uint8_t *packet, uint8_t size, bool b_crc_ok, int16_t rssi, uint8_t lqi, uint32_t now_ms) {
+    stats_frame_type_t type = STATS_OTHER;
+
+    if (size > 2) {
+        switch (packet[2]) {
+            case IBOOST_FRAME_SENDER:
+                type = STATS_SENDER;
+                break;
+            case IBOOST_FRAME_BUDDY:
+                type = STATS_BUDDY;
+                break;
+            case IBOOST_FRAME_MAIN_UNIT:
+                type = STATS_MAIN_UNIT;
+                break;
+        }
+    }
+
+    int rssi_bucket = constrain((rssi - STATS_RSSI_MIN) / STATS_RSSI_STEP, 0, STATS_RSSI_BUCKETS - 1);
+    int lqi_bucket = constrain(lqi / STATS_LQI_STEP, 0, STATS_LQI_BUCKETS - 1);
+
+    portENTER_CRITICAL(&stats_mux);
+    if (!b_crc_ok || size < 2) {
+        stats.crc_failures++;
+    } else if (type != STATS_OTHER && size != iboost_frame_size(packet[2])) {
+        stats.size_rejects++;
+    } else {
+        stats.frames[type]++;
+
+        stats_source_t *source = find_source((uint16_t)(packet[0] << 8 | packet[1]), now_ms);
+        source->frames++;
+        source->last_ms = now_ms;
+        source->rssi_total += rssi;
+        source->rssi[rssi_bucket]++;
+        source->lqi[lqi_bucket]++;
+    }
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+
+/**
+ * @brief Count a request sent to the main unit and its time on air.
+ *
+ * @param result How the transmission ended
+ * @param airtime_us STX to the end of packet interrupt, only used for TX_RESULT_OK
+ */
+void radio_stats_transmit(tx_result_t result, uint32_t airtime_us) {
+    portENTER_CRITICAL(&stats_mux);
+    switch (result) {
+        case TX_RESULT_OK:
+            stats.requests++;
+            stats.airtime_us += airtime_us;
+            stats.airtime_last_us = airtime_us;
+            if (airtime_us > stats.airtime_max_us) {
+                stats.airtime_max_us = airtime_us;
+            }
+        break;
+        case TX_RESULT_UNDERFLOW:
+            stats.tx_underflows++;
+        break;
+        case TX_RESULT_TIMEOUT:
+            stats.requests++;
+            stats.tx_timeouts++;
+        break;
+    }
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+
+/**
+ * @brief Count an answer to one of our requests.
+ *
+ */
+void radio_stats_response(void) {
+    portENTER_CRITICAL(&stats_mux);
+    stats.responses++;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+
+/**
+ * @brief Copy the statistics.
+ *
+ * @param copy Where to put them
+ */
+void radio_stats_snapshot(radio_stats_t *copy) {
+    portENTER_CRITICAL(&stats_mux);
+    memcpy(copy, &stats, sizeof(radio_stats_t));
+    portEXIT_CRITICAL(&stats_mux);
+}
@@ -0,0 +1,195 @@
+#include <Preferences.h>
+#include "radio_survey.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "SURVEY";
+
+static Preferences preferences;
+
+
+/**
+ * @brief Load the carrier picked by an earlier survey. Call once before radio_setup(),
+ * which applies it.
+ *
+ * @param survey Survey state to initialise
+ */
+void radio_survey_begin(radio_survey_t *survey) {
+    memset(survey, 0, sizeof(radio_survey_t));
+    survey->best = -1;
+
+    if (preferences.begin("radio", true)) {
+        survey->saved_hz = preferences.getUInt("frequency", 0);
+        survey->b_surveyed = preferences.getBool("surveyed", survey->saved_hz != 0);
+        preferences.end();
+    }
+    if (survey->saved_hz != 0) {
+        ESP_LOGI(TAG, "Saved carrier frequency: %" PRIu32 " Hz", survey->saved_hz);
+    } else if (survey->b_surveyed) {
+        ESP_LOGI(TAG, "No saved carrier frequency, the survey heard nothing");
+    } else {
+        ESP_LOGI(TAG, "No saved carrier frequency, not surveyed yet");
+    }
+}
+
+
+/**
+ * @brief Start a survey from the first step, clearing the last one's results.
+ *
+ * @param survey Survey state
+ * @param current_hz Carrier in use, kept if nothing is heard
+ * @param now_ms Time now
+ * @return uint32_t frequency of the first step (Hz)
+ */
+uint32_t radio_survey_start(radio_survey_t *survey, uint32_t current_hz, uint32_t now_ms) {
+    memset(survey->steps, 0, sizeof(survey->steps));
+    for (uint8_t i = 0; i < SURVEY_STEPS; i++) {
+        survey->steps[i].frequency = SURVEY_CENTRE_HZ + ((int32_t)i - SURVEY_STEPS / 2) * SURVEY_STEP_HZ;
+    }
+    survey->b_active = true;
+    survey->step = 0;
+    survey->best = -1;
+    survey->step_start_ms = now_ms;
+    survey->previous_hz = current_hz;
+
+    ESP_LOGI(TAG, "Surveying %" PRIu32 " to %" PRIu32 " Hz, %d s per step", survey->steps[0].frequency,
+        survey->steps[SURVEY_STEPS - 1].frequency, SURVEY_DWELL / 1000);
+    return survey->steps[0].frequency;
+}
+
+
+/**
+ * @brief Count a received frame against the step being listened to.
+ *
+ * @param survey Survey state
+ * @param b_crc_ok CRC result of the frame
+ * @param rssi_dbm RSSI of the frame
+ * @param lqi LQI of the frame
+ */
+void radio_survey_frame(radio_survey_t *survey, bool b_crc_ok, int16_t rssi_dbm, uint8_t lqi) {
+    if (!survey->b_active) {
+        return;
+    }
+    survey_step_t *step = &survey->steps[survey->step];
+    if (b_crc_ok) {
+        step->good++;
+        step->rssi_total += rssi_dbm;
+        step->lqi_total += lqi;
+    } else {
+        step->bad++;
+    }
+}
+
+
+/**
+ * @brief Whether step a did better than step b.
+ *
+ * @param a Step
+ * @param b Step
+ * @return true if a has more good frames, or as many with a better LQI or RSSI
+ */
+static bool better(const survey_step_t *a, const survey_step_t *b) {
+    if (a->good != b->good) {
+        return a->good > b->good;
+    }
+    if (radio_survey_lqi(a) != radio_survey_lqi(b)) {
+        return radio_survey_lqi(a) < radio_survey_lqi(b);
+    }
+    return radio_survey_rssi(a) > radio_survey_rssi(b);
+}
+
+
+/**
+ * @brief Pick the best step and save it in NVS if it is good enough and new. The first
+ * survey is recorded either way, so one that heard nothing isn't run again at every boot.
+ *
+ * @param survey Survey state
+ * @return uint32_t carrier to use from now on (Hz)
+ */
+static uint32_t finish(radio_survey_t *survey) {
+    survey->b_active = false;
+    survey->surveys++;
+    if (!survey->b_surveyed) {
+        if (preferences.begin("radio", false)) {
+            preferences.putBool("surveyed", true);
+            preferences.end();
+            survey->b_surveyed = true;
+        } else {
+            ESP_LOGE(TAG, "Unable to open NVS namespace");
+        }
+    }
+    for (uint8_t i = 0; i < SURVEY_STEPS; i++) {
+        if (survey->steps[i].good >= SURVEY_MIN_FRAMES && (survey->best < 0 || better(&survey->steps[i], &survey->steps[survey->best]))) {
+            survey->best = i;
+        }
+    }
+
+    if (survey->best < 0) {
+        ESP_LOGW(TAG, "Nothing heard, staying on %" PRIu32 " Hz", survey->previous_hz);
+        return survey->previous_hz;
+    }
+
+    const survey_step_t *best = &survey->steps[survey->best];
+    ESP_LOGI(TAG, "Best carrier %" PRIu32 " Hz: %u good, %u bad frames, RSSI %d dBm, LQI %u", best->frequency,
+        best->good, best->bad, radio_survey_rssi(best), radio_survey_lqi(best));
+    if (best->frequency != survey->saved_hz) {
+        if (preferences.begin("radio", false)) {
+            preferences.putUInt("frequency", best->frequency);
+            preferences.end();
+            survey->saved_hz = best->frequency;
+        } else {
+            ESP_LOGE(TAG, "Unable to open NVS namespace");
+        }
+    }
+    return best->frequency;
+}
+
+
+/**
+ * @brief Move on to the next step once the dwell time is up, and after the last one
+ * pick the best.
+ *
+ * @param survey Survey state
+ * @param now_ms Time now
+ * @param frequency Set to the carrier to tune to when returning true
+ * @return true if the carrier should change, b_active is false once the survey is over
+ */
+bool radio_survey_update(radio_survey_t *survey, uint32_t now_ms, uint32_t *frequency) {
+    if (!survey->b_active || now_ms - survey->step_start_ms < SURVEY_DWELL) {
+        return false;
+    }
+
+    const survey_step_t *step = &survey->steps[survey->step];
+    ESP_LOGI(TAG, "%" PRIu32 " Hz: %u good, %u bad frames", step->frequency, step->good, step->bad);
+    survey->step++;
+    survey->step_start_ms = now_ms;
+    if (survey->step < SURVEY_STEPS) {
+        *frequency = survey->steps[survey->step].frequency;
+    } else {
+        survey->step = SURVEY_STEPS - 1;
+        *frequency = finish(survey);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Mean RSSI of the good frames on a step.
+ *
+ * @param step Step
+ * @return int16_t dBm, 0 if none
+ */
+int16_t radio_survey_rssi(const survey_step_t *step) {
+    return step->good ? (int16_t)(step->rssi_total / step->good) : 0;
+}
+
+
+/**
+ * @brief Mean LQI of the good frames on a step, lower is better.
+ *
+ * @param step Step
+ * @return uint8_t LQI, 0 if none
+ */
+uint8_t radio_survey_lqi(const survey_step_t *step) {
+    return step->good ? (uint8_t)(step->lqi_total / step->good) : 0;
+}
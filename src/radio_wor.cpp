@@ -0,0 +1,171 @@
+#include "radio_wor.h"
+#include "radio_config.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "WOR";
+
+
+/**
+ * @brief Add the time since the last state change to the state's total.
+ *
+ * @param wor WOR state
+ * @param now_ms Time now
+ */
+static void account(radio_wor_t *wor, uint32_t now_ms) {
+    if (wor->state == WOR_STATE_RX) {
+        wor->rx_ms += now_ms - wor->since_ms;
+    } else {
+        wor->wor_ms += now_ms - wor->since_ms;
+    }
+    wor->since_ms = now_ms;
+}
+
+
+/**
+ * @brief Wake the CC1101 and listen continuously.
+ *
+ * @param radio CC1101
+ */
+static void start_rx(CC1101 &radio) {
+    radio.setIDLEstate();
+    radio.wor2rx();
+    radio.writeBurstRegister(CC1101_FSTEST, &iboost_radio_config[CC1101_FSTEST], CC1101_TEST0 - CC1101_FSTEST + 1);
+    radio.setRXstate();
+}
+
+
+/**
+ * @brief Put the CC1101 into WOR.
+ *
+ * @param radio CC1101
+ */
+static void start_wor(CC1101 &radio) {
+    radio.setIDLEstate();
+    radio.strobe(CC1101_SFRX);
+    radio.wor(WOR_EVENT0);
+}
+
+
+/**
+ * @brief Start the accounting, the radio is expected to be in RX (as radio_setup() leaves it).
+ *
+ * @param wor WOR state to initialise
+ * @param now_ms Time now
+ */
+void radio_wor_begin(radio_wor_t *wor, uint32_t now_ms) {
+    memset(wor, 0, sizeof(radio_wor_t));
+    wor->state = WOR_STATE_RX;
+    wor->since_ms = now_ms;
+    wor->window_start_ms = now_ms;
+}
+
+
+/**
+ * @brief Switch the receiver on or off according to the transmit schedule. Call with the
+ * radio semaphore held after every drain of the RX FIFO and whenever the returned time has
+ * passed. A frame caught while asleep leaves the CC1101 in RX (MCSM1 RXOFF_MODE) so after
+ * a drain it is put back into WOR if it should be asleep.
+ *
+ * @param radio CC1101
+ * @param wor WOR state
+ * @param schedule Transmit schedule, knows when traffic is due
+ * @param b_drained Frames were read from the RX FIFO
+ * @param now_ms Time now
+ * @return uint32_t time until the next call is needed (ms)
+ */
+uint32_t radio_wor_update(CC1101 &radio, radio_wor_t *wor, tx_schedule_t *schedule, bool b_drained, uint32_t now_ms) {
+    uint32_t change_ms;
+    bool b_listen = tx_schedule_listen(schedule, WOR_GUARD, now_ms, &change_ms);
+
+    if (b_listen) {
+        // The radio task leaves the radio in RX after a request, start_rx() is harmless then
+        if (wor->state != WOR_STATE_RX) {
+            account(wor, now_ms);
+            start_rx(radio);
+            wor->state = WOR_STATE_RX;
+            wor->windows++;
+            wor->window_start_ms = now_ms;
+            wor->sender_frames_at_start = schedule->sender.frames;
+            wor->b_sender_window = tx_schedule_is_locked(schedule, now_ms) && !schedule->b_is_pending;
+            if (wor->b_sender_window) {
+                wor->sender_windows++;
+            }
+        }
+    } else if (wor->state != WOR_STATE_WOR || b_drained) {
+        if (wor->state == WOR_STATE_WOR) {
+            wor->wakes++;                   // caught by the poll, back to sleep
+        } else {
+            account(wor, now_ms);
+            if (wor->b_sender_window && schedule->sender.frames == wor->sender_frames_at_start) {
+                wor->sender_missed++;
+                ESP_LOGI(TAG, "Sender frame not heard in its window (%" PRIu32 " of %" PRIu32 " missed)",
+                    wor->sender_missed, wor->sender_windows);
+            }
+            wor->state = WOR_STATE_WOR;
+        }
+        start_wor(radio);
+    }
+
+    return change_ms;
+}
+
+
+/**
+ * @brief Wake the CC1101 to transmit, with the registers lost asleep put back. It is left
+ * listening for the reply, radio_wor_update() puts it back into WOR when the schedule says.
+ * Call with the radio held before touching the TX FIFO.
+ *
+ * @param radio CC1101
+ * @param wor WOR state
+ * @param now_ms Time now
+ */
+void radio_wor_wake(CC1101 &radio, radio_wor_t *wor, uint32_t now_ms) {
+    if (wor->state == WOR_STATE_RX) {
+        return;
+    }
+    start_rx(radio);
+    radio_wor_listening(wor, now_ms);
+}
+
+
+/**
+ * @brief Record that the CC1101 has been put into RX outside of radio_wor_update(), e.g.
+ * reset and set up again, so the accounting matches it and the next update puts it back
+ * into WOR if it should be asleep.
+ *
+ * @param wor WOR state
+ * @param now_ms Time now
+ */
+void radio_wor_listening(radio_wor_t *wor, uint32_t now_ms) {
+    if (wor->state == WOR_STATE_RX) {
+        return;
+    }
+    account(wor, now_ms);
+    wor->state = WOR_STATE_RX;
+    wor->windows++;
+    wor->window_start_ms = now_ms;
+    wor->b_sender_window = false;
+}
+
+
+/**
+ * @brief Share of the time the receiver has been on, counting the current state up to
+ * now. Changes nothing, so it can be used on a copy taken by the radio task.
+ *
+ * @param wor WOR state
+ * @param now_ms Time now
+ * @return float duty cycle 0..1
+ */
+float radio_wor_duty_cycle(const radio_wor_t *wor, uint32_t now_ms) {
+    uint64_t rx_ms = wor->rx_ms;
+    uint64_t wor_ms = wor->wor_ms;
+
+    if (wor->state == WOR_STATE_RX) {
+        rx_ms += now_ms - wor->since_ms;
+    } else {
+        wor_ms += now_ms - wor->since_ms;
+    }
+    uint64_t total = rx_ms + wor_ms;
+    return total ? (float)rx_ms / total : 1.0f;
+}
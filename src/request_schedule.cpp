@@ -0,0 +1,203 @@
+#include <time.h>
+#include "request_schedule.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "REQUEST";
+
+#define CLOCK_ROLLOVER_HOLDOFF  7200000     // Main unit already rolled over this recently, ignore our clock (ms)
+
+static portMUX_TYPE schedule_mux = portMUX_INITIALIZER_UNLOCKED;     // Receive and transmit tasks both use the schedule
+
+
+/**
+ * @brief Find the counter for a request code.
+ *
+ * @param schedule Schedule
+ * @param code SAVED_*
+ * @return request_counter_t* counter, NULL if the code isn't one of ours
+ */
+static request_counter_t *find_counter(request_schedule_t *schedule, uint8_t code) {
+    if (code < SAVED_TODAY || code > SAVED_TOTAL) {
+        return NULL;
+    }
+    return &schedule->counters[code - SAVED_TODAY];
+}
+
+
+/**
+ * @brief Midnight, everything apart from today has moved on a day.
+ *
+ * @param schedule Schedule
+ */
+static void rollover(request_schedule_t *schedule) {
+    for (uint8_t i = 0; i < REQUEST_COUNTERS; i++) {
+        if (schedule->counters[i].code != SAVED_TODAY) {
+            schedule->counters[i].b_is_valid = false;
+        }
+    }
+    schedule->rollovers++;
+}
+
+
+/**
+ * @brief Local day of the year, once SNTP has set the clock.
+ *
+ * @return int day of the year, -1 if the clock isn't set
+ */
+static int local_day(void) {
+    time_t now = time(NULL);
+    struct tm local;
+
+    localtime_r(&now, &local);
+    if (local.tm_year + 1900 < 2020) {
+        return -1;
+    }
+    return local.tm_yday;
+}
+
+
+/**
+ * @brief Set up the counters, all invalid so the first requests are a full refresh.
+ *
+ * @param schedule Schedule to initialise
+ */
+void request_schedule_begin(request_schedule_t *schedule) {
+    memset(schedule, 0, sizeof(request_schedule_t));
+    for (uint8_t i = 0; i < REQUEST_COUNTERS; i++) {
+        schedule->counters[i].code = SAVED_TODAY + i;
+        schedule->counters[i].budget_ms = REQUEST_TOTALS_BUDGET;
+    }
+    find_counter(schedule, SAVED_TODAY)->budget_ms = REQUEST_TODAY_BUDGET;
+    find_counter(schedule, SAVED_YESTERDAY)->budget_ms = REQUEST_DAILY_BUDGET;
+    schedule->day = -1;
+}
+
+
+/**
+ * @brief Choose the next request, checking the local clock for midnight first. Invalid
+ * counters come first (least recently requested first, at most once per REQUEST_RETRY
+ * each), then the counter furthest past its budget, otherwise today.
+ *
+ * @param schedule Schedule
+ * @param now_ms Time now
+ * @return uint8_t request code (SAVED_*)
+ */
+uint8_t request_schedule_next(request_schedule_t *schedule, uint32_t now_ms) {
+    int day = local_day();
+    bool b_midnight = false;
+
+    portENTER_CRITICAL(&schedule_mux);
+    if (day >= 0) {
+        if (schedule->day >= 0 && schedule->day != day &&
+            (schedule->last_device_rollover_ms == 0 || now_ms - schedule->last_device_rollover_ms >= CLOCK_ROLLOVER_HOLDOFF)) {
+            rollover(schedule);
+            b_midnight = true;
+        }
+        schedule->day = day;
+    }
+
+    request_counter_t *choice = NULL;
+    uint32_t longest_wait = 0;
+    for (uint8_t i = 0; i < REQUEST_COUNTERS; i++) {
+        request_counter_t *counter = &schedule->counters[i];
+        uint32_t wait = counter->requested_ms ? now_ms - counter->requested_ms : UINT32_MAX;
+        if (!counter->b_is_valid && wait >= REQUEST_RETRY && (choice == NULL || wait > longest_wait)) {
+            longest_wait = wait;
+            choice = counter;
+        }
+    }
+
+    if (choice == NULL) {
+        uint32_t most_overdue = 0;
+        for (uint8_t i = 0; i < REQUEST_COUNTERS; i++) {
+            request_counter_t *counter = &schedule->counters[i];
+            uint32_t age = now_ms - counter->updated_ms;
+            if (counter->b_is_valid && counter->budget_ms > 0 && age >= counter->budget_ms &&
+                age - counter->budget_ms >= most_overdue) {
+                most_overdue = age - counter->budget_ms;
+                choice = counter;
+            }
+        }
+    }
+    uint8_t code = choice ? choice->code : SAVED_TODAY;
+    portEXIT_CRITICAL(&schedule_mux);
+
+    if (b_midnight) {
+        ESP_LOGI(TAG, "Midnight, refreshing the daily counters");
+    }
+    return code;
+}
+
+
+/**
+ * @brief Record a request that has been sent.
+ *
+ * @param schedule Schedule
+ * @param code Request code sent
+ * @param now_ms Time the request went out
+ */
+void request_schedule_sent(request_schedule_t *schedule, uint8_t code, uint32_t now_ms) {
+    portENTER_CRITICAL(&schedule_mux);
+    request_counter_t *counter = find_counter(schedule, code);
+    if (counter != NULL) {
+        counter->requested_ms = now_ms ? now_ms : 1;       // 0 means never requested
+        counter->requests++;
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+}
+
+
+/**
+ * @brief Record an answer from the main unit, to our request or a real buddy's. "Today"
+ * going down means the main unit has passed midnight.
+ *
+ * @param schedule Schedule
+ * @param code Request code in the answer
+ * @param value Counter value (Wh)
+ * @param now_ms Arrival time
+ */
+void request_schedule_answered(request_schedule_t *schedule, uint8_t code, long value, uint32_t now_ms) {
+    bool b_rollover = false;
+
+    portENTER_CRITICAL(&schedule_mux);
+    request_counter_t *counter = find_counter(schedule, code);
+    if (counter != NULL) {
+        if (code == SAVED_TODAY && counter->b_is_valid && value < counter->value) {
+            rollover(schedule);
+            schedule->last_device_rollover_ms = now_ms ? now_ms : 1;
+            b_rollover = true;
+        }
+        counter->value = value;
+        counter->updated_ms = now_ms;
+        counter->answers++;
+        counter->b_is_valid = true;
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+
+    if (b_rollover) {
+        ESP_LOGI(TAG, "Saved today went back to %ld Wh, refreshing the daily counters", value);
+    }
+}
+
+
+/**
+ * @brief Age of a counter.
+ *
+ * @param schedule Schedule
+ * @param code SAVED_*
+ * @param now_ms Time now
+ * @return int32_t seconds since the last answer, -1 if not valid
+ */
+int32_t request_schedule_age(request_schedule_t *schedule, uint8_t code, uint32_t now_ms) {
+    int32_t age = -1;
+
+    portENTER_CRITICAL(&schedule_mux);
+    request_counter_t *counter = find_counter(schedule, code);
+    if (counter != NULL && counter->b_is_valid) {
+        age = (int32_t)((now_ms - counter->updated_ms) / 1000);
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+
+    return age;
+}
@@ -31,6 +31,8 @@
 #include "main.h"
 #include "TFT_eSPI.h"
 #include "my_ringbuf.h"
+#include "trace.h"
+#include "latency.h"
 
 /*
     CLOG_ENABLE Needs to be defined before cLog.h is included.  
@@ -173,6 +175,8 @@ static bool b_update_logging = false;
 static char time_buffer[9] = {0};       // buffer for time on the display
 //
 
+static int64_t pending_arrival_us[LATENCY_KINDS];   // Oldest frame per event type waiting to be drawn, 0 if none
+
 // structure to hold all solar related information and flags. 
 typedef struct {
     int pv_now;                  // Current solar PV generation (Watts)
@@ -236,6 +240,8 @@ static void print_pv_today(void);
 static void print_pv_now(void);
 static void print_wt_today(void);
 static void print_wt_now(void);
+static bool redraw_pending(sl_event_t event);
+static void drawn(sl_event_t event);
 
 // Screensaver related
 typedef enum {
@@ -381,30 +387,43 @@ void display_task(void *parameter) {
             // }
         } else { // check flags and update display as appropriate
             if (solar.b_update_pv_today) {
+                TRACE_BEGIN(TRACE_DRAW, SL_TODAY);
                 print_pv_today();
+                TRACE_END(TRACE_DRAW, SL_TODAY);
+                drawn(SL_TODAY);
 
                 solar.b_update_pv_today = false;
             }
 
             if (solar.b_update_pv_now) {
+                TRACE_BEGIN(TRACE_DRAW, SL_NOW);
                 print_pv_now();
+                TRACE_END(TRACE_DRAW, SL_NOW);
+                drawn(SL_NOW);
 
                 solar.b_update_pv_now = false;
             }
 
             if (solar.b_update_wt_now) {
+                TRACE_BEGIN(TRACE_DRAW, SL_WT_NOW);
                 print_wt_now();
+                TRACE_END(TRACE_DRAW, SL_WT_NOW);
+                drawn(SL_WT_NOW);
 
                 solar.b_update_wt_now = false;
             }
 
             if (solar.b_update_wt_today) {
+                TRACE_BEGIN(TRACE_DRAW, SL_WT_TODAY);
                 print_wt_today();
+                TRACE_END(TRACE_DRAW, SL_WT_TODAY);
+                drawn(SL_WT_TODAY);
                 
                 solar.b_update_wt_today = false;
             }
 
             if (solar.b_update_wt_colour) {
+                TRACE_BEGIN(TRACE_DRAW, SL_WT_STATUS);
                 switch (screen_saver_colour_shift) {
                     case SS_COLD: // cold
                         fill_water_tank(0);
@@ -418,12 +437,15 @@ void display_task(void *parameter) {
                         fill_water_tank(2);
                     break;
                 }
+                TRACE_END(TRACE_DRAW, SL_WT_STATUS);
+                drawn(SL_WT_STATUS);
 
                 solar.b_update_wt_colour = false;
             }
 
             if (solar.b_update_grid) {
                 // TODO need to move to own function and a sprite
+                TRACE_BEGIN(TRACE_DRAW, SL_IMPORT);
                 tft.setCursor(312, 86, 2);   // position and font
                 tft.setTextColor(TFT_FOREGROUND, TFT_BACKGROUND);
                 tft.setTextSize(1);
@@ -433,11 +455,15 @@ void display_task(void *parameter) {
                     tft.print(solar.export_now);
                 }
                 tft.print(" W   ");
+                TRACE_END(TRACE_DRAW, SL_IMPORT);
+                drawn(SL_IMPORT);
+                drawn(SL_EXPORT);
 
                 solar.b_update_grid = false;
             }
 
             if (b_update_logging) {
+                TRACE_BEGIN(TRACE_DRAW, 0xff);
                 log_sprite.fillSprite(TFT_BACKGROUND);
                 log_sprite.setTextColor(TFT_FOREGROUND, TFT_BACKGROUND);
                 log_sprite.setTextFont(1);
@@ -448,6 +474,7 @@ void display_task(void *parameter) {
                 }
 
                 log_sprite.pushSprite(0, 258);
+                TRACE_END(TRACE_DRAW, 0xff);
 
                 b_update_logging = false;
 
@@ -460,12 +487,18 @@ void display_task(void *parameter) {
 
             if (solar.b_update_lqi) {
                 solar.b_update_lqi = false;
+                TRACE_BEGIN(TRACE_DRAW, SL_LQI);
                 draw_lqi_signal_strength(LQI_X, LQI_Y, solar.lqi);
+                TRACE_END(TRACE_DRAW, SL_LQI);
+                drawn(SL_LQI);
             }
 
             if (solar.b_update_battery) {
                 solar.b_update_battery = false;
+                TRACE_BEGIN(TRACE_DRAW, SL_BATTERY);
                 draw_horizontal_battery(BATTERY_X, BATTERY_Y, solar.sender_battery_status);
+                TRACE_END(TRACE_DRAW, SL_BATTERY);
+                drawn(SL_BATTERY);
             }
 
             if (millis() - check_animation >= update_animation) {  // time has elapsed, update display
@@ -647,6 +680,7 @@ static void electricity_event_handler(void) {
 
     // Receive information from other tasks to display on the screen
     if (xQueueReceive(g_main_queue, &electricity_event, (TickType_t)0) == pdPASS) {
+        TRACE_INSTANT(TRACE_DISPLAY_RECEIVE, electricity_event.event);
         ESP_LOGI(TAGS, "Electricity Event: %d, watts: %f, info: %d", 
                     electricity_event.event, electricity_event.value, electricity_event.info);
         
@@ -822,6 +856,48 @@ static void electricity_event_handler(void) {
                 solar.b_update_lqi = true;
             break;
         }
+
+        // Frame to pixels latency, from the oldest frame not yet drawn
+        if (electricity_event.arrival_us != 0 && !b_screen_saver_is_active && redraw_pending(electricity_event.event) &&
+            pending_arrival_us[electricity_event.event] == 0) {
+            pending_arrival_us[electricity_event.event] = electricity_event.arrival_us;
+        }
+    }
+}
+
+
+/**
+ * @brief Is there a redraw waiting for an event type?
+ * 
+ * @param event Event type
+ * @return true if its update flag is set
+ */
+static bool redraw_pending(sl_event_t event) {
+    switch (event) {
+        case SL_EXPORT:
+        case SL_IMPORT:     return solar.b_update_grid;
+        case SL_NOW:        return solar.b_update_pv_now;
+        case SL_TODAY:      return solar.b_update_pv_today;
+        case SL_WT_NOW:     return solar.b_update_wt_now;
+        case SL_WT_TODAY:   return solar.b_update_wt_today;
+        case SL_BATTERY:    return solar.b_update_battery;
+        case SL_WT_STATUS:  return solar.b_update_wt_colour;
+        case SL_LQI:        return solar.b_update_lqi;
+    }
+    return false;
+}
+
+
+/**
+ * @brief An event type's value is on the screen, add the time since its frame arrived to
+ * the display latency histogram.
+ * 
+ * @param event Event type
+ */
+static void drawn(sl_event_t event) {
+    if (pending_arrival_us[event] != 0) {
+        latency_record(LATENCY_DISPLAY, event, pending_arrival_us[event]);
+        pending_arrival_us[event] = 0;
     }
 }
 
@@ -941,6 +1017,7 @@ static void initialise_screen(void) {
  */
 static void setup_screen_saver(void) {
     b_screen_saver_is_active = true;
+    memset(pending_arrival_us, 0, sizeof(pending_arrival_us));     // nothing is drawn until it stops
 
     tft.fillScreen(TFT_BLACK);
 
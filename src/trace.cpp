@@ -0,0 +1,94 @@
+#include "trace.h"
+
+#ifdef TRACE    // declared in platformio.ini build_flags, nothing here otherwise
+
+#include <Arduino.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TRACE_ENTRIES_PER_LINE  8
+
+// Indexed by trace_event_t
+static const char *trace_names[TRACE_EVENTS] = {"gdo0", "strobe", "getPackets", "sendPacket", "radio command",
+    "pool submit", "pool wait", "decode", "mqtt wait", "json", "publish", "display send", "display receive", "draw"};
+
+static trace_entry_t ring[TRACE_ENTRIES];
+static uint32_t recorded = 0;               // Entries ever written, the next goes at recorded % TRACE_ENTRIES
+static bool b_paused = false;               // While dumping
+static TaskHandle_t tasks[TRACE_TASKS];     // Task number is the index, in order of first entry
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/**
+ * @brief Add an entry to the ring, use the TRACE_* macros rather than calling this.
+ * Safe from interrupt handlers.
+ *
+ * @param event trace_event_t
+ * @param phase TRACE_PHASE_*
+ * @param arg Argument, see trace_event_t
+ */
+void IRAM_ATTR trace_record(uint8_t event, uint8_t phase, uint16_t arg) {
+    uint32_t now_us;
+    uint8_t task = TRACE_ISR;
+
+    portENTER_CRITICAL_SAFE(&trace_mux);
+    now_us = (uint32_t)esp_timer_get_time();    // in the lock, so the ring stays in time order
+    if (!xPortInIsrContext()) {
+        TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+        for (task = 0; task < TRACE_TASKS - 1 && tasks[task] != handle && tasks[task] != NULL; task++) {
+        }
+        tasks[task] = handle;       // The last row is shared once the table is full
+    }
+    if (!b_paused) {
+        trace_entry_t *entry = &ring[recorded++ & (TRACE_ENTRIES - 1)];
+        entry->time_us = now_us;
+        entry->event = event;
+        entry->flags = phase | (xPortGetCoreID() << 2) | (task << 4);
+        entry->arg = arg;
+    }
+    portEXIT_CRITICAL_SAFE(&trace_mux);
+}
+
+
+/**
+ * @brief Print the ring, oldest first, to the serial port for
+ * support/host/trace_to_chrome.py. Recording stops while it runs (a second or so at
+ * 115200 baud), so keep it out of time critical tasks.
+ *
+ */
+void trace_dump(void) {
+    uint32_t count, first;
+
+    portENTER_CRITICAL(&trace_mux);
+    b_paused = true;
+    count = recorded < TRACE_ENTRIES ? recorded : TRACE_ENTRIES;
+    first = recorded - count;
+    portEXIT_CRITICAL(&trace_mux);
+
+    Serial.printf("trace: begin %" PRIu32 " %" PRIu32 "\n", count, first);      // entries, overwritten
+    for (uint8_t i = 0; i < TRACE_EVENTS; i++) {
+        Serial.printf("trace: event %u %s\n", i, trace_names[i]);
+    }
+    for (uint8_t i = 0; i < TRACE_TASKS && tasks[i] != NULL; i++) {
+        Serial.printf("trace: task %u %s\n", i, pcTaskGetName(tasks[i]));
+    }
+    Serial.printf("trace: task %u ISR\n", TRACE_ISR);
+
+    // time (8 hex digits), event (2), flags (2), arg (4)
+    for (uint32_t i = 0; i < count; i++) {
+        const trace_entry_t *entry = &ring[(first + i) & (TRACE_ENTRIES - 1)];
+        if (i % TRACE_ENTRIES_PER_LINE == 0) {
+            Serial.print(i ? "\ntrace:" : "trace:");
+        }
+        Serial.printf(" %08" PRIx32 "%02x%02x%04x", entry->time_us, entry->event, entry->flags, entry->arg);
+    }
+    Serial.printf("%strace: end\n", count ? "\n" : "");
+
+    portENTER_CRITICAL(&trace_mux);
+    b_paused = false;
+    portEXIT_CRITICAL(&trace_mux);
+}
+
+#endif
@@ -0,0 +1,319 @@
+#include "tx_schedule.h"
+#include "iboost_codec.h"
+#include "esp_log.h"
+
+// Logging tag
+static const char* TAG = "TX_SCHEDULE";
+
+static const uint16_t slot_offsets[TX_SLOTS] = TX_SLOT_OFFSETS;
+static portMUX_TYPE schedule_mux = portMUX_INITIALIZER_UNLOCKED;     // Receive and transmit tasks both use the schedule
+
+
+/**
+ * @brief Fold a frame arrival into the period estimate of its type. Intervals are
+ * divided by the number of periods they span so missed frames don't upset the estimate,
+ * and intervals that don't fit restart the lock.
+ *
+ * @param traffic Timing of the frame type
+ * @param now_ms Arrival time
+ */
+static void track_traffic(tx_traffic_t *traffic, uint32_t now_ms) {
+    if (traffic->frames > 0) {
+        uint32_t interval = now_ms - traffic->last_ms;
+
+        if (traffic->period_ms == 0) {
+            if (interval >= TX_PERIOD_MIN && interval <= TX_PERIOD_MAX) {
+                traffic->period_ms = interval;
+            }
+        } else {
+            uint32_t cycles = (interval + traffic->period_ms / 2) / traffic->period_ms;
+            int32_t error = (int32_t)(interval - cycles * traffic->period_ms);
+
+            if (cycles >= 1 && cycles <= 6 && (uint32_t)abs(error) < traffic->period_ms / 16) {
+                traffic->period_ms += error / (int32_t)cycles / 4;
+                if (traffic->matches < 255) traffic->matches++;
+            } else if (cycles == 0) {
+                return;                 // Retry or repeat inside the period, keep the phase
+            } else {
+                traffic->matches = 0;
+                traffic->period_ms = (interval >= TX_PERIOD_MIN && interval <= TX_PERIOD_MAX) ? interval : 0;
+            }
+        }
+    }
+    traffic->last_ms = now_ms;
+    traffic->frames++;
+}
+
+
+/**
+ * @brief Whether the timing of a frame type can be used to predict the next frame.
+ *
+ * @param traffic Timing of the frame type
+ * @param now_ms Time now
+ * @return true if the period is locked and the last frame is recent
+ */
+static bool is_traffic_locked(const tx_traffic_t *traffic, uint32_t now_ms) {
+    return traffic->period_ms != 0 && traffic->matches >= TX_LOCK_COUNT &&
+        now_ms - traffic->last_ms < 4 * traffic->period_ms;
+}
+
+
+/**
+ * @brief Whether a transmission at time_ms would be within TX_GUARD of an expected
+ * frame.
+ *
+ * @param traffic Timing of the frame type
+ * @param time_ms Proposed transmit time
+ * @param now_ms Time now
+ * @return true if it clashes
+ */
+static bool is_clash(const tx_traffic_t *traffic, uint32_t time_ms, uint32_t now_ms) {
+    if (!is_traffic_locked(traffic, now_ms)) {
+        return false;
+    }
+    uint32_t phase = (time_ms - traffic->last_ms) % traffic->period_ms;
+    return phase < TX_GUARD || traffic->period_ms - phase < TX_GUARD;
+}
+
+
+/**
+ * @brief Pick the slot for the next request. Each slot is tried TX_SLOT_MIN_TRIES times,
+ * after that the one with the best answer rate is used, with every TX_EXPLORE_EVERY-th
+ * request going to the least used slot to keep the others up to date.
+ *
+ * @param schedule Schedule
+ * @return uint8_t slot index
+ */
+static uint8_t choose_slot(const tx_schedule_t *schedule) {
+    uint8_t least_used = 0;
+    for (uint8_t i = 1; i < TX_SLOTS; i++) {
+        if (schedule->slots[i].sent < schedule->slots[least_used].sent) least_used = i;
+    }
+    if (schedule->slots[least_used].sent < TX_SLOT_MIN_TRIES || schedule->requests % TX_EXPLORE_EVERY == 0) {
+        return least_used;
+    }
+
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < TX_SLOTS; i++) {
+        // answered[i] / sent[i] > answered[best] / sent[best]
+        if ((uint64_t)schedule->slots[i].answered * schedule->slots[best].sent >
+            (uint64_t)schedule->slots[best].answered * schedule->slots[i].sent) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * @brief Reset the schedule.
+ *
+ * @param schedule Schedule to initialise
+ * @param interval_ms Time between requests, also used while there is no lock
+ */
+void tx_schedule_begin(tx_schedule_t *schedule, uint32_t interval_ms) {
+    memset(schedule, 0, sizeof(tx_schedule_t));
+    for (uint8_t i = 0; i < TX_SLOTS; i++) {
+        schedule->slots[i].offset_ms = slot_offsets[i];
+    }
+    schedule->interval_ms = interval_ms;
+}
+
+
+/**
+ * @brief Record the arrival of an iBoost frame. Only frames from the tracked unit are used
+ * for timing. A main unit frame from the unit we asked, carrying the request we sent,
+ * within TX_RESPONSE_WINDOW counts as an answer for the slot used.
+ *
+ * @param schedule Schedule
+ * @param packet Frame with a good CRC
+ * @param size Frame length
+ * @param now_ms Arrival time
+ * @return true if the frame answered our request
+ */
+bool tx_schedule_observe(tx_schedule_t *schedule, const uint8_t *packet, uint8_t size, uint32_t now_ms) {
+    bool b_answered = false;
+
+    if (size < 3) {
+        return false;
+    }
+
+    uint16_t address = (uint16_t)(packet[0] << 8 | packet[1]);
+
+    portENTER_CRITICAL(&schedule_mux);
+    bool b_tracked = schedule->address == 0 || address == schedule->address;
+    switch (packet[2]) {
+        case IBOOST_FRAME_SENDER:
+            if (b_tracked) track_traffic(&schedule->sender, now_ms);
+            break;
+        case IBOOST_FRAME_BUDDY:
+            if (b_tracked) track_traffic(&schedule->buddy, now_ms);
+            break;
+        case IBOOST_FRAME_MAIN_UNIT:
+            if (b_tracked) track_traffic(&schedule->main_unit, now_ms);
+            if (schedule->b_is_pending && size > IBOOST_MAIN_REQUEST.offset &&
+                packet[IBOOST_MAIN_REQUEST.offset] == schedule->pending_request &&
+                address == schedule->pending_address &&
+                now_ms - schedule->last_tx_ms <= TX_RESPONSE_WINDOW) {
+                schedule->slots[schedule->pending_slot].answered++;
+                schedule->b_is_pending = false;
+                b_answered = true;
+            }
+            break;
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+
+    return b_answered;
+}
+
+
+/**
+ * @brief Time until the next request should be sent. With the sender locked this is the
+ * chosen slot in the first sender cycle at least 3/4 of interval_ms after the last
+ * request, skipping cycles where a real buddy request (and so a main unit answer) is
+ * expected in the slot. Main unit frames are not used, they mostly answer us.
+ * Without a lock requests are interval_ms apart.
+ *
+ * @param schedule Schedule
+ * @param now_ms Time now
+ * @param slot Set to the slot to pass to tx_schedule_sent()
+ * @return uint32_t delay (ms)
+ */
+uint32_t tx_schedule_next(tx_schedule_t *schedule, uint32_t now_ms, uint8_t *slot) {
+    uint32_t wait_ms;
+
+    portENTER_CRITICAL(&schedule_mux);
+    uint32_t earliest = now_ms;
+    if (schedule->requests > 0 && (int32_t)(schedule->last_tx_ms + schedule->interval_ms * 3 / 4 - now_ms) > 0) {
+        earliest = schedule->last_tx_ms + schedule->interval_ms * 3 / 4;
+    }
+
+    if (is_traffic_locked(&schedule->sender, now_ms)) {
+        const tx_traffic_t *sender = &schedule->sender;
+        *slot = choose_slot(schedule);
+
+        uint32_t time_ms = sender->last_ms + schedule->slots[*slot].offset_ms;
+        while ((int32_t)(time_ms - earliest) < 0) {
+            time_ms += sender->period_ms;
+        }
+        for (uint8_t cycle = 0; cycle < 4; cycle++) {
+            if (!is_clash(&schedule->buddy, time_ms, now_ms)) {
+                break;
+            }
+            time_ms += sender->period_ms;
+        }
+        wait_ms = time_ms - now_ms;
+    } else {
+        *slot = TX_SLOT_FALLBACK;
+        if (schedule->requests == 0 || (int32_t)(schedule->last_tx_ms + schedule->interval_ms - now_ms) <= 0) {
+            wait_ms = 0;
+        } else {
+            wait_ms = schedule->last_tx_ms + schedule->interval_ms - now_ms;
+        }
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+
+    return wait_ms;
+}
+
+
+/**
+ * @brief Follow a different unit's traffic, what was learnt about the last one is dropped.
+ *
+ * @param schedule Schedule
+ * @param address Unit address, 0 for any
+ */
+void tx_schedule_set_address(tx_schedule_t *schedule, uint16_t address) {
+    portENTER_CRITICAL(&schedule_mux);
+    if (address != schedule->address) {
+        schedule->address = address;
+        memset(&schedule->sender, 0, sizeof(tx_traffic_t));
+        memset(&schedule->buddy, 0, sizeof(tx_traffic_t));
+        memset(&schedule->main_unit, 0, sizeof(tx_traffic_t));
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+}
+
+
+/**
+ * @brief Record a request that has been sent.
+ *
+ * @param schedule Schedule
+ * @param slot Slot returned by tx_schedule_next()
+ * @param address Unit the request was sent to
+ * @param request Request code sent
+ * @param now_ms Time the request went out
+ */
+void tx_schedule_sent(tx_schedule_t *schedule, uint8_t slot, uint16_t address, uint8_t request, uint32_t now_ms) {
+    portENTER_CRITICAL(&schedule_mux);
+    if (slot > TX_SLOT_FALLBACK) {
+        slot = TX_SLOT_FALLBACK;
+    }
+    schedule->slots[slot].sent++;
+    schedule->requests++;
+    schedule->last_tx_ms = now_ms;
+    schedule->pending_slot = slot;
+    schedule->pending_request = request;
+    schedule->pending_address = address;
+    schedule->b_is_pending = true;
+    portEXIT_CRITICAL(&schedule_mux);
+
+    ESP_LOGD(TAG, "Request 0x%02x in slot %d", request, slot);
+}
+
+
+/**
+ * @brief Whether requests are being placed relative to the sender.
+ *
+ * @param schedule Schedule
+ * @param now_ms Time now
+ * @return true if the sender period is locked
+ */
+bool tx_schedule_is_locked(tx_schedule_t *schedule, uint32_t now_ms) {
+    portENTER_CRITICAL(&schedule_mux);
+    bool b_locked = is_traffic_locked(&schedule->sender, now_ms);
+    portEXIT_CRITICAL(&schedule_mux);
+    return b_locked;
+}
+
+
+/**
+ * @brief Whether the receiver needs to be on: around the expected sender frame (until it
+ * arrives) and while waiting for the answer to our request. Without a lock on the sender
+ * nothing can be predicted so the answer is always yes.
+ *
+ * @param schedule Schedule
+ * @param guard_ms Listen this long either side of the expected sender frame
+ * @param now_ms Time now
+ * @param change_ms Set to the time until the answer changes (ms)
+ * @return true if the receiver should be on
+ */
+bool tx_schedule_listen(tx_schedule_t *schedule, uint32_t guard_ms, uint32_t now_ms, uint32_t *change_ms) {
+    bool b_listen;
+
+    portENTER_CRITICAL(&schedule_mux);
+    const tx_traffic_t *sender = &schedule->sender;
+    if (!is_traffic_locked(sender, now_ms) || 2 * guard_ms >= sender->period_ms) {
+        b_listen = true;
+        *change_ms = TX_LISTEN_RECHECK;
+    } else if (schedule->b_is_pending && now_ms - schedule->last_tx_ms < TX_RESPONSE_WINDOW) {
+        b_listen = true;
+        *change_ms = TX_RESPONSE_WINDOW - (now_ms - schedule->last_tx_ms);
+    } else {
+        uint32_t since_last = now_ms - sender->last_ms;
+        uint32_t phase = since_last % sender->period_ms;      // time since the expected frame
+        if (phase >= sender->period_ms - guard_ms) {
+            b_listen = true;                    // frame due
+            *change_ms = sender->period_ms - phase + guard_ms;
+        } else if (phase < guard_ms && since_last >= sender->period_ms) {
+            b_listen = true;                    // frame late
+            *change_ms = guard_ms - phase;
+        } else {
+            b_listen = false;                   // heard it (or gave up), nothing until the next one
+            *change_ms = sender->period_ms - guard_ms - phase;
+        }
+    }
+    portEXIT_CRITICAL(&schedule_mux);
+
+    return b_listen;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+    Minimal Arduino core for building the CC1101 driver on a Linux host, see
+    support/host/README. Time is virtual: it only moves when the code under test
+    clocks SPI bytes, delays or reads the clock, so a run is repeatable and the
+    reported times are the simulated bus cost rather than host speed.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"     // the ESP32 core's Arduino.h brings in FreeRTOS too
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+
+#define HEX     16
+#define DEC     10
+
+// ESP32 Wroom 32 VSPI pins, as used by main.cpp
+#define SS      5
+#define MISO    19
+
+// Virtual time in nanoseconds since start up
+extern uint64_t sim_now_ns;
+
+// Moves virtual time forward
+void sim_advance_ns(uint64_t ns);
+
+// Pin hooks, the fake CC1101 watches CSN and drives MISO (SO) through these
+typedef void (*sim_pin_write_t)(uint8_t pin, uint8_t level);
+typedef int (*sim_pin_read_t)(uint8_t pin);
+extern sim_pin_write_t sim_pin_write;
+extern sim_pin_read_t sim_pin_read;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+unsigned long micros(void);
+unsigned long millis(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
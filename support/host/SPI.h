@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+    Host stand in for the Arduino SPIClass. The transfer calls are virtual so a
+    simulated peripheral (FakeCC1101) can sit behind the SPIClass& the CC1101
+    constructor takes.
+*/
+
+#include "Arduino.h"
+
+class SPIClass {
+    public:
+        virtual ~SPIClass() {}
+
+        virtual void begin() {}
+        virtual uint8_t transfer(uint8_t data) { return 0xFF; }
+
+        // Same signature as the ESP32 core, used when CC1101_BLOCK_TRANSFER is defined
+        virtual void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size) {
+            for (uint32_t i = 0; i < size; i++) {
+                uint8_t value = transfer(data ? data[i] : 0xFF);
+                if (out) out[i] = value;
+            }
+        }
+};
+
+// Nothing is attached, a fake peripheral is passed to the CC1101 constructor instead
+extern SPIClass SPI;
@@ -0,0 +1,45 @@
+#include "Arduino.h"
+#include "SPI.h"
+
+// Reading the clock or a pin costs a little time so polling loops always make progress
+#define CLOCK_READ_NS   100
+
+uint64_t sim_now_ns = 0;
+sim_pin_write_t sim_pin_write = NULL;
+sim_pin_read_t sim_pin_read = NULL;
+
+SPIClass SPI;
+
+void sim_advance_ns(uint64_t ns) {
+    sim_now_ns += ns;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+    if (sim_pin_write) sim_pin_write(pin, level);
+}
+
+int digitalRead(uint8_t pin) {
+    sim_advance_ns(CLOCK_READ_NS);
+    return sim_pin_read ? sim_pin_read(pin) : LOW;
+}
+
+unsigned long micros(void) {
+    sim_advance_ns(CLOCK_READ_NS);
+    return (unsigned long)(sim_now_ns / 1000);
+}
+
+unsigned long millis(void) {
+    sim_advance_ns(CLOCK_READ_NS);
+    return (unsigned long)(sim_now_ns / 1000000);
+}
+
+void delay(uint32_t ms) {
+    sim_advance_ns((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim_advance_ns((uint64_t)us * 1000);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+    Parser for the frames captured in notes/packet.txt, shared by the host tools.
+
+    Frame: 23,b3,22,00,...,00,len=37 RSSI=-51 LQI=4
+
+    The hex bytes are the payload as getPacket() returns it (address, frame type, data),
+    without the length byte or the appended status bytes.
+
+    rtl_433 with the flex decoder in notes/notes.txt prints each frame as the bits after
+    the sync word, in the text output as
+
+    codes     : {352}2523b32200...
+
+    and the same "{bits}hex" string in its JSON output. Those start with the length byte
+    and end with the CRC, there is no RSSI or LQI.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t data[64];
+    uint8_t size;
+    int16_t rssi;           // dBm, 0 if not in the capture
+    uint8_t lqi;
+} capture_frame_t;
+
+// Returns true and fills frame if line is a "Frame:" line with a payload matching len=
+static inline bool capture_parse_frame(const char *line, capture_frame_t *frame) {
+    const char *p = strstr(line, "Frame:");
+    if (p == NULL) return false;
+    p += 6;
+
+    memset(frame, 0, sizeof(*frame));
+    for (;;) {
+        while (*p == ' ') p++;
+        if (strncmp(p, "len=", 4) == 0) break;
+
+        char *end;
+        long value = strtol(p, &end, 16);
+        if (end == p || value < 0 || value > 0xFF || frame->size >= sizeof(frame->data)) return false;
+        frame->data[frame->size++] = (uint8_t)value;
+        p = end;
+        if (*p == ',') p++;
+    }
+
+    int len = atoi(p + 4);
+    const char *rssi = strstr(p, "RSSI=");
+    const char *lqi = strstr(p, "LQI=");
+    if (rssi) frame->rssi = (int16_t)atoi(rssi + 5);
+    if (lqi) frame->lqi = (uint8_t)atoi(lqi + 4);
+    return len == frame->size && frame->size > 0;
+}
+
+static inline int capture_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Returns true and fills frame if line holds an rtl_433 "{bits}hex" row long enough for
+// the length byte it starts with
+static inline bool capture_parse_rtl433(const char *line, capture_frame_t *frame) {
+    const char *p = line;
+    char *end;
+    long bits;
+    do {        // the JSON output has other braces before the row
+        p = strchr(p, '{');
+        if (p == NULL) return false;
+        bits = strtol(++p, &end, 10);
+    } while (end == p || *end != '}');
+    if (bits < 8) return false;
+    p = end + 1;
+
+    uint8_t bytes[sizeof(frame->data) + 3];
+    size_t count = 0;
+    while (count < sizeof(bytes) && count * 8 < (size_t)bits) {
+        while (*p == ' ') p++;
+        int high = capture_hex_digit(p[0]);
+        int low = high < 0 ? -1 : capture_hex_digit(p[1]);
+        if (low < 0) break;
+        bytes[count++] = (uint8_t)(high << 4 | low);
+        p += 2;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    if (count < 1 || bytes[0] == 0 || bytes[0] > sizeof(frame->data) || count < (size_t)bytes[0] + 1) return false;
+    frame->size = bytes[0];
+    memcpy(frame->data, &bytes[1], frame->size);
+    return true;
+}
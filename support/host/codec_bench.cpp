@@ -0,0 +1,94 @@
+/*
+    Decode and encode throughput of include/iboost_codec.h on the "Frame:" lines of
+    notes/packet.txt, next to the pointer casts receive_packet_task used before (which
+    are only safe where unaligned access is allowed and long is 32 bits).
+
+    Build and run from the repository root:
+
+    g++ -std=gnu++11 -O2 -Isupport/host -Iinclude support/host/codec_bench.cpp -o codec_bench
+    ./codec_bench [notes/packet.txt] [rounds]
+*/
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "iboost_codec.h"
+#include "capture.h"
+
+// Stops the compiler throwing away work whose result isn't used
+static volatile int64_t sink;
+
+template <typename F>
+static double ns_per_call(uint64_t calls, F body) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    body();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "notes/packet.txt";
+    uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 200000;
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    std::vector<capture_frame_t> frames;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        capture_frame_t frame;
+        if (capture_parse_frame(line, &frame)) frames.push_back(frame);
+    }
+    fclose(file);
+    if (frames.empty()) {
+        fprintf(stderr, "No frames in %s\n", path);
+        return 1;
+    }
+    uint64_t calls = (uint64_t)rounds * frames.size();
+    printf("%zu frames from %s, %u rounds\n", frames.size(), path, rounds);
+
+    double codec_ns = ns_per_call(calls, [&]() {
+        int64_t total = 0;
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < frames.size(); i++) {
+                iboost_frame_t frame;
+                if (iboost_decode(frames[i].data, frames[i].size, &frame)) {
+                    total += frame.p1 + frame.p2 + frame.heating + frame.request;
+                }
+            }
+        }
+        sink = total;
+    });
+    int64_t codec_total = sink;
+
+    double cast_ns = ns_per_call(calls, [&]() {
+        int64_t total = 0;
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < frames.size(); i++) {
+                const uint8_t *packet = frames[i].data;
+                if (packet[2] == 0x22 && frames[i].size == 37) {
+                    total += *(const int32_t *)&packet[18] + *(const int32_t *)&packet[25] +
+                        *(const int16_t *)&packet[16] + packet[24];
+                }
+            }
+        }
+        sink = total;
+    });
+    int64_t cast_total = sink;
+
+    double encode_ns = ns_per_call(rounds, [&]() {
+        uint8_t buffer[IBOOST_BUDDY_SIZE];
+        int64_t total = 0;
+        for (uint32_t r = 0; r < rounds; r++) {
+            total += iboost_encode_request(buffer, (uint16_t)r, (uint8_t)(0xCA + r % 5)) + buffer[1];
+        }
+        sink = total;
+    });
+
+    printf("%-24s %10s %14s\n", "", "ns/frame", "frames/s");
+    printf("%-24s %10.1f %14.0f\n", "iboost_decode", codec_ns, 1e9 / codec_ns);
+    printf("%-24s %10.1f %14.0f\n", "pointer casts", cast_ns, 1e9 / cast_ns);
+    printf("%-24s %10.1f %14.0f\n", "iboost_encode_request", encode_ns, 1e9 / encode_ns);
+    printf("Results %s\n", codec_total == cast_total ? "agree" : "DIFFER");
+    return codec_total == cast_total ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/*
+    Checks include/iboost_codec.h against the captures in notes/packet.txt. Each main unit
+    "Frame:" line is followed by what the firmware of the day logged for it (heating, P1,
+    P2, tank and battery), the decoder has to agree with all of it. Also checks the
+    buddy request against the bytes transmit_packet_task used to poke in by hand.
+
+    Build and run from the repository root:
+
+    g++ -std=gnu++11 -O2 -Wall -Isupport/host -Iinclude support/host/codec_test.cpp -o codec_test
+    ./codec_test [notes/packet.txt]
+
+    Exits non-zero if any check fails.
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "iboost_codec.h"
+#include "capture.h"
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    checks++; \
+    if (!(cond)) { \
+        failures++; \
+        printf("FAIL line %d: %s: ", __LINE__, #cond); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while (0)
+
+// Heating, P1 and P2 from either log format in the capture:
+// "Heating=0,P1=-269193,Import=-747,P2=2825,..." or "Heating: 2965  P1: -181658  Import: -465  P2: 2903 ..."
+static bool parse_logged(const char *line, long *heating, long *p1, long *p2) {
+    long import;
+    return sscanf(line, "Heating=%ld,P1=%ld,Import=%ld,P2=%ld", heating, p1, &import, p2) == 4 ||
+        sscanf(line, "Heating: %ld P1: %ld Import: %ld P2: %ld", heating, p1, &import, p2) == 4;
+}
+
+static void check_capture(const std::vector<std::string> &lines) {
+    int main_unit = 0, sender = 0, logged = 0;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        capture_frame_t capture;
+        if (!capture_parse_frame(lines[i].c_str(), &capture)) continue;
+
+        iboost_frame_t frame;
+        bool b_ok = iboost_decode(capture.data, capture.size, &frame);
+        CHECK(b_ok, "capture line %zu did not decode", i + 1);
+        CHECK(frame.address == 0x23b3, "capture line %zu address %04x", i + 1, frame.address);
+        if (!b_ok) continue;
+
+        if (frame.type == IBOOST_FRAME_SENDER) {
+            sender++;
+            CHECK(frame.samples == &capture.data[4], "capture line %zu samples not in place", i + 1);
+            continue;
+        }
+        CHECK(frame.type == IBOOST_FRAME_MAIN_UNIT, "capture line %zu type %02x", i + 1, frame.type);
+        main_unit++;
+        CHECK(frame.request >= 0xCA && frame.request <= 0xCE, "capture line %zu request %02x", i + 1, frame.request);
+
+        // what was logged for it, up to the next frame or request
+        for (size_t j = i + 1; j < lines.size(); j++) {
+            const char *line = lines[j].c_str();
+            long heating, p1, p2;
+            if (strstr(line, "Frame:") || strstr(line, "Sent request")) break;
+            if (parse_logged(line, &heating, &p1, &p2)) {
+                logged++;
+                CHECK(frame.heating == heating, "capture line %zu heating %d, logged %ld", i + 1, frame.heating, heating);
+                CHECK(frame.p1 == p1, "capture line %zu P1 %d, logged %ld", i + 1, frame.p1, p1);
+                CHECK(frame.p2 == p2, "capture line %zu P2 %d, logged %ld", i + 1, frame.p2, p2);
+            }
+            if (strstr(line, "Water Tank HOT")) {
+                CHECK(frame.b_tank_hot, "capture line %zu logged hot", i + 1);
+            } else if (strstr(line, "Heating by Solar")) {
+                CHECK(frame.b_heating_by_solar && !frame.b_tank_hot, "capture line %zu logged heating by solar", i + 1);
+            } else if (strstr(line, "Water Heating OFF")) {
+                CHECK(!frame.b_heating_by_solar && !frame.b_tank_hot, "capture line %zu logged off", i + 1);
+            }
+            if (strstr(line, "Sender Battery OK")) {
+                CHECK(frame.b_battery_ok, "capture line %zu logged battery OK", i + 1);
+            }
+        }
+    }
+    printf("%d main unit frames (%d with logged values), %d sender frames\n", main_unit, logged, sender);
+    CHECK(main_unit > 0 && sender > 0 && logged > 0, "nothing to check in the capture");
+}
+
+static void check_request(void) {
+    // as transmit_packet_task built it before the codec
+    uint8_t legacy[32];
+    memset(legacy, 0, sizeof(legacy));
+    legacy[0] = 0x23;
+    legacy[1] = 0xb3;
+    legacy[2] = 0x21;
+    legacy[3] = 0x8;
+    legacy[4] = 0x92;
+    legacy[5] = 0x7;
+    legacy[8] = 0x24;
+    legacy[10] = 0xa0;
+    legacy[11] = 0xa0;
+    legacy[12] = 0xCC;
+    legacy[14] = 0xa0;
+    legacy[15] = 0xa0;
+    legacy[16] = 0xc8;
+
+    uint8_t encoded[32];
+    memset(encoded, 0x55, sizeof(encoded));
+    uint8_t size = iboost_encode_request(encoded, 0x23b3, 0xCC);
+    CHECK(size == 29, "request length %u", size);
+    CHECK(memcmp(encoded, legacy, 29) == 0, "request bytes differ");
+    CHECK(encoded[29] == 0x55, "request wrote past its length");
+
+    iboost_frame_t frame;
+    CHECK(iboost_decode(encoded, size, &frame), "request did not decode");
+    CHECK(frame.type == IBOOST_FRAME_BUDDY && frame.address == 0x23b3 && frame.request == 0xCC,
+        "request decoded as type %02x address %04x request %02x", frame.type, frame.address, frame.request);
+}
+
+static void check_rejects(void) {
+    capture_frame_t capture;
+    iboost_frame_t frame;
+    const char *line = "Frame: 23,b3,22,00,00,00,00,01,00,00,00,02,00,00,00,00,00,00,77,e4,fb,ff,a0,a0,ca,09,0b,00,00,00,00,00,00,00,00,00,00,len=37";
+
+    CHECK(capture_parse_frame(line, &capture), "reject sample did not parse");
+    CHECK(!iboost_decode(capture.data, capture.size - 1, &frame), "short main unit frame accepted");
+    CHECK(!iboost_decode(capture.data, 2, &frame), "frame without a type accepted");
+    capture.data[2] = 0x42;
+    CHECK(!iboost_decode(capture.data, capture.size, &frame), "unknown type accepted");
+    CHECK(frame.address == 0x23b3 && frame.type == 0x42, "unknown type not reported");
+}
+
+static void check_fields(void) {
+    uint8_t data[IBOOST_MAIN_UNIT_SIZE];
+    memset(data, 0, sizeof(data));
+    data[IBOOST_TYPE.offset] = IBOOST_FRAME_MAIN_UNIT;
+
+    static const int32_t values[] = {0, 1, -1, 2147483647, -2147483647 - 1, -269193, 1832943};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        iboost_frame_t frame;
+        iboost_put(data, IBOOST_MAIN_P1, (uint32_t)values[i]);
+        iboost_put(data, IBOOST_MAIN_P2, (uint32_t)values[i]);
+        iboost_put(data, IBOOST_MAIN_HEATING, (uint32_t)values[i]);
+        iboost_decode(data, sizeof(data), &frame);
+        CHECK(frame.p1 == values[i] && frame.p2 == values[i], "32 bit round trip %d", values[i]);
+        CHECK(frame.heating == (int16_t)values[i], "16 bit round trip %d", values[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "notes/packet.txt";
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    std::vector<std::string> lines;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        lines.push_back(line);
+    }
+    fclose(file);
+
+    check_capture(lines);
+    check_request();
+    check_rejects();
+    check_fields();
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+// Host builds: no pinned units (IBOOST_ADDRESSES), any unit heard is tracked
@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+    ESP-IDF logging for host builds of the decode path, see support/host/README. Errors
+    and warnings go to stderr, info and debug only with -DHOST_LOG_VERBOSE so they don't
+    swamp the replay output.
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#define ESP_LOG_ERROR   1
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#ifdef HOST_LOG_VERBOSE
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) fprintf(stderr, "D (%s) " format "\n", tag, ##__VA_ARGS__)
+#else
+#define ESP_LOGI(tag, format, ...) do { (void)tag; } while (0)
+#define ESP_LOGD(tag, format, ...) do { (void)tag; } while (0)
+#endif
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, length, level) do { (void)tag; } while (0)
@@ -0,0 +1,493 @@
+#include "fake_cc1101.h"
+#include <CC1101_RFx.h>
+
+// Timings from SWRS061I table 34, 26MHz crystal
+#define CALIBRATE_NS        721000ull       // FS calibration
+#define SETTLE_NS           88400ull        // IDLE -> RX/TX without calibration
+#define RX_TO_TX_NS         31000ull
+#define TX_TO_RX_NS         21500ull
+#define FSTXON_TO_TX_NS     1000ull
+#define WAKE_NS             150000ull       // crystal start up after SLEEP
+#define RESET_NS            41000ull        // SRES until CHIP_RDYn goes low
+
+// Register values after reset, CC1101_IOCFG2 (0x00) to CC1101_TEST0 (0x2E)
+static const uint8_t reset_values[CC1101_CONFIG_SIZE] = {
+    0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,
+    0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+    0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B
+};
+
+FakeCC1101 *FakeCC1101::active = NULL;
+
+FakeCC1101::FakeCC1101(uint8_t csn, uint8_t miso, uint32_t sclk_hz)
+: sclkHz(sclk_hz), csnPin(csn), misoPin(miso) {
+    reset(true);
+    active = this;
+    sim_pin_write = pinWriteHook;
+    sim_pin_read = pinReadHook;
+}
+
+FakeCC1101::~FakeCC1101() {
+    if (active == this) {
+        active = NULL;
+        sim_pin_write = NULL;
+        sim_pin_read = NULL;
+    }
+}
+
+void FakeCC1101::pinWriteHook(uint8_t pin, uint8_t level) {
+    if (active) active->pinWrite(pin, level);
+}
+
+int FakeCC1101::pinReadHook(uint8_t pin) {
+    return active ? active->pinRead(pin) : HIGH;
+}
+
+void FakeCC1101::reset(bool power_on) {
+    memcpy(regs, reset_values, sizeof(regs));
+    memset(patable, 0, sizeof(patable));
+    patable[0] = 0xC6;
+    paIndex = 0;
+    rxFifo.clear();
+    txFifo.clear();
+    if (rxActive) {
+        air.pop_front();
+        framesMissed++;
+    }
+    rxActive = false;
+    txActive = false;
+    sleepOnCsnHigh = false;
+    access = ACC_HEADER;
+    st = ST_IDLE;
+}
+
+// CSN falling edge starts an access (and wakes the chip), rising edge ends any burst
+void FakeCC1101::pinWrite(uint8_t pin, uint8_t level) {
+    if (pin != csnPin) return;
+    sim_advance_ns(csnOverheadNs);
+    busNs += csnOverheadNs;
+    update();
+
+    if (level == LOW && !csnLow) {
+        csnLow = true;
+        access = ACC_HEADER;
+        if (st == ST_SLEEP) {
+            // FSTEST..TEST0, the PATABLE (bar entry 0) and the FIFOs are lost in SLEEP
+            for (uint8_t addr = CC1101_FSTEST; addr <= CC1101_TEST0; addr++) regs[addr] = reset_values[addr];
+            memset(&patable[1], 0, sizeof(patable) - 1);
+            rxFifo.clear();
+            txFifo.clear();
+            st = ST_IDLE;
+            readyNs = sim_now_ns + WAKE_NS;
+        }
+    } else if (level == HIGH && csnLow) {
+        csnLow = false;
+        access = ACC_HEADER;
+        paIndex = 0;
+        if (sleepOnCsnHigh && st == ST_IDLE) st = ST_SLEEP;
+        sleepOnCsnHigh = false;
+    }
+}
+
+// SO doubles as CHIP_RDYn while CSN is low
+int FakeCC1101::pinRead(uint8_t pin) {
+    if (pin != misoPin || !csnLow || wedged) return HIGH;
+    return sim_now_ns < readyNs ? HIGH : LOW;
+}
+
+uint8_t FakeCC1101::transfer(uint8_t data) {
+    uint64_t ns = callOverheadNs + 8000000000ull / sclkHz;
+    sim_advance_ns(ns);
+    busNs += ns;
+    update();
+    return clock(data);
+}
+
+// One call overhead for the whole block, the bytes still take their time on the wire
+void FakeCC1101::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size) {
+    sim_advance_ns(callOverheadNs);
+    busNs += callOverheadNs;
+    for (uint32_t i = 0; i < size; i++) {
+        uint64_t ns = 8000000000ull / sclkHz;
+        sim_advance_ns(ns);
+        busNs += ns;
+        update();
+        uint8_t value = clock(data ? data[i] : 0xFF);
+        if (out) out[i] = value;
+    }
+}
+
+// One byte on the bus, returns what the chip shifts out on SO
+uint8_t FakeCC1101::clock(uint8_t mosi) {
+    if (!csnLow || wedged) return 0xFF;
+
+    uint8_t value;
+    switch (access) {
+        case ACC_HEADER:
+            accAddr = mosi & 0x3F;
+            accRead = mosi & 0x80;
+            accBurst = mosi & 0x40;
+            value = statusByte(accRead);
+            if (accAddr == CC1101_TXFIFO) access = ACC_FIFO;
+            else if (accAddr == CC1101_PATABLE) access = ACC_PATABLE;
+            else if (accAddr >= 0x30) {
+                if (accRead && accBurst) access = ACC_STATUS;
+                else doStrobe(accAddr);
+            } else access = ACC_REG;
+            return value;
+
+        case ACC_REG:
+            if (accAddr >= CC1101_CONFIG_SIZE) return statusByte(accRead);
+            if (accRead) value = regs[accAddr];
+            else {
+                regs[accAddr] = mosi;
+                value = statusByte(false);
+            }
+            if (accBurst) accAddr++;
+            else access = ACC_HEADER;
+            return value;
+
+        case ACC_STATUS:
+            access = ACC_HEADER;
+            return readStatus(accAddr);
+
+        case ACC_PATABLE:
+            if (accRead) value = patable[paIndex];
+            else {
+                patable[paIndex] = mosi;
+                value = statusByte(false);
+            }
+            paIndex = (paIndex + 1) & 0x07;
+            if (!accBurst) access = ACC_HEADER;
+            return value;
+
+        case ACC_FIFO:
+            if (accRead) {
+                if (rxFifo.empty()) {
+                    fifoUnderreads++;
+                    value = 0;
+                } else {
+                    value = rxFifo.front();
+                    rxFifo.pop_front();
+                }
+            } else {
+                if (txFifo.size() < 64) txFifo.push_back(mosi);
+                value = statusByte(false);
+                if (st == ST_TX && !txActive && txFifo.size() >= (size_t)txFifo[0] + 1) {
+                    txActive = true;
+                    txEndNs = sim_now_ns + airtimeNs(txFifo[0]);
+                }
+            }
+            if (!accBurst) access = ACC_HEADER;
+            return value;
+    }
+    return 0xFF;
+}
+
+uint8_t FakeCC1101::state() const {
+    switch (st) {
+        case ST_RX:             return 1;
+        case ST_TX:             return 2;
+        case ST_FSTXON:         return 3;
+        case ST_CALIBRATE:      return 4;
+        case ST_SETTLING:       return 5;
+        case ST_RX_OVERFLOW:    return 6;
+        case ST_TX_UNDERFLOW:   return 7;
+        default:                return 0;
+    }
+}
+
+// CHIP_RDYn, STATE and FIFO_BYTES_AVAILABLE (RX bytes for a read, free TX bytes for a write)
+uint8_t FakeCC1101::statusByte(bool read) const {
+    size_t fifo = read ? rxFifo.size() : 64 - txFifo.size();
+    if (fifo > 15) fifo = 15;
+    return (sim_now_ns < readyNs ? 0x80 : 0x00) | (state() << 4) | (uint8_t)fifo;
+}
+
+uint8_t FakeCC1101::readStatus(uint8_t addr) {
+    switch (addr) {
+        case 0x30: return 0x00;                         // PARTNUM
+        case 0x31: return 0x14;                         // VERSION
+        case 0x32: return (uint8_t)lastFreqest;         // FREQEST
+        case 0x33: return lastLqiStatus;                // LQI
+        case 0x34: return lastRssiRaw;                  // RSSI
+        case 0x35:                                      // MARCSTATE
+            switch (st) {
+                case ST_SLEEP:          return 0x00;
+                case ST_IDLE:           return 0x01;
+                case ST_CALIBRATE:      return 0x08;
+                case ST_SETTLING:       return 0x0C;
+                case ST_RX:             return 0x0D;
+                case ST_RX_OVERFLOW:    return 0x11;
+                case ST_FSTXON:         return 0x12;
+                case ST_TX:             return 0x13;
+                case ST_TX_UNDERFLOW:   return 0x16;
+            }
+            return 0x01;
+        case 0x3A: return (uint8_t)txFifo.size() | (st == ST_TX_UNDERFLOW ? 0x80 : 0x00);    // TXBYTES
+        case 0x3B: return (uint8_t)rxFifo.size() | (st == ST_RX_OVERFLOW ? 0x80 : 0x00);    // RXBYTES
+        case 0x3C: return 0x41;                         // RCCTRL1_STATUS
+        default:   return 0x00;
+    }
+}
+
+void FakeCC1101::doStrobe(uint8_t strobe) {
+    strobes++;
+    evNs = sim_now_ns;
+    switch (strobe) {
+        case CC1101_SRES:
+            reset(false);
+            readyNs = sim_now_ns + RESET_NS;
+            break;
+        case CC1101_SFSTXON:
+            if (st == ST_IDLE) goActive(ST_FSTXON);
+            break;
+        case CC1101_SCAL:
+            if (st == ST_IDLE) {
+                afterSettle = ST_IDLE;
+                enter(ST_CALIBRATE);
+                timerNs = evNs + CALIBRATE_NS;
+            }
+            break;
+        case CC1101_SRX:
+        case CC1101_SWOR:                               // no duty cycling, listens continuously
+            if (st == ST_CALIBRATE || st == ST_SETTLING) afterSettle = ST_RX;
+            else if (st == ST_IDLE || st == ST_TX || st == ST_FSTXON) goActive(ST_RX);
+            break;
+        case CC1101_STX:
+            if (st == ST_CALIBRATE || st == ST_SETTLING) afterSettle = ST_TX;
+            else if (st == ST_RX) {
+                // CCA: a packet on air (or being received) keeps the chip in RX
+                bool busy = rxActive || (!air.empty() && air.front().start_ns <= sim_now_ns &&
+                    sim_now_ns < air.front().start_ns + airtimeNs(air.front().size));
+                if (((regs[CC1101_MCSM1] >> 4) & 0x03) == 0 || !busy) goActive(ST_TX);
+            } else if (st == ST_IDLE || st == ST_FSTXON) goActive(ST_TX);
+            break;
+        case CC1101_SIDLE:
+            if (st != ST_SLEEP) enter(ST_IDLE);
+            break;
+        case CC1101_SPWD:
+            sleepOnCsnHigh = true;
+            break;
+        case CC1101_SFRX:
+            if (st == ST_IDLE || st == ST_RX_OVERFLOW) {
+                rxFifo.clear();
+                if (st == ST_RX_OVERFLOW) enter(ST_IDLE);
+            }
+            break;
+        case CC1101_SFTX:
+            if (st == ST_IDLE || st == ST_TX_UNDERFLOW) {
+                txFifo.clear();
+                if (st == ST_TX_UNDERFLOW) enter(ST_IDLE);
+            }
+            break;
+        default:                                        // SXOFF, SWORRST, SAFC, SNOP
+            break;
+    }
+}
+
+// SRX/STX/SFSTXON or an automatic transition, with calibration as MCSM0 FS_AUTOCAL says
+void FakeCC1101::goActive(chip_state_t target) {
+    if (st == target) return;
+    uint64_t settle = SETTLE_NS;
+    if (st == ST_IDLE) {
+        uint8_t autocal = (regs[CC1101_MCSM0] >> 4) & 0x03;
+        if (autocal == 1 || (autocal == 3 && (++calCount & 0x03) == 0)) {
+            afterSettle = target;
+            enter(ST_CALIBRATE);
+            timerNs = evNs + CALIBRATE_NS;
+            return;
+        }
+    } else if (st == ST_RX) settle = RX_TO_TX_NS;
+    else if (st == ST_TX) settle = TX_TO_RX_NS;
+    else if (st == ST_FSTXON) settle = target == ST_TX ? FSTXON_TO_TX_NS : TX_TO_RX_NS;
+    afterSettle = target;
+    enter(ST_SETTLING);
+    timerNs = evNs + settle;
+}
+
+// Automatic return to IDLE at the end of a packet, FS_AUTOCAL = 2 calibrates on the way
+void FakeCC1101::goIdleFrom(chip_state_t from) {
+    if (((regs[CC1101_MCSM0] >> 4) & 0x03) == 2) {
+        afterSettle = ST_IDLE;
+        enter(ST_CALIBRATE);
+        timerNs = evNs + CALIBRATE_NS;
+    } else {
+        enter(ST_IDLE);
+    }
+}
+
+void FakeCC1101::enter(chip_state_t s) {
+    if (st == ST_RX && s != ST_RX && rxActive) {
+        rxActive = false;               // packet cut short, what reached the FIFO stays
+        air.pop_front();
+        framesMissed++;
+    }
+    if (st == ST_TX && s != ST_TX) txActive = false;
+    st = s;
+    if (st == ST_TX && !txActive && !txFifo.empty() && txFifo.size() >= (size_t)txFifo[0] + 1) {
+        txActive = true;
+        txEndNs = evNs + airtimeNs(txFifo[0]);
+    }
+}
+
+void FakeCC1101::rxEnd() {
+    const air_frame_t &frame = air.front();
+    lastRssiRaw = (uint8_t)(int8_t)((frame.rssi + 74) * 2);
+    lastLqiStatus = (frame.crc_ok ? 0x80 : 0x00) | (frame.lqi & 0x7F);
+    lastFreqest = frame.freqest;
+    air.pop_front();
+    rxActive = false;
+    rxBusyUntilNs = evNs;
+
+    if (regs[CC1101_PKTCTRL1] & 0x04) {             // APPEND_STATUS
+        if (rxFifo.size() > 62) {
+            overflows++;
+            enter(ST_RX_OVERFLOW);
+            return;
+        }
+        rxFifo.push_back(lastRssiRaw);
+        rxFifo.push_back(lastLqiStatus);
+    }
+    framesReceived++;
+    gdo0Edges++;
+    lastGdo0Ns = evNs;
+
+    switch ((regs[CC1101_MCSM1] >> 2) & 0x03) {     // RXOFF_MODE
+        case 0: goIdleFrom(ST_RX); break;
+        case 1: enter(ST_FSTXON); break;
+        case 2: goActive(ST_TX); break;
+        case 3: break;
+    }
+}
+
+void FakeCC1101::txEnd() {
+    uint8_t size = txFifo.front();
+    txFifo.pop_front();
+    std::vector<uint8_t> payload;
+    for (uint8_t i = 0; i < size && !txFifo.empty(); i++) {
+        payload.push_back(txFifo.front());
+        txFifo.pop_front();
+    }
+    transmitted.push_back(payload);
+    txActive = false;
+    gdo0Edges++;
+    lastGdo0Ns = evNs;
+
+    switch (regs[CC1101_MCSM1] & 0x03) {            // TXOFF_MODE
+        case 0: goIdleFrom(ST_TX); break;
+        case 1: enter(ST_FSTXON); break;
+        case 2: enter(ST_TX); break;
+        case 3: goActive(ST_RX); break;
+    }
+}
+
+// Runs the chip's own events (timers, packet bytes, end of TX) in time order up to now
+void FakeCC1101::update() {
+    for (;;) {
+        uint64_t next = UINT64_MAX;
+        int event = 0;
+
+        if ((st == ST_CALIBRATE || st == ST_SETTLING) && timerNs < next) {
+            next = timerNs;
+            event = 1;
+        }
+        if (st == ST_TX && txActive && txEndNs < next) {
+            next = txEndNs;
+            event = 2;
+        }
+        if (!air.empty()) {
+            uint64_t sync = air.front().start_ns + (uint64_t)(preambleBytes() + syncBytes()) * byteNs();
+            uint64_t t = rxActive ? sync + (uint64_t)(rxDelivered + 1) * byteNs() : sync;
+            if (t < next) {
+                next = t;
+                event = rxActive ? 4 : 3;
+            }
+        }
+        if (event == 0 || next > sim_now_ns) break;
+
+        evNs = next;
+        if (event == 1) {
+            if (st == ST_CALIBRATE) {
+                calibrations++;
+                // deterministic "result" so a cached calibration can be told from a fresh one
+                regs[CC1101_FSCAL3] = (regs[CC1101_FSCAL3] & 0xF0) | 0x09;
+                regs[CC1101_FSCAL1] = 0x10 + (regs[CC1101_FREQ1] & 0x0F);
+                if (afterSettle == ST_IDLE) enter(ST_IDLE);
+                else {
+                    enter(ST_SETTLING);
+                    timerNs = evNs + SETTLE_NS;
+                }
+            } else {
+                enter(afterSettle);
+            }
+        } else if (event == 2) {
+            txEnd();
+        } else if (event == 3) {
+            const air_frame_t &frame = air.front();
+            bool variable = (regs[CC1101_PKTCTRL0] & 0x03) == 0x01;
+            if (st == ST_RX && next >= rxBusyUntilNs && (!variable || frame.size <= regs[CC1101_PKTLEN])) {
+                rxActive = true;
+                rxDelivered = 0;
+            } else {
+                air.pop_front();
+                framesMissed++;
+            }
+        } else {
+            const air_frame_t &frame = air.front();
+            uint8_t crc_bytes = (regs[CC1101_PKTCTRL0] & 0x04) ? 2 : 0;
+            if (rxDelivered <= frame.size) {
+                if (rxFifo.size() >= 64) {
+                    overflows++;
+                    enter(ST_RX_OVERFLOW);
+                    continue;
+                }
+                rxFifo.push_back(rxDelivered == 0 ? frame.size : frame.data[rxDelivered - 1]);
+            }
+            if (++rxDelivered == frame.size + 1 + crc_bytes) rxEnd();
+        }
+    }
+}
+
+void FakeCC1101::injectFrame(const uint8_t *payload, uint8_t size, uint64_t start_us,
+        int16_t rssi, uint8_t lqi, bool crc_ok, int8_t freqest) {
+    air_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.start_ns = start_us * 1000;
+    frame.size = size > sizeof(frame.data) ? sizeof(frame.data) : size;
+    memcpy(frame.data, payload, frame.size);
+    frame.rssi = rssi;
+    frame.lqi = lqi;
+    frame.crc_ok = crc_ok;
+    frame.freqest = freqest;
+
+    std::deque<air_frame_t>::iterator it = air.end();
+    while (it != air.begin() && (it - 1)->start_ns > frame.start_ns) --it;
+    if (it == air.begin() && rxActive) ++it;            // never ahead of the frame being received
+    air.insert(it, frame);
+}
+
+// 8 bits at the MDMCFG4/MDMCFG3 data rate
+uint64_t FakeCC1101::byteNs() const {
+    double rate = (double)((256 + regs[CC1101_MDMCFG3]) << (regs[CC1101_MDMCFG4] & 0x0F)) *
+        CC1101_CRYSTAL_FREQUENCY / (double)(1ul << 28);
+    return (uint64_t)(8e9 / rate);
+}
+
+uint8_t FakeCC1101::preambleBytes() const {
+    static const uint8_t preamble[8] = {2, 3, 4, 6, 8, 12, 16, 24};
+    return preamble[(regs[CC1101_MDMCFG1] >> 4) & 0x07];
+}
+
+uint8_t FakeCC1101::syncBytes() const {
+    switch (regs[CC1101_MDMCFG2] & 0x03) {
+        case 0:  return 0;
+        case 3:  return 4;
+        default: return 2;
+    }
+}
+
+uint64_t FakeCC1101::airtimeNs(uint8_t size) const {
+    uint8_t crc_bytes = (regs[CC1101_PKTCTRL0] & 0x04) ? 2 : 0;
+    return (uint64_t)(preambleBytes() + syncBytes() + 1 + size + crc_bytes) * byteNs();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+/*
+    Register level model of a CC1101 for running the driver in src/CC1101_RFx.cpp on a
+    Linux host, see support/host/README.
+
+    It sits behind the SPIClass& the CC1101 constructor takes and decodes the SPI
+    stream the way the chip does: header byte, status byte reply, single and burst
+    register access, status registers, strobes, the 64 byte RX and TX FIFOs and the
+    RSSI/LQI/CRC bytes appended to a received packet. The radio state machine runs on
+    the virtual clock in Arduino.h, calibration, settling and packet air time take
+    the time the data sheet (SWRS061I) gives.
+
+    Not modelled: WOR duty cycling (SWOR listens continuously), the RX FIFO last byte
+    errata, RSSI threshold CCA (a packet on air counts as a busy channel) and the
+    CRC itself (the crc_ok flag of the injected frame decides).
+*/
+
+#include <deque>
+#include <vector>
+#include "Arduino.h"
+#include "SPI.h"
+
+class FakeCC1101 : public SPIClass {
+    public:
+        // One frame scheduled to be on air
+        typedef struct {
+            uint64_t start_ns;      // start of the preamble
+            uint8_t size;
+            uint8_t data[64];
+            int16_t rssi;           // dBm
+            uint8_t lqi;
+            bool crc_ok;
+            int8_t freqest;         // FREQEST reported for the frame
+        } air_frame_t;
+
+        // csn and miso are the pins the driver toggles and polls, sclk_hz the SPI clock
+        FakeCC1101(uint8_t csn = SS, uint8_t miso = MISO, uint32_t sclk_hz = 1000000);
+        ~FakeCC1101();
+
+        // SPIClass
+        uint8_t transfer(uint8_t data) override;
+        void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size) override;
+
+        // SPI clock and the host CPU cost of each transfer() / transferBytes() call and
+        // each CSN edge, added to the clocked bits when time is advanced.
+        uint32_t sclkHz;
+        uint32_t callOverheadNs = 1500;
+        uint32_t csnOverheadNs = 250;
+
+        // A chip that has stopped answering (no crystal, loose MISO): SO stays high and
+        // every byte reads 0xFF, so the driver's waits run to their deadlines
+        bool wedged = false;
+
+        // Puts a frame on air at start_us (virtual time). Payload as getPacket() returns
+        // it, the length byte is added. Frames are kept in start order.
+        void injectFrame(const uint8_t *payload, uint8_t size, uint64_t start_us,
+            int16_t rssi = -60, uint8_t lqi = 4, bool crc_ok = true, int8_t freqest = 0);
+
+        // Brings the chip up to the current virtual time
+        void update();
+
+        // Time the chip needs to send or receive a packet with size payload bytes,
+        // from the start of the preamble, with the current register settings
+        uint64_t airtimeNs(uint8_t size) const;
+
+        // Current STATE field of the status byte (0 IDLE, 1 RX, 2 TX ... 7)
+        uint8_t state() const;
+        uint8_t reg(uint8_t addr) const { return regs[addr]; }
+        uint8_t rxFifoBytes() const { return (uint8_t)rxFifo.size(); }
+
+        // Observations
+        std::vector<std::vector<uint8_t> > transmitted;    // payloads sent, without the length byte
+        uint32_t gdo0Edges = 0;         // end of packet (RX or TX), GDO0 rises with IOCFG0 = 0x46
+        uint64_t lastGdo0Ns = 0;
+        uint32_t framesReceived = 0;    // complete packets written to the RX FIFO
+        uint32_t framesMissed = 0;      // on air while the chip was not listening
+        uint32_t overflows = 0;
+        uint32_t fifoUnderreads = 0;    // RX FIFO read while empty
+        uint32_t calibrations = 0;
+        uint32_t strobes = 0;
+        uint64_t busNs = 0;             // time spent clocking SPI, including overheads
+
+    private:
+        enum chip_state_t {
+            ST_SLEEP, ST_IDLE, ST_CALIBRATE, ST_SETTLING, ST_RX, ST_TX, ST_FSTXON,
+            ST_RX_OVERFLOW, ST_TX_UNDERFLOW
+        };
+        enum access_t { ACC_HEADER, ACC_REG, ACC_STATUS, ACC_PATABLE, ACC_FIFO };
+
+        void reset(bool power_on);
+        void pinWrite(uint8_t pin, uint8_t level);
+        int pinRead(uint8_t pin);
+        uint8_t clock(uint8_t mosi);
+        uint8_t statusByte(bool read) const;
+        uint8_t readStatus(uint8_t addr);
+        void doStrobe(uint8_t strobe);
+        void goActive(chip_state_t target);
+        void goIdleFrom(chip_state_t from);
+        void enter(chip_state_t s);
+        void rxEnd();
+        void txEnd();
+        uint64_t byteNs() const;
+        uint8_t syncBytes() const;
+        uint8_t preambleBytes() const;
+
+        static void pinWriteHook(uint8_t pin, uint8_t level);
+        static int pinReadHook(uint8_t pin);
+        static FakeCC1101 *active;
+
+        uint8_t csnPin, misoPin;
+        bool csnLow = false;
+        uint64_t readyNs = 0;           // SO (CHIP_RDYn) stays high until this time
+
+        uint8_t regs[0x2F];
+        uint8_t patable[8];
+        uint8_t paIndex = 0;
+
+        chip_state_t st = ST_IDLE;
+        chip_state_t afterSettle = ST_IDLE;
+        uint64_t timerNs = 0;           // end of CALIBRATE / SETTLING
+        uint64_t evNs = 0;              // time of the event being handled
+        bool sleepOnCsnHigh = false;
+        uint8_t calCount = 0;
+
+        // SPI decoder
+        access_t access = ACC_HEADER;
+        uint8_t accAddr = 0;
+        bool accRead = false, accBurst = false;
+
+        // RX
+        std::deque<air_frame_t> air;
+        std::deque<uint8_t> rxFifo;
+        bool rxActive = false;          // receiving air.front()
+        uint8_t rxDelivered = 0;        // bytes of the current frame written to the FIFO
+        uint64_t rxBusyUntilNs = 0;     // end of the last packet received
+        uint8_t lastLqiStatus = 0, lastRssiRaw = 0;
+        int8_t lastFreqest = 0;
+
+        // TX
+        std::deque<uint8_t> txFifo;
+        bool txActive = false;
+        uint64_t txEndNs = 0;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+    Just the FreeRTOS types the decode path names (main.h, the spinlocks in the unit
+    table and request schedule). Host builds are single threaded so the critical
+    sections do nothing.
+*/
+
+#include <stdint.h>
+
+typedef int portMUX_TYPE;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
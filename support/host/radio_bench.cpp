@@ -0,0 +1,304 @@
+/*
+    Runs the CC1101 driver against FakeCC1101 on a Linux host and reports what each
+    call costs: SPI transactions (chip select cycles), bytes, simulated bus time and
+    simulated elapsed time (which includes waiting on the chip), plus host CPU time.
+
+    Build and run from the repository root:
+
+    g++ -std=gnu++11 -O2 -DCC1101_BLOCK_TRANSFER -Isupport/host -Iinclude \
+        src/CC1101_RFx.cpp support/host/arduino_shim.cpp support/host/fake_cc1101.cpp \
+        support/host/radio_bench.cpp -o radio_bench
+    ./radio_bench [notes/packet.txt]
+
+    The received frames are the "Frame:" lines of the capture file.
+*/
+
+#include <chrono>
+#include <vector>
+#include "CC1101_RFx.h"
+#include "radio_config.h"
+#include "fake_cc1101.h"
+#include "capture.h"
+
+#define SPI_CLOCK       1000000     // SPI.begin() default on the ESP32
+#define FRAME_GAP_US    20000       // quiet time between the capture frames
+#define BACK_TO_BACK_US 300         // gap between a request and its answer in the burst test
+
+typedef struct {
+    const char *name;
+    uint32_t calls;
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t bus_ns;
+    uint64_t sim_ns;
+    uint64_t host_ns;
+} bench_row_t;
+
+static FakeCC1101 chip(SS, MISO, SPI_CLOCK);
+static CC1101 radio(SS, MISO, chip);
+static std::vector<bench_row_t> rows;
+
+// Times one driver call and adds it to the row called name
+template <typename F>
+static void measure(const char *name, F call) {
+    bench_row_t *row = NULL;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (strcmp(rows[i].name, name) == 0) row = &rows[i];
+    }
+    if (row == NULL) {
+        bench_row_t blank = {name, 0, 0, 0, 0, 0, 0};
+        rows.push_back(blank);
+        row = &rows.back();
+    }
+
+    cc1101_spi_stats_t spi = radio.spiStats;
+    uint64_t bus = chip.busNs;
+    uint64_t sim = sim_now_ns;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    call();
+    row->host_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    row->calls++;
+    row->transactions += radio.spiStats.transactions - spi.transactions;
+    row->bytes += radio.spiStats.bytes - spi.bytes;
+    row->bus_ns += chip.busNs - bus;
+    row->sim_ns += sim_now_ns - sim;
+}
+
+// Lets virtual time pass until GDO0 has fired since edges, false on timeout
+static bool wait_for_gdo0(uint32_t edges, uint32_t timeout_us) {
+    uint64_t deadline = sim_now_ns + (uint64_t)timeout_us * 1000;
+    while (chip.gdo0Edges == edges && sim_now_ns < deadline) {
+        delayMicroseconds(10);
+        chip.update();
+    }
+    return chip.gdo0Edges != edges;
+}
+
+// Same sequence as radio_setup() in main.cpp
+static bool radio_setup() {
+    radio.begin(iboost_radio_config);
+    radio.writeBurstRegister(CC1101_PATABLE, iboost_radio_pa_table, sizeof(iboost_radio_pa_table));
+    radio.setIDLEstate();
+    return radio.verifyConfiguration() && radio.verifyConfiguration(iboost_radio_config);
+}
+
+static void set_rxoff_mode(byte mcsm1) {
+    radio.setIDLEstate();
+    radio.writeRegister(CC1101_MCSM1, mcsm1);
+    radio.setRXstate();
+}
+
+// One frame at a time through getPacket(), RXOFF_MODE = IDLE
+static uint32_t run_get_packet(const std::vector<capture_frame_t> &frames) {
+    uint32_t good = 0;
+    byte packet[64];
+    set_rxoff_mode(0x30);
+    for (size_t i = 0; i < frames.size(); i++) {
+        const capture_frame_t &f = frames[i];
+        uint32_t edges = chip.gdo0Edges;
+        chip.injectFrame(f.data, f.size, sim_now_ns / 1000 + FRAME_GAP_US, f.rssi, f.lqi);
+        if (!wait_for_gdo0(edges, 2 * FRAME_GAP_US)) continue;
+        byte size = 0;
+        measure("getPacket", [&]() { size = radio.getPacket(packet); });
+        if (size == f.size && radio.crcok() && memcmp(packet, f.data, size) == 0) good++;
+    }
+    return good;
+}
+
+// Frames in back to back pairs, the second already on air when the receive task reads
+// the first. getPackets() (stay in RX) or getPacket() (back to IDLE, RXOFF_MODE = IDLE) is called
+// at each GDO0 edge.
+static uint32_t run_back_to_back(const std::vector<capture_frame_t> &frames, bool drain) {
+    uint32_t good = 0;
+    cc1101_frame_t batch[4];
+    byte packet[64];
+    set_rxoff_mode(drain ? 0x3C : 0x30);
+    for (size_t i = 0; i + 1 < frames.size(); i += 2) {
+        const capture_frame_t *pair[2] = {&frames[i], &frames[i + 1]};
+        uint64_t start = sim_now_ns / 1000 + FRAME_GAP_US;
+        chip.injectFrame(pair[0]->data, pair[0]->size, start, pair[0]->rssi, pair[0]->lqi);
+        chip.injectFrame(pair[1]->data, pair[1]->size, start + chip.airtimeNs(pair[0]->size) / 1000 + BACK_TO_BACK_US,
+            pair[1]->rssi, pair[1]->lqi);
+
+        size_t next = 0;
+        for (int edge = 0; edge < 2 && next < 2; edge++) {
+            if (!wait_for_gdo0(chip.gdo0Edges, 2 * FRAME_GAP_US)) break;
+            if (drain) {
+                byte count = 0;
+                measure("getPackets (pair)", [&]() { count = radio.getPackets(batch, 4); });
+                for (byte n = 0; n < count && next < 2; n++, next++) {
+                    const capture_frame_t *f = pair[next];
+                    if (batch[n].size == f->size && CC1101::frameCrcOk(&batch[n]) && memcmp(batch[n].data, f->data, f->size) == 0) good++;
+                }
+            } else {
+                byte size = 0;
+                measure("getPacket (pair)", [&]() { size = radio.getPacket(packet); });
+                for (; next < 2; next++) {
+                    const capture_frame_t *f = pair[next];
+                    if (size == f->size && memcmp(packet, f->data, size) == 0) {
+                        if (radio.crcok()) good++;
+                        next++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return good;
+}
+
+// radio_transmit()'s strobe sequence, which sleeps until GDO0 ends the packet
+static void transmit_sequence(const byte *request, byte size) {
+    uint32_t edges = chip.gdo0Edges;
+    radio.strobe(CC1101_SIDLE);
+    radio.writeRegister(CC1101_TXFIFO, size);
+    radio.writeBurstRegister(CC1101_TXFIFO, request, size);
+    radio.strobe(CC1101_STX);
+    wait_for_gdo0(edges, 20000);
+    radio.setRXstate();
+}
+
+// The fake buddy request built by transmit_packet_task()
+static void fake_request(byte *request) {
+    memset(request, 0, 29);
+    request[0] = 0x23;
+    request[1] = 0xb3;
+    request[2] = 0x21;
+    request[3] = 0x08;
+    request[4] = 0x92;
+    request[5] = 0x07;
+    request[8] = 0x24;
+    request[10] = 0xa0;
+    request[11] = 0xa0;
+    request[14] = 0xa0;
+    request[15] = 0xa0;
+    request[16] = 0xc8;
+}
+
+// The fake buddy request sent with sendPacket() and with radio_transmit()'s sequence
+static uint32_t run_send(uint32_t count) {
+    byte request[29];
+    fake_request(request);
+    set_rxoff_mode(iboost_radio_config[CC1101_MCSM1]);
+    size_t before = chip.transmitted.size();
+    for (uint32_t i = 0; i < count; i++) {
+        request[12] = 0xca + (i % 5);
+        measure("sendPacket (29 bytes)", [&]() { radio.sendPacket(request, sizeof(request)); });
+        delay(10);
+        measure("radio_transmit sequence", [&]() { transmit_sequence(request, sizeof(request)); });
+        delay(10);
+    }
+    return (uint32_t)(chip.transmitted.size() - before);
+}
+
+// IDLE -> RX and the request sequence (IDLE -> TX -> RX), the turnarounds that pay
+// for a calibration with MCSM0 FS_AUTOCAL
+static void run_turnaround(uint32_t count, const char *rx_name, const char *tx_name) {
+    byte request[29];
+    fake_request(request);
+    for (uint32_t i = 0; i < count; i++) {
+        radio.setIDLEstate();
+        measure(rx_name, [&]() { radio.setRXstate(); });
+        delay(5);
+        measure(tx_name, [&]() { transmit_sequence(request, sizeof(request)); });
+        delay(5);
+    }
+}
+
+static void print_rows(const char *title) {
+    printf("\n%s\n", title);
+    printf("%-24s %6s %8s %8s %10s %10s %10s\n", "call", "calls", "trans", "bytes", "bus us", "elapsed us", "host ns");
+    for (size_t i = 0; i < rows.size(); i++) {
+        const bench_row_t &r = rows[i];
+        if (r.calls == 0) continue;
+        printf("%-24s %6u %8.1f %8.1f %10.1f %10.1f %10.0f\n", r.name, r.calls,
+            (double)r.transactions / r.calls, (double)r.bytes / r.calls, r.bus_ns / 1000.0 / r.calls,
+            r.sim_ns / 1000.0 / r.calls, (double)r.host_ns / r.calls);
+    }
+    rows.clear();
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "notes/packet.txt";
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    std::vector<capture_frame_t> frames;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        capture_frame_t frame;
+        if (capture_parse_frame(line, &frame)) frames.push_back(frame);
+    }
+    fclose(file);
+    printf("%zu frames from %s, SPI clock %u Hz\n", frames.size(), path, (unsigned)SPI_CLOCK);
+
+    static const cc1101_burst_mode_t modes[] = {CC1101_BURST_BYTE_LOOP, CC1101_BURST_BLOCK};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        radio.burstMode = modes[m];
+        bool ok = false;
+        measure("radio_setup", [&]() { ok = radio_setup(); });
+        measure("setRXstate (from IDLE)", [&]() { radio.setRXstate(); });
+        measure("setRXstate (in RX)", [&]() { radio.setRXstate(); });
+
+        uint32_t single = run_get_packet(frames);
+        uint32_t legacy = run_back_to_back(frames, false);
+        uint32_t drained = run_back_to_back(frames, true);
+        uint32_t sent = run_send(10);
+
+        char title[160];
+        snprintf(title, sizeof(title), "%s bursts: configuration %s, getPacket %u/%zu, back to back getPacket %u/%zu "
+            "getPackets %u/%zu, sent %u/20", modes[m] == CC1101_BURST_BLOCK ? "Block" : "Byte loop",
+            ok ? "verified" : "MISMATCH", single, frames.size(), legacy, frames.size() & ~1ul,
+            drained, frames.size() & ~1ul, sent);
+        print_rows(title);
+    }
+
+    // The same turnarounds calibrating every time and from the cached calibration
+    // (RADIO_CACHED_CAL in main.cpp), then coming back from a power down and from WOR
+    // (RADIO_WOR), neither of which may turn FS_AUTOCAL back on
+    radio_setup();
+    uint32_t autocal = chip.calibrations;
+    run_turnaround(20, "IDLE -> RX (autocal)", "request (autocal)");
+    autocal = chip.calibrations - autocal;
+    uint32_t cached = chip.calibrations;
+    measure("setManualCalibration", [&]() { radio.setManualCalibration(true); });
+    run_turnaround(20, "IDLE -> RX (cached)", "request (cached)");
+    for (uint32_t i = 0; i < 20; i++) {
+        radio.strobe(CC1101_SPWD);
+        radio.setIDLEstate();
+        measure("IDLE -> RX (restored)", [&]() { radio.setRXstate(); });
+        delay(5);
+        radio.setIDLEstate();
+        radio.wor();
+        delay(5);
+        radio.setIDLEstate();
+        radio.wor2rx();
+        measure("WOR -> RX (restored)", [&]() { radio.setRXstate(); });
+        delay(5);
+    }
+    cached = chip.calibrations - cached;
+    bool matches = radio.fscal[0] == chip.reg(CC1101_FSCAL3) && radio.fscal[1] == chip.reg(CC1101_FSCAL2) &&
+        radio.fscal[2] == chip.reg(CC1101_FSCAL1);
+    radio.setManualCalibration(false);
+    char title[160];
+    snprintf(title, sizeof(title), "Turnaround: %u calibrations with FS_AUTOCAL, %u cached (%u restores, FSCAL %s)",
+        autocal, cached, radio.calStats.restores, matches ? "matches" : "MISMATCH");
+    print_rows(title);
+
+    // Every wait on a dead chip ends at its deadline, CC1101::error says why
+    chip.wedged = true;
+    radio.error = CC1101_OK;
+    measure("setIDLEstate (wedged)", [&]() { radio.setIDLEstate(); });
+    measure("setRXstate (wedged)", [&]() { radio.setRXstate(); });
+    measure("getPackets (wedged)", [&]() { cc1101_frame_t frame; radio.getPackets(&frame, 1); });
+    chip.wedged = false;
+    snprintf(title, sizeof(title), "Wedged chip: error %d, %u waits, %u timed out, longest %u us",
+        radio.error, radio.waitStats.waits, radio.waitStats.timeouts, radio.waitStats.maxUs);
+    print_rows(title);
+
+    printf("\nChip: %u frames received, %u missed, %u overflows, %u FIFO under-reads, %u calibrations\n",
+        chip.framesReceived, chip.framesMissed, chip.overflows, chip.fifoUnderreads, chip.calibrations);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+    Replays captured frames through the firmware's own decode path (src/iboost_events.cpp
+    with the unit table, request schedules and grid estimate) and prints what it would
+    have sent to the display (electricity_event_t) and to MQTT, then how many frames a
+    second it got through. Use it to check a decoder change against real traffic and
+    to see what it costs.
+
+    Reads the "Frame:" lines of notes/packet.txt and rtl_433 flex decoder output (text
+    or JSON, see notes/notes.txt), any other line is skipped. Neither has arrival times
+    so frames are taken to be -i ms apart.
+
+    ArduinoJson is needed, e.g. the copy PlatformIO fetched for the firmware. Build and
+    run from the repository root:
+
+    g++ -std=gnu++11 -O2 -Isupport/host -Iinclude -I.pio/libdeps/esp32wroom32/ArduinoJson/src \
+        src/iboost_events.cpp src/iboost_units.cpp src/request_schedule.cpp src/grid_estimate.cpp \
+        src/frame_dedup.cpp support/host/arduino_shim.cpp support/host/replay.cpp -o replay
+    ./replay [-q] [-i interval_ms] [-d horizon_ms] [-r rounds] [capture ...]
+
+    -q leaves out the event stream (the MQTT messages are still serialised) for timing,
+    -d sets the duplicate horizon (frame_dedup.h, 0 keeps every frame), -r replays the
+    captures that many times. The summary goes to stderr.
+*/
+
+#include <chrono>
+#include <vector>
+#include "iboost_events.h"
+#include "capture.h"
+
+static bool b_quiet = false;
+static uint32_t now_ms = 0;
+static uint64_t event_count = 0;
+static uint64_t message_count = 0;
+static uint64_t message_bytes = 0;
+
+static const char *event_name(sl_event_t event) {
+    static const char *names[] = {"SL_EXPORT", "SL_IMPORT", "SL_NOW", "SL_TODAY", "SL_WT_NOW", "SL_WT_TODAY",
+        "SL_BATTERY", "SL_WT_STATUS", "SL_LQI"};
+    return (unsigned)event < sizeof(names) / sizeof(names[0]) ? names[event] : "?";
+}
+
+static const char *info_name(ib_info_t info) {
+    static const char *names[] = {"IB_NONE", "IB_BATTERY_OK", "IB_BATTERY_LOW", "IB_WT_OFF", "IB_WT_HEATING", "IB_WT_HOT"};
+    return (unsigned)info < sizeof(names) / sizeof(names[0]) ? names[info] : "?";
+}
+
+static void replay_event(const electricity_event_t *event) {
+    event_count++;
+    if (!b_quiet) printf("%u event %s %g %s\n", now_ms, event_name(event->event), event->value, info_name(event->info));
+}
+
+static bool replay_publish(const char *topic, JsonDocument &doc, int64_t arrival_us) {
+    char msg[256];      // PubSubClient's default packet size, as publish_json()
+    size_t size = serializeJson(doc, msg, sizeof(msg));
+    message_count++;
+    message_bytes += size;
+    if (!b_quiet) printf("%u mqtt %s %s\n", now_ms, topic, msg);
+    return true;
+}
+
+static void replay_primary_changed(uint16_t address) {
+    if (!b_quiet) printf("%u primary %04x\n", now_ms, address);
+}
+
+static void replay_publish_failed(void) {
+}
+
+static const iboost_events_sink_t replay_sink = {replay_event, replay_publish, replay_primary_changed, replay_publish_failed};
+
+static bool load(const char *path, std::vector<capture_frame_t> &frames) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        capture_frame_t frame;
+        if (capture_parse_frame(line, &frame) || capture_parse_rtl433(line, &frame)) frames.push_back(frame);
+    }
+    if (file != stdin) fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t interval_ms = 5000;
+    uint32_t rounds = 1;
+    uint32_t horizon_ms = DEDUP_DEFAULT_HORIZON;
+    std::vector<capture_frame_t> frames;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        if (strcmp(argv[arg], "-q") == 0) {
+            b_quiet = true;
+        } else if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc) {
+            interval_ms = (uint32_t)atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) {
+            horizon_ms = (uint32_t)atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+            rounds = (uint32_t)atoi(argv[++arg]);
+        } else {
+            fprintf(stderr, "Usage: %s [-q] [-i interval_ms] [-d horizon_ms] [-r rounds] [capture ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (arg == argc) {
+        if (!load("notes/packet.txt", frames)) return 1;
+    }
+    for (; arg < argc; arg++) {
+        if (!load(argv[arg], frames)) return 1;
+    }
+    if (frames.empty()) {
+        fprintf(stderr, "No frames found\n");
+        return 1;
+    }
+
+    static iboost_units_t units;
+    static iboost_events_t events;
+    units_begin(&units);
+    iboost_events_begin(&events, &units, &replay_sink);
+    frame_dedup_begin(&events.dedup, horizon_ms);
+
+    uint64_t used = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            const capture_frame_t *frame = &frames[i];
+            now_ms += interval_ms;
+            if (iboost_events_frame(&events, frame->data, frame->size, frame->rssi, frame->lqi, now_ms, 0) & EVENTS_USED) {
+                used++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1e9;
+
+    uint64_t total = (uint64_t)frames.size() * rounds;
+    fprintf(stderr, "%zu frames x %u rounds, %llu used, %u duplicates, %llu events, %llu MQTT messages (%llu bytes)\n",
+        frames.size(), rounds, (unsigned long long)used, events.dedup.duplicates, (unsigned long long)event_count,
+        (unsigned long long)message_count, (unsigned long long)message_bytes);
+    fprintf(stderr, "%.3f s, %.0f frames/s, %.2f us/frame\n", seconds, total / seconds, seconds * 1e6 / total);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+Turns a trace dumped by the firmware (trace_dump() in src/trace.cpp, build with -DTRACE
+and send 't' in the serial monitor) into Chrome trace_event JSON. Open the result in
+chrome://tracing or https://ui.perfetto.dev, each task is a row.
+
+    pio device monitor | tee monitor.log
+    python3 support/host/trace_to_chrome.py monitor.log > trace.json
+
+Only the "trace:" lines are read, anything else in the log is skipped. With several
+dumps in the log the last one is used.
+"""
+
+import json
+import struct
+import sys
+
+PHASES = {0: "i", 1: "B", 2: "E"}
+
+
+def parse(lines):
+    """The last dump in lines as (entries, events, tasks, overwritten)."""
+    dump = None
+    for line in lines:
+        at = line.find("trace:")
+        if at < 0:
+            continue
+        fields = line[at + len("trace:"):].split()
+        if not fields:
+            continue
+        if fields[0] == "begin":
+            dump = {"entries": [], "events": {}, "tasks": {}, "overwritten": int(fields[2])}
+        elif dump is None:
+            continue
+        elif fields[0] == "event":
+            dump["events"][int(fields[1])] = " ".join(fields[2:])
+        elif fields[0] == "task":
+            dump["tasks"][int(fields[1])] = " ".join(fields[2:])
+        elif fields[0] == "end":
+            pass
+        else:
+            for field in fields:
+                if len(field) != 16:
+                    continue        # cut short by another task's log output
+                dump["entries"].append(struct.unpack(">IBBH", bytes.fromhex(field)))
+    if dump is None:
+        raise SystemExit("No trace dump found")
+    return dump
+
+
+def convert(dump):
+    """Chrome trace_event JSON object for a parsed dump."""
+    events = []
+    base = None
+    wraps = 0
+    last = None
+    for time_us, event, flags, arg in dump["entries"]:
+        if last is not None and last - time_us > 1 << 31:
+            wraps += 1      # esp_timer_get_time() truncated to 32 bits, not just out of order
+        last = time_us
+        time_us += wraps << 32
+        if base is None:
+            base = time_us
+        task = flags >> 4
+        entry = {
+            "name": dump["events"].get(event, "event %d" % event),
+            "ph": PHASES.get(flags & 0x03, "i"),
+            "ts": time_us - base,
+            "pid": 0,
+            "tid": task,
+            "args": {"arg": arg, "core": (flags >> 2) & 0x01},
+        }
+        if entry["ph"] == "i":
+            entry["s"] = "t"
+        events.append(entry)
+
+    for task, name in dump["tasks"].items():
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": task, "args": {"name": name}})
+    events.append({"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "iBoost Monitor"}})
+    return {"traceEvents": events, "displayTimeUnit": "ms",
+            "otherData": {"overwritten": dump["overwritten"]}}
+
+
+def main():
+    if len(sys.argv) > 2:
+        raise SystemExit("Usage: trace_to_chrome.py [monitor.log] > trace.json")
+    source = open(sys.argv[1], errors="replace") if len(sys.argv) == 2 else sys.stdin
+    with source:
+        dump = parse(source)
+    json.dump(convert(dump), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+    print("%d entries, %d overwritten before the dump" % (len(dump["entries"]), dump["overwritten"]), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()